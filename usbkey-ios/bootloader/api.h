@@ -0,0 +1,178 @@
+/**
+ * @file  api.h
+ * @brief Layout of the bootloader API table (shared with main firmware)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef API_H
+#define API_H
+
+/* Address of the table into flash (just after the vectors) */
+#define API_ADDR    0x000000C0
+#define API_MAGIC   0xDEADBEEF
+/* ABI version : major changes break existing entries, minor add entries */
+#define API_MAJOR   1
+#define API_MINOR   3
+#define API_VERSION ((API_MAJOR << 8) | API_MINOR)
+/* Size of the table (in bytes, from API_ADDR) */
+#define API_SIZE    0x140
+
+/* Feature bitmap : options the bootloader has been compiled with */
+#define API_FEAT_DMA     (1 << 0)
+#define API_FEAT_LOG_BIN (1 << 1)
+#define API_FEAT_NET_LOG (1 << 2)
+#define API_FEAT_PROF    (1 << 3)
+#define API_FEAT_PCAP    (1 << 4)
+
+#ifndef __ASSEMBLER__
+#include "dma.h"
+#include "net.h"
+#include "net_ipv4.h"
+#include "timer.h"
+#include "types.h"
+#include "usb.h"
+#include "usb_ecm.h"
+
+typedef struct _bl_api
+{
+	/* Offset 0xC0 : global */
+	u32   magic;
+	u16   version;    /* ABI version (API_VERSION)           */
+	u16   size;       /* Table size in bytes (API_SIZE)      */
+	u32   features;   /* Compiled options (API_FEAT_x)       */
+	void  (*led_status)(u32 mode);
+	/* Offset 0xD0 : libc */
+	void *(*memset) (void *dst, int value, int n);
+	void *(*memcpy) (void *dst, const void *src, int n);
+	int   (*memcmp) (const void *s1, const void *s2, int n);
+	void *(*memmove)(void *dst, const void *src, int n);
+	/* Offset 0xE0 : usb */
+	void  (*usb_config)   (usb_module *mod);
+	void  (*usb_irq)      (usb_module *mod);
+	int   (*usb_transfer) (usb_module *mod, u8 ep, u8 *data, int len);
+	void  (*usb_ep_enable)(usb_module *mod, u8 ep, u8 mode);
+	/* Offset 0xF0 : uart */
+	void  (*uart_init)    (void);
+	void  (*uart_puts)    (char *s);
+	void  (*uart_puthex)  (const u32 c);
+	int   (*uart_set_baud)(u32 baud);
+	/* Offset 0x100 : network */
+	void  (*net_init)     (network *mod);
+	void  (*net_periodic) (network *mod);
+	u8   *(*net_tx_buffer)(network *mod, u16 proto);
+	void  (*net_send)     (network *mod, u32 size);
+	void  (*ipv4_init)     (network *mod);
+	u8   *(*ipv4_tx_buffer)(network *mod, u32 dest, u8 proto);
+	void  (*ipv4_send)     (network *mod, int len);
+	u16   (*ip_cksum)      (u32 sum, const u8 *data, u16 len);
+	u8   *(*udp4_tx_buffer)(network *mod, udp_conn *conn);
+	void  (*udp4_send)     (network *mod, udp_conn *conn, int len);
+	u8   *(*tcp4_tx_buffer)(tcp_conn *conn);
+	void  (*tcp4_send)     (tcp_conn *conn, int len);
+	void  (*tcp4_close)    (tcp_conn *conn);
+	u32   (*htonl)(u32 v);
+	u16   (*htons)(u16 v);
+	u32   reserved_13c;
+	/* Offset 0x140 : timer */
+	u32   (*timer_now)   (void);
+	void  (*timer_arm)   (timer *tmr, u32 delay);
+	void  (*timer_cancel)(timer *tmr);
+	void  (*timer_periodic)(void);
+	/* Offset 0x150 : statistics */
+	net_stats *(*net_get_stats)(network *mod);
+	usb_stats *(*usb_get_stats)(usb_module *mod);
+	int   (*net_cap_read)(net_cap *rec, u32 *lost); /* 0 without PCAP */
+	u32   reserved_15c;
+	/* Offset 0x160 : flash */
+	int   (*flash_erase)(u32 addr);
+	void  (*flash_write)(u32 addr, u8 *data);
+	u32   reserved_168;
+	u32   reserved_16c;
+	/* Offset 0x170 : usb (continued) */
+	void  (*usb_init)     (void);
+	int   (*usb_submit)   (usb_module *mod, u8 ep, usb_request *req);
+	u8   *(*usb_find_desc)(usb_module *mod, u8 rtype, u8 type, u8 index,
+	                       int *size);
+	u32   reserved_17c;
+	/* Offset 0x180 : usb ecm */
+	void  (*ecm_init)      (usb_module *mod, usb_class *obj);
+	void  (*ecm_rx_prepare)(usb_module *mod);
+	int   (*ecm_tx)        (usb_module *mod, u8 *buffer, u32 size);
+	u32   reserved_18c;
+	/* Offset 0x190 : network (continued) */
+	int   (*net_rx_classify)(network *mod, int *len);
+	void  (*arp_receive)    (network *mod, u8 *data, int length);
+	void  (*ipv4_receive)   (network *mod, u8 *buffer, int length);
+	void  (*dhcp_recv)      (network *netif, udp_packet *pkt, ip_dgram *ip);
+	/* Offset 0x1A0 : timer (continued) */
+	void  (*timer_init)  (void);
+	void  (*timer_irq)   (void);
+	u32   (*timer_cycles)(void);
+	u32   reserved_1ac;
+	/* Offset 0x1B0 : uart (continued) */
+	void  (*uart_irq)       (void);
+	void  (*uart_putc)      (unsigned char c);
+	void  (*uart_flush)     (void);
+	int   (*uart_set_format)(int bits, int parity, int stop);
+	/* Offset 0x1C0 : dma */
+	void  (*dma_init)(void);
+	void  (*dma_irq) (void);
+	int   (*dma_copy)(dma_xfer *xfer);
+	int   (*dma_busy)(void);
+	/* Offset 0x1D0 : log */
+	void  (*log_write)  (u32 id, int n, u32 a, u32 b, u32 c);
+	int   (*log_read)   (u8 *buffer, int len);
+	int   (*log_pending)(void);
+	u32   (*log_drops)  (void);
+	/* Offset 0x1E0 : udp sockets (since 1.1) */
+	int   (*udp4_bind)    (network *mod, udp_socket *sock, u16 port);
+	void  (*udp4_unbind)  (udp_socket *sock);
+	int   (*udp4_sendto)  (udp_socket *sock, udp_conn *to, const u8 *data, int len);
+	int   (*udp4_recvfrom)(udp_socket *sock, udp_conn *from, u8 *buffer, int len);
+	/* Offset 0x1F0 : tcp (since 1.2) */
+	tcp_conn *(*tcp4_connect)(network *netif, u8 family, const void *addr,
+	                          tcp_service *service);
+	u32   reserved_1f4;
+	u32   reserved_1f8;
+	u32   reserved_1fc;
+} bl_api;
+
+/* Pointer to the table, for use by the main firmware */
+#define BL_API ((const bl_api *)API_ADDR)
+
+/* Verify that the structure match offsets of api.S (compile-time) */
+#define API_OFFSET(f, o) \
+	_Static_assert(__builtin_offsetof(bl_api, f) == (o) - API_ADDR, #f)
+API_OFFSET(led_status,    0x0CC);
+API_OFFSET(memset,        0x0D0);
+API_OFFSET(usb_config,    0x0E0);
+API_OFFSET(uart_init,     0x0F0);
+API_OFFSET(net_init,      0x100);
+API_OFFSET(ipv4_init,     0x110);
+API_OFFSET(udp4_tx_buffer, 0x120);
+API_OFFSET(tcp4_close,    0x130);
+API_OFFSET(timer_now,     0x140);
+API_OFFSET(net_get_stats, 0x150);
+API_OFFSET(flash_erase,   0x160);
+API_OFFSET(usb_init,      0x170);
+API_OFFSET(ecm_init,      0x180);
+API_OFFSET(net_rx_classify, 0x190);
+API_OFFSET(timer_init,    0x1A0);
+API_OFFSET(uart_irq,      0x1B0);
+API_OFFSET(dma_init,      0x1C0);
+API_OFFSET(log_write,     0x1D0);
+API_OFFSET(udp4_bind,     0x1E0);
+API_OFFSET(tcp4_connect,  0x1F0);
+_Static_assert(sizeof(bl_api) == API_SIZE, "API_SIZE");
+#endif
+#endif
+/* EOF */
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+#
+# apicheck.py - Compare the slots of api.S with the fields of bl_api (api.h)
+#
+# Copyright (c) 2017 Cowlab
+# Author: Saint-Genest Gwenael <gwen@cowlab.fr>
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 3 as
+# published by the Free Software Foundation. This program is distributed
+# WITHOUT ANY WARRANTY, see LICENSE.md file for more details.
+#
+# Read the preprocessed api.S on stdin and write a C file of compile-time
+# checks : each slot must be the field of bl_api with the same name, at the
+# same offset and with the same size. Slots set to 0 must be the reserved
+# field of their address (reserved_<addr>). Used by "make check".
+#
+# Usage: $(CC) $(CFLAGS) -E -P api.S | apicheck.py > api_check.c
+import os
+import re
+import sys
+
+# Fields of the global header, before the first function pointer
+HEADER = ['magic', 'version', 'size', 'features']
+SIZES = {'.long': 4, '.short': 2, '.byte': 1}
+
+def api_addr():
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'api.h')
+    with open(path) as f:
+        m = re.search(r'#define\s+API_ADDR\s+(0x[0-9A-Fa-f]+)', f.read())
+    return int(m.group(1), 16)
+
+def main():
+    base = api_addr()
+    offset = 0
+    header = list(HEADER)
+    out = ['#include "api.h"', '']
+
+    for line in sys.stdin:
+        words = line.split(None, 1)
+        if not words or words[0] not in SIZES:
+            continue
+        size = SIZES[words[0]]
+        value = words[1].strip()
+        if re.match(r'^[A-Za-z_]\w*$', value):
+            name = value
+            header = []
+        elif header:
+            name = header.pop(0)
+        elif value == '0':
+            name = 'reserved_%x' % (base + offset)
+        else:
+            sys.stderr.write('api.S: unexpected value "%s" at 0x%X\n' %
+                             (value, base + offset))
+            return 1
+        out.append('_Static_assert(__builtin_offsetof(bl_api, %s) == 0x%03X &&'
+                   % (name, offset))
+        out.append('               sizeof(((bl_api *)0)->%s) == %d,'
+                   % (name, size))
+        out.append('               "api.S 0x%03X : %s");' % (base + offset, name))
+        offset += size
+
+    out.append('_Static_assert(sizeof(bl_api) == 0x%03X, "api.S size");' % offset)
+    print('\n'.join(out))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,256 @@
+/**
+ * @file  dma.c
+ * @brief Asynchronous memory copy engine (using DMAC, or CPU as fallback)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "dma.h"
+#include "hardware.h"
+#include "libc.h"
+
+static void dma_cpu_beat(void *dst, const void *src, int len);
+static void dma_cpu_copy(dma_xfer *xfer);
+
+#ifdef USE_DMA
+typedef struct __attribute__((packed))
+{
+	u16 btctrl;   /* Block transfer control      */
+	u16 btcnt;    /* Number of beats in the block */
+	u32 srcaddr;  /* Source address (end of block when incremented) */
+	u32 dstaddr;  /* Destination address (end of block)             */
+	u32 descaddr; /* Address of next descriptor (or 0)              */
+} dma_desc;
+
+/* DMAC descriptors must be aligned on 128 bits (see datasheet 20.8.15) */
+static dma_desc dma_base[1]  __attribute__((aligned(16)));
+static dma_desc dma_wrb[1]   __attribute__((aligned(16)));
+static dma_desc dma_chain[DMA_DESC_MAX - 1] __attribute__((aligned(16)));
+/* Copy job currently processed by the DMAC */
+static dma_xfer * volatile dma_pending;
+#endif
+
+/**
+ * @brief Initialize the copy engine
+ *
+ * With USE_DMA, the DMAC is configured to use channel 0 for memory to memory
+ * copies (software trigger). Else, all copies are made by CPU.
+ */
+void dma_init(void)
+{
+#ifdef USE_DMA
+	dma_pending = 0;
+
+	/* Enable DMAC clocks (AHBMASK and APBBMASK) */
+	reg_set(PM_ADDR + 0x14, (1 << 5));
+	reg_set(PM_ADDR + 0x1C, (1 << 4));
+
+	/* Disable then reset DMAC (set SWRST) */
+	reg16_wr(DMAC_ADDR + 0x00, 0x0000);
+	reg16_wr(DMAC_ADDR + 0x00, 0x0001);
+	while (reg16_rd(DMAC_ADDR + 0x00) & 0x0001)
+		;
+	/* Set address of descriptors and write-back sections */
+	reg_wr(DMAC_ADDR + 0x34, (u32)dma_base);
+	reg_wr(DMAC_ADDR + 0x38, (u32)dma_wrb);
+
+	/* Select channel 0, then reset it */
+	reg8_wr(DMAC_ADDR + 0x3F, 0);
+	reg8_wr(DMAC_ADDR + 0x40, 0x01);
+	while (reg8_rd(DMAC_ADDR + 0x40) & 0x01)
+		;
+	/* Software trigger, one trigger for the whole transaction (chain) */
+	reg_wr(DMAC_ADDR + 0x44, (0x03 << 22) | (0x00 << 8));
+	/* Enable transfer complete (TCMPL) and error (TERR) interrupts */
+	reg8_wr(DMAC_ADDR + 0x4D, 0x03);
+
+	/* Enable DMAC, with all priority levels */
+	reg16_wr(DMAC_ADDR + 0x00, (0x0F << 8) | (1 << 1));
+
+	/* Enable DMAC interrupt into NVIC */
+	reg_wr(0xE000E100, (1 << 6));
+#endif
+}
+
+/**
+ * @brief DMAC interrupt handler
+ *
+ * This function must be called when an interrupt is received from DMAC.
+ */
+void dma_irq(void)
+{
+#ifdef USE_DMA
+	dma_xfer *xfer;
+	u8 flags;
+
+	/* Select channel 0 and read its interrupt flags */
+	reg8_wr(DMAC_ADDR + 0x3F, 0);
+	flags = reg8_rd(DMAC_ADDR + 0x4E);
+	/* Ack/clear events */
+	reg8_wr(DMAC_ADDR + 0x4E, flags);
+
+	xfer = dma_pending;
+	if (xfer == 0)
+		return;
+	dma_pending = 0;
+
+	/* In case of transfer error (TERR), do the copy with CPU */
+	if (flags & 0x01)
+	{
+		dma_cpu_copy(xfer);
+		return;
+	}
+	/* Call completion function of each chained copy */
+	for ( ; xfer; xfer = xfer->next)
+	{
+		if (xfer->complete)
+			xfer->complete(xfer);
+	}
+#endif
+}
+
+/**
+ * @brief Test if the copy engine is processing a job
+ *
+ * @return boolean True if a copy is in progress
+ */
+int dma_busy(void)
+{
+#ifdef USE_DMA
+	return(dma_pending != 0);
+#else
+	return(0);
+#endif
+}
+
+/**
+ * @brief Start an asynchronous copy (or a chain of copies)
+ *
+ * When the DMAC is not available (busy, chain too long, size out of range)
+ * the copies are made by CPU before this function returns. In all cases, the
+ * complete() callback of each item is called, in chain order.
+ *
+ * @param xfer Pointer to the first copy descriptor of the chain
+ * @return integer Zero if started on DMAC, 1 if copied by CPU
+ */
+int dma_copy(dma_xfer *xfer)
+{
+#ifdef USE_DMA
+	dma_xfer *x;
+	dma_desc *desc;
+	int i;
+
+	if (dma_pending != 0)
+		goto cpu;
+	/* The chain must fit into available descriptors */
+	for (x = xfer, i = 0; x; x = x->next)
+		i++;
+	if (i > DMA_DESC_MAX)
+		goto cpu;
+
+	desc = dma_base;
+	for (x = xfer, i = 0; x; x = x->next, i++)
+	{
+		u32 mode = ((u32)x->dst | (u32)x->src | (u32)x->len);
+		u32 beat;
+
+		if (x->len <= 0)
+			goto cpu;
+
+		/* Select the largest beat size allowed by alignment */
+		if ((mode & 3) == 0)
+			beat = 2;
+		else if ((mode & 1) == 0)
+			beat = 1;
+		else
+			beat = 0;
+		if ((x->len >> beat) > 0xFFFF)
+			goto cpu;
+
+		desc->btctrl  = (1 << 11) | (1 << 10) /* DSTINC, SRCINC  */
+		              | (beat << 8)           /* BEATSIZE        */
+		              | (1 << 0);             /* VALID           */
+		desc->btcnt   = (x->len >> beat);
+		desc->srcaddr = (u32)x->src + x->len;
+		desc->dstaddr = (u32)x->dst + x->len;
+		desc->descaddr = 0;
+		if (x->next)
+		{
+			/* Link to next descriptor */
+			desc->descaddr = (u32)&dma_chain[i];
+			desc = &dma_chain[i];
+		}
+		else
+			/* Last block : generate interrupt (BLOCKACT=INT) */
+			desc->btctrl |= (1 << 3);
+	}
+
+	dma_pending = xfer;
+	/* Select channel 0, enable it, then send software trigger */
+	reg8_wr(DMAC_ADDR + 0x3F, 0);
+	reg8_wr(DMAC_ADDR + 0x40, (1 << 1));
+	reg_wr (DMAC_ADDR + 0x10, (1 << 0));
+	return(0);
+cpu:
+#endif
+	dma_cpu_copy(xfer);
+	return(1);
+}
+
+/**
+ * @brief Copy a buffer by CPU with the access size of a DMAC beat
+ *
+ * Like the DMAC, words are used when buffers and length are aligned on 4,
+ * halfwords when aligned on 2, else bytes. Some destinations (NVM page
+ * buffer) reject byte writes, so stores are explicit (not memcpy).
+ *
+ * @param dst Pointer to the destination buffer
+ * @param src Pointer to the source buffer
+ * @param len Number of bytes to copy
+ */
+static void dma_cpu_beat(void *dst, const void *src, int len)
+{
+	u32 mode = ((u32)dst | (u32)src | (u32)len);
+
+	if ((mode & 3) == 0)
+	{
+		volatile u32 *d = (volatile u32 *)dst;
+		const u32 *s = (const u32 *)src;
+		for (len >>= 2; len > 0; len--)
+			*d++ = *s++;
+	}
+	else if ((mode & 1) == 0)
+	{
+		volatile u16 *d = (volatile u16 *)dst;
+		const u16 *s = (const u16 *)src;
+		for (len >>= 1; len > 0; len--)
+			*d++ = *s++;
+	}
+	else
+		memcpy(dst, src, len);
+}
+
+/**
+ * @brief Process a chain of copies using CPU (software backend)
+ *
+ * @param xfer Pointer to the first copy descriptor of the chain
+ */
+static void dma_cpu_copy(dma_xfer *xfer)
+{
+	for ( ; xfer; xfer = xfer->next)
+	{
+		if (xfer->len > 0)
+			dma_cpu_beat(xfer->dst, xfer->src, xfer->len);
+		if (xfer->complete)
+			xfer->complete(xfer);
+	}
+}
+/* EOF */
@@ -0,0 +1,42 @@
+/**
+ * @file  dma.h
+ * @brief Definitions and prototypes for memory copy engine (DMAC)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef DMA_H
+#define DMA_H
+#include "types.h"
+
+/* Max number of chained copies processed by the DMAC in one job */
+#ifndef DMA_DESC_MAX
+#define DMA_DESC_MAX 4
+#endif
+
+typedef struct dma_xfer
+{
+	void       *dst;  /* Pointer to destination buffer */
+	const void *src;  /* Pointer to source buffer      */
+	int         len;  /* Number of bytes to copy       */
+	/* Called when the copy is complete (from ISR when DMAC is used) */
+	void (*complete)(struct dma_xfer *xfer);
+	void *priv;
+	struct dma_xfer *next; /* Next chained copy (or NULL) */
+} dma_xfer;
+
+void  dma_init(void);
+void  dma_irq (void);
+int   dma_busy(void);
+int   dma_copy(dma_xfer *xfer);
+
+#endif
+/* EOF */
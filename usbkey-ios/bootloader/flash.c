@@ -13,16 +13,20 @@
  * License along with this program, see LICENSE.md file for more details.
  * This program is distributed WITHOUT ANY WARRANTY see README file.
  */
+#include "dma.h"
 #include "flash.h"
 #include "hardware.h"
+#include "prof.h"
 
 /**
  * @brief Erase one page of memory
  *
  * @param addr Start address of the page to erase
  */
-int flash_erase(u32 addr)
+RAMFUNC_FLASH int flash_erase(u32 addr)
 {
+	PROF_START(PROF_FLASH_ERASE);
+
 	/* Set ADDR */
 	reg_wr(NVM_ADDR + 0x1C, (addr / 2));
 	/* Erase Row command */
@@ -36,9 +40,11 @@ int flash_erase(u32 addr)
 		u16 status;
 		/* Read (and return) status bits */
 		status = reg16_rd(NVM_ADDR+0x18);
+		PROF_END(PROF_FLASH_ERASE);
 		return(status);
 	}
 
+	PROF_END(PROF_FLASH_ERASE);
 	return(0);
 }
 
@@ -48,14 +54,37 @@ int flash_erase(u32 addr)
  * @param addr Start address of the datas to write
  * @param data Pointer to the datas (source)
  */
-void flash_write(u32 addr, u8 *data)
+RAMFUNC_FLASH void flash_write(u32 addr, u8 *data)
 {
 	u32 *pdest;
 	int len;
 	int  i;
+#ifdef USE_DMA
+	dma_xfer xfer;
+#endif
+	PROF_START(PROF_FLASH_WRITE);
 
 	len = 64;
 	pdest = (u32 *)addr;
+#ifdef USE_DMA
+	/* Page buffer only accepts 16/32 bits accesses, use DMAC if aligned. */
+	/* When DMAC can not be used, the copy engine falls back to CPU with  */
+	/* the same (halfword or word) accesses                               */
+	if (((u32)data & 1) == 0)
+	{
+		xfer.dst = pdest;
+		xfer.src = data;
+		xfer.len = len;
+		xfer.complete = 0;
+		xfer.next = 0;
+		if (dma_copy(&xfer) == 0)
+		{
+			while (dma_busy())
+				;
+		}
+	}
+	else
+#endif
 	for (i = 0; i < 16; i++)
 	{
 		u32 word;
@@ -74,6 +103,7 @@ void flash_write(u32 addr, u8 *data)
 	reg16_wr(NVM_ADDR + 0x00, (0xA5 << 8) | 0x04);
 	while( (reg8_rd(NVM_ADDR+0x14) & 1) == 0)
 		;
+	PROF_END(PROF_FLASH_WRITE);
 	return;
 }
 /* EOF */
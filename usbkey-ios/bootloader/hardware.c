@@ -20,6 +20,23 @@ static inline void hw_init_clock(void);
 static inline void hw_init_leds(void);
 static inline void hw_init_uart(void);
 
+/**
+ * @brief Minimal init, only what is needed to select the boot mode
+ *
+ * This function only configure the push-button IO. Clocks are left in their
+ * reset state (OSC8M with prescaler 8, CPU at 1MHz) so the main firmware can
+ * be started as fast as possible.
+ */
+void hw_init_early(void)
+{
+	int i;
+
+	hw_init_button();
+	/* Wait for pull-up and input synchronizer (a few us at 1MHz) */
+	for (i = 0; i < 8; i++)
+		__asm__ volatile ("nop");
+}
+
 /**
  * @brief Called on startup to init processor, clocks and some peripherals
  *
@@ -258,6 +275,51 @@ int button_status(void)
 	return(0);
 }
 
+/**
+ * @brief Read the 128 bits unique serial number of the chip
+ *
+ * @param sn Pointer to an array of 4 words where the number is copied
+ */
+void hw_serial(u32 *sn)
+{
+	sn[0] = reg_rd(0x0080A00C);
+	sn[1] = reg_rd(0x0080A040);
+	sn[2] = reg_rd(0x0080A044);
+	sn[3] = reg_rd(0x0080A048);
+}
+
+#ifdef USE_BOOT_MARK
+/**
+ * @brief Drive the status LED pin as a GPIO to mark boot steps
+ *
+ * The pin is set at reset and cleared just before jumping into the main
+ * firmware, the time-to-application can then be measured with a scope or a
+ * logic analyzer (from reset release to the falling edge).
+ *
+ * @param state New state of the pin (1 during boot, 0 on firmware start)
+ */
+void boot_mark(int state)
+{
+#ifdef XPLAINED
+	/* DIR: Set PB30 as output, PINCFG: GPIO */
+	reg_wr (0x60000080 + 0x08, (1 << 30));
+	reg8_wr(0x60000080 + 0x5E, 0x40);
+	if (state)
+		reg_wr(0x60000080 + 0x18, (1 << 30));
+	else
+		reg_wr(0x60000080 + 0x14, (1 << 30));
+#else
+	/* DIR: Set PA15 as output, PINCFG: GPIO */
+	reg_wr (0x60000000 + 0x08, (1 << 15));
+	reg8_wr(0x60000000 + 0x4F, 0x40);
+	if (state)
+		reg_wr(0x60000000 + 0x18, (1 << 15));
+	else
+		reg_wr(0x60000000 + 0x14, (1 << 15));
+#endif
+}
+#endif
+
 /**
  * @brief Set status LED state
  *
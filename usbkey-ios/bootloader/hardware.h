@@ -24,14 +24,79 @@
 #define GCLK_ADDR    ((u32)0x40000C00)
 /* AHB-APB Bridge B */
 #define NVM_ADDR     ((u32)0x41004000)
+#define DMAC_ADDR    ((u32)0x41004800)
 #define USB_ADDR     ((u32)0x41005000)
 /* Bridge C */
 #define TCC0_ADDR    ((u32)0x42002000)
 
 void hw_init(void);
+void hw_init_early(void);
 int  button_status(void);
+void hw_serial(u32 *sn);
 void led_status(u32 mode);
 
+/* Place a function into SRAM (copied on startup, see cowstick.ld) to avoid */
+/* flash wait-states and stalls while the NVM is programmed.                */
+#ifdef USE_RAMFUNC
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline))
+#else
+#define RAMFUNC
+#endif
+/* Placement of each group of functions, can be set from CFLAGS to move */
+/* only some of them into SRAM (ex: -DRAMFUNC_FLASH= to keep in flash)  */
+#ifndef RAMFUNC_USB
+#define RAMFUNC_USB   RAMFUNC
+#endif
+#ifndef RAMFUNC_CKSUM
+#define RAMFUNC_CKSUM RAMFUNC
+#endif
+#ifndef RAMFUNC_FLASH
+#define RAMFUNC_FLASH RAMFUNC
+#endif
+
+#ifdef USE_BOOT_MARK
+void boot_mark(int state);
+#define BOOT_MARK(x) boot_mark(x)
+#else
+#define BOOT_MARK(x)
+#endif
+
+#ifdef HW_EMUL
+/* When built for a host-side peripheral model, all register accesses are
+ * routed to functions provided by the emulator instead of the bus. */
+u32  reg_rd  (u32 reg);
+u8   reg8_rd (u32 reg);
+u16  reg16_rd(u32 reg);
+void reg_wr  (u32 reg, u32 value);
+void reg16_wr(u32 reg, u16 value);
+void reg8_wr (u32 reg, u8 value);
+void reg_set (u32 reg, u32 value);
+u32  irq_save   (void);
+void irq_restore(u32 state);
+#else
+/**
+ * @brief Disable all interrupts, and get previous state
+ *
+ * @return u32 Previous value of PRIMASK (to use with irq_restore)
+ */
+static inline u32 irq_save(void)
+{
+	u32 state;
+	__asm__ volatile ("mrs %0, primask\n\tcpsid i" : "=r" (state) : : "memory");
+	return(state);
+}
+
+/**
+ * @brief Restore interrupts state saved by irq_save()
+ *
+ * @param state Value of PRIMASK returned by irq_save()
+ */
+static inline void irq_restore(u32 state)
+{
+	__asm__ volatile ("msr primask, %0" : : "r" (state) : "memory");
+}
+
+
 /**
  * @brief Read the value of a 32bits memory mapped register
  *
@@ -108,5 +173,6 @@ static inline void reg_set(u32 reg, u32 value)
 {
   *(volatile u32 *)reg = (*(volatile u32 *)reg | value);
 }
+#endif /* HW_EMUL */
 
 #endif
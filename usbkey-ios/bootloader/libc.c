@@ -19,24 +19,85 @@
 /**
  * @brief Copy 'n' bytes from a source buffer to a destination buffer
  *
+ * When source and destination have the same alignment, the copy is made by
+ * blocks of 16 bytes (4 words, that gcc emit as ldm/stm) then by words. If
+ * they are only halfword compatible (ethernet payloads), halfwords are used.
+ *
  * @param dst Pointer to the destination buffer
  * @param src Pointer to the source buffer
  * @param n   NUmber of bytes to copy
  */
 void *memcpy(void *dst, const void *src, int n)
 {
-        u8 *s;
-        u8 *d;
-        s = (u8*)src;
-        d = (u8*)dst;
-        while(n)
-        {
-                *d = *s;
-                s ++;
-                d ++;
-                n --;
-        }
-        return(dst);
+	const u8 *s = (const u8 *)src;
+	u8 *d = (u8 *)dst;
+
+	if ((((u32)d ^ (u32)s) & 3) == 0)
+	{
+		const u32 *sw;
+		u32 *dw;
+
+		/* Copy first bytes until pointers are word aligned */
+		while (((u32)d & 3) && (n > 0))
+		{
+			*d++ = *s++;
+			n--;
+		}
+		sw = (const u32 *)s;
+		dw = (u32 *)d;
+		/* Copy blocks of 16 bytes */
+		while (n >= 16)
+		{
+			u32 a = sw[0], b = sw[1], c = sw[2], e = sw[3];
+			dw[0] = a; dw[1] = b; dw[2] = c; dw[3] = e;
+			sw += 4;
+			dw += 4;
+			n  -= 16;
+		}
+		/* Copy remaining words */
+		while (n >= 4)
+		{
+			*dw++ = *sw++;
+			n -= 4;
+		}
+		s = (const u8 *)sw;
+		d = (u8 *)dw;
+	}
+	else if ((((u32)d ^ (u32)s) & 1) == 0)
+	{
+		const u16 *sh;
+		u16 *dh;
+
+		if (((u32)d & 1) && (n > 0))
+		{
+			*d++ = *s++;
+			n--;
+		}
+		sh = (const u16 *)s;
+		dh = (u16 *)d;
+		while (n >= 8)
+		{
+			u16 a = sh[0], b = sh[1], c = sh[2], e = sh[3];
+			dh[0] = a; dh[1] = b; dh[2] = c; dh[3] = e;
+			sh += 4;
+			dh += 4;
+			n  -= 8;
+		}
+		while (n >= 2)
+		{
+			*dh++ = *sh++;
+			n -= 2;
+		}
+		s = (const u8 *)sh;
+		d = (u8 *)dh;
+	}
+	/* Copy last bytes (or all bytes if pointers are not compatible) */
+	while (n > 0)
+	{
+		*d++ = *s++;
+		n--;
+	}
+	return(dst);
 }
 
 /**
@@ -48,15 +109,123 @@ void *memcpy(void *dst, const void *src, int n)
  */
 void *memset(void *dst, int value, int n)
 {
-        u8 *d;
-        d = (u8 *)dst;
-        while(n)
-        {
-                *d  = value;
-                d++;
-                n --;
-        }
-        return(dst);
+	u8 *d = (u8 *)dst;
+	u32 *dw;
+	u32 w;
+
+	/* Fill first bytes until pointer is word aligned */
+	while (((u32)d & 3) && (n > 0))
+	{
+		*d++ = value;
+		n--;
+	}
+	/* Fill by blocks of 16 bytes, then by words */
+	w  = (value & 0xFF) * 0x01010101;
+	dw = (u32 *)d;
+	while (n >= 16)
+	{
+		dw[0] = w; dw[1] = w; dw[2] = w; dw[3] = w;
+		dw += 4;
+		n  -= 16;
+	}
+	while (n >= 4)
+	{
+		*dw++ = w;
+		n -= 4;
+	}
+	/* Fill last bytes */
+	d = (u8 *)dw;
+	while (n > 0)
+	{
+		*d++ = value;
+		n--;
+	}
+	return(dst);
+}
+
+/**
+ * @brief Compare two buffers
+ *
+ * @param s1 Pointer to the first buffer
+ * @param s2 Pointer to the second buffer
+ * @param n  Number of bytes to compare
+ * @return integer Zero if equal, else difference of the first different bytes
+ */
+int memcmp(const void *s1, const void *s2, int n)
+{
+	const u8 *p1 = (const u8 *)s1;
+	const u8 *p2 = (const u8 *)s2;
+
+	if ((((u32)p1 ^ (u32)p2) & 3) == 0)
+	{
+		while (((u32)p1 & 3) && (n > 0))
+		{
+			if (*p1 != *p2)
+				return(*p1 - *p2);
+			p1++;
+			p2++;
+			n--;
+		}
+		/* Skip equal words, the different one is compared by bytes */
+		while ((n >= 4) && (*(const u32 *)p1 == *(const u32 *)p2))
+		{
+			p1 += 4;
+			p2 += 4;
+			n  -= 4;
+		}
+	}
+	while (n > 0)
+	{
+		if (*p1 != *p2)
+			return(*p1 - *p2);
+		p1++;
+		p2++;
+		n--;
+	}
+	return(0);
+}
+
+/**
+ * @brief Copy 'n' bytes between buffers that may overlap
+ *
+ * @param dst Pointer to the destination buffer
+ * @param src Pointer to the source buffer
+ * @param n   Number of bytes to copy
+ * @return Pointer to the destination buffer
+ */
+void *memmove(void *dst, const void *src, int n)
+{
+	const u8 *s = (const u8 *)src;
+	u8 *d = (u8 *)dst;
+
+	/* If destination is before source (or after its end), copy forward */
+	if ((d <= s) || (d >= (s + n)))
+		return memcpy(dst, src, n);
+
+	/* Else, copy backward from the end */
+	s += n;
+	d += n;
+	if ((((u32)d ^ (u32)s) & 3) == 0)
+	{
+		while (((u32)d & 3) && (n > 0))
+		{
+			*--d = *--s;
+			n--;
+		}
+		while (n >= 4)
+		{
+			d -= 4;
+			s -= 4;
+			*(u32 *)d = *(const u32 *)s;
+			n -= 4;
+		}
+	}
+	while (n > 0)
+	{
+		*--d = *--s;
+		n--;
+	}
+	return(dst);
 }
 
 /****************************** STRING functions ******************************/
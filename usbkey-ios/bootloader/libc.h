@@ -16,7 +16,9 @@
 #ifndef LIBC_H
 #define LIBC_H
 
+int   memcmp (const void *s1, const void *s2, int n);
 void *memcpy (void *dst, const void *src, int n);
+void *memmove(void *dst, const void *src, int n);
 void *memset (void *dst, int value, int n);
 #ifdef USE_LIBC_STRING
 char *strcpy (char *dest, const char *src);
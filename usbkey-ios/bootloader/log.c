@@ -0,0 +1,225 @@
+/**
+ * @file  log.c
+ * @brief Deferred (binary) log and text formatting for debug messages
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "hardware.h"
+#include "log.h"
+#include "timer.h"
+#include "uart.h"
+
+#define LOG_MASK (LOG_RING_SIZE - 1)
+
+/* A record is made of 2 to 5 words :
+ *  - Header    : [31:24] 0xA5 marker [17:16] args count [15:0] string id
+ *  - Timestamp : value of timer_now() (ms)
+ *  - Arguments : 0 to 3 words
+ */
+#define LOG_MARK 0xA5000000
+
+static u32 log_ring[LOG_RING_SIZE];
+static volatile u16 log_head;
+static volatile u16 log_tail;
+static u32 log_lost;
+
+/**
+ * @brief Initialize log ring
+ *
+ */
+void log_init(void)
+{
+	log_head = 0;
+	log_tail = 0;
+	log_lost = 0;
+}
+
+/**
+ * @brief Get the number of records dropped because the ring was full
+ *
+ * @return u32 Number of lost records
+ */
+u32 log_drops(void)
+{
+	return(log_lost);
+}
+
+/**
+ * @brief Get the number of bytes waiting into the log ring
+ *
+ * @return integer Size of pending records (in bytes, as read by log_read)
+ */
+int log_pending(void)
+{
+	return(((log_head - log_tail) & LOG_MASK) * 4);
+}
+
+/**
+ * @brief Insert a binary record into the log ring
+ *
+ * This function is called by LOGx macros, it can be used from interrupts.
+ *
+ * @param id Identifier of the format string (offset into .logstr)
+ * @param n  Number of arguments (0 to 3)
+ * @param a  First argument
+ * @param b  Second argument
+ * @param c  Third argument
+ */
+void log_write(u32 id, int n, u32 a, u32 b, u32 c)
+{
+	u32 irq;
+	u16 head;
+
+	irq  = irq_save();
+	head = log_head;
+	/* If there is not enough space for this record, drop it */
+	if ((u16)((log_tail - head - 1) & LOG_MASK) < (2 + n))
+	{
+		log_lost++;
+		irq_restore(irq);
+		return;
+	}
+	log_ring[head] = LOG_MARK | (n << 16) | (id & 0xFFFF);
+	head = (head + 1) & LOG_MASK;
+	log_ring[head] = timer_now();
+	head = (head + 1) & LOG_MASK;
+	if (n > 0)
+	{
+		log_ring[head] = a;
+		head = (head + 1) & LOG_MASK;
+	}
+	if (n > 1)
+	{
+		log_ring[head] = b;
+		head = (head + 1) & LOG_MASK;
+	}
+	if (n > 2)
+	{
+		log_ring[head] = c;
+		head = (head + 1) & LOG_MASK;
+	}
+	log_head = head;
+	irq_restore(irq);
+}
+
+/**
+ * @brief Extract complete records from the log ring
+ *
+ * @param buffer Pointer to a buffer where records are copied
+ * @param len    Size of the buffer (in bytes)
+ * @return integer Number of bytes copied into the buffer
+ */
+int log_read(u8 *buffer, int len)
+{
+	int count = 0;
+
+	while (log_tail != log_head)
+	{
+		u32 hdr = log_ring[log_tail];
+		int size = 2 + ((hdr >> 16) & 3);
+		int i;
+
+		/* Stop if the next record does not fit into buffer */
+		if ((count + (size * 4)) > len)
+			break;
+		for (i = 0; i < size; i++)
+		{
+			u32 v = log_ring[log_tail];
+			buffer[0] = (v >>  0) & 0xFF;
+			buffer[1] = (v >>  8) & 0xFF;
+			buffer[2] = (v >> 16) & 0xFF;
+			buffer[3] = (v >> 24) & 0xFF;
+			buffer += 4;
+			log_tail = (log_tail + 1) & LOG_MASK;
+		}
+		count += (size * 4);
+	}
+	return(count);
+}
+
+/**
+ * @brief Send pending binary records over UART
+ *
+ * This function must be called periodically (from main loop). Only complete
+ * records are sent, depending on free space into UART TX ring. When the
+ * UDP log sink is used (USE_NET_LOG) records are sent by net_log instead.
+ */
+void log_periodic(void)
+{
+#if defined(USE_LOG_BIN) && !defined(USE_NET_LOG)
+	u8  buffer[40];
+	int len;
+	int i;
+
+	len = uart_free();
+	if (len > (int)sizeof(buffer))
+		len = sizeof(buffer);
+
+	len = log_read(buffer, len);
+	for (i = 0; i < len; i++)
+		uart_putc(buffer[i]);
+#endif
+}
+
+/**
+ * @brief Send a formatted log message over UART (when binary log is unused)
+ *
+ * Only a small subset of printf is supported : %c and %X with optional
+ * width (%02X, %04X or %08X).
+ *
+ * @param fmt Pointer to the format string
+ * @param n   Number of arguments
+ * @param a   First argument
+ * @param b   Second argument
+ * @param c   Third argument
+ */
+void log_text(const char *fmt, int n, u32 a, u32 b, u32 c)
+{
+	u32 args[3];
+	int arg = 0;
+
+	args[0] = a;
+	args[1] = b;
+	args[2] = c;
+
+	for ( ; *fmt; fmt++)
+	{
+		u32 v;
+		int width = 0;
+
+		if ((*fmt != '%') || (arg >= n))
+		{
+			uart_putc(*fmt);
+			continue;
+		}
+		fmt++;
+		/* Get optional width */
+		while ((*fmt >= '0') && (*fmt <= '9'))
+			width = (width * 10) + (*fmt++ - '0');
+
+		v = args[arg++];
+		if (*fmt == 'c')
+			uart_putc(v);
+		else if (*fmt == 'X')
+		{
+			if (width == 2)
+				uart_puthex8(v);
+			else if (width == 4)
+				uart_puthex16(v);
+			else
+				uart_puthex(v);
+		}
+		else if (*fmt == 0)
+			break;
+	}
+}
+/* EOF */
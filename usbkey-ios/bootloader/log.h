@@ -1,5 +1,5 @@
 /**
- * @file  usb.h
+ * @file  log.h
  * @brief Global definitions used for log and debug
  *
  * @author Saint-Genest Gwenael <gwen@cowlab.fr>
@@ -16,11 +16,50 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include "types.h"
 #include "uart.h"
 
+/* Size of the binary log ring (in 32bits words, must be a power of two) */
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 128
+#endif
+
+#ifdef USE_LOG_BIN
+/* Format strings are stored into a section that is not loaded on target,
+ * a record only contains the offset of its string into this section. The
+ * host tool logdecode.py use the ELF file to expand records. */
+#define LOG_REC(fmt, n, a, b, c) do { \
+	static const char log_fmt[] __attribute__((section(".logstr"))) = fmt; \
+	log_write((u32)log_fmt, n, (u32)(a), (u32)(b), (u32)(c)); \
+	} while(0)
+#else
+#define LOG_REC(fmt, n, a, b, c) \
+	log_text(fmt, n, (u32)(a), (u32)(b), (u32)(c))
+#endif
+
+#define LOG0(fmt)          LOG_REC(fmt, 0, 0, 0, 0)
+#define LOG1(fmt, a)       LOG_REC(fmt, 1, a, 0, 0)
+#define LOG2(fmt, a, b)    LOG_REC(fmt, 2, a, b, 0)
+#define LOG3(fmt, a, b, c) LOG_REC(fmt, 3, a, b, c)
+
+#ifdef USE_LOG_BIN
+#define DBG_PUTC(x)     LOG1("%c", x)
+#define DBG_PUTS(x)     LOG0(x)
+#define DBG_PUTHEX8(x)  LOG1("%02X", x)
+#define DBG_PUTHEX16(x) LOG1("%04X", x)
+#else
 #define DBG_PUTC(x)     uart_putc(x)
 #define DBG_PUTS(x)     uart_puts(x)
 #define DBG_PUTHEX8(x)  uart_puthex8(x)
 #define DBG_PUTHEX16(x) uart_puthex16(x)
+#endif
+
+u32  log_drops(void);
+void log_init (void);
+int  log_pending(void);
+void log_periodic(void);
+int  log_read (u8 *buffer, int len);
+void log_text (const char *fmt, int n, u32 a, u32 b, u32 c);
+void log_write(u32 id, int n, u32 a, u32 b, u32 c);
 
 #endif
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+#
+# logdecode.py - Decode binary log records sent by the bootloader
+#
+# Copyright (c) 2017 Cowlab
+# Author: Saint-Genest Gwenael <gwen@cowlab.fr>
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 3 as
+# published by the Free Software Foundation. This program is distributed
+# WITHOUT ANY WARRANTY, see LICENSE.md file for more details.
+#
+# Usage: logdecode.py cowstick.elf < capture.bin
+#        logdecode.py cowstick.elf capture.bin
+#        logdecode.py cowstick.elf udp:1514
+#
+# When the bootloader is built with USE_LOG_BIN, each log record is sent as
+# little-endian 32bits words : header (0xA5 marker, args count, string id),
+# timestamp (ms) and 0 to 3 arguments. The string id is the offset of the
+# format string into the .logstr section of the ELF file. Bytes that are
+# not part of a record (raw text) are copied as-is.
+#
+# With USE_NET_LOG, records are received into UDP datagrams. Each datagram
+# starts with a sequence number and the count of lost records (two 32bits
+# little-endian words).
+import socket
+import struct
+import sys
+
+def load_strings(path):
+    with open(path, 'rb') as f:
+        elf = f.read()
+    (shoff,) = struct.unpack_from('<I', elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from('<HHH', elf, 0x2E)
+
+    def section(i):
+        return struct.unpack_from('<IIIIIIIIII', elf, shoff + i * shentsize)
+
+    names = section(shstrndx)
+    for i in range(shnum):
+        sh = section(i)
+        name = elf[names[4] + sh[0]:].split(b'\0', 1)[0]
+        if name == b'.logstr':
+            return elf[sh[4]:sh[4] + sh[5]]
+    raise SystemExit('No .logstr section into %s' % path)
+
+def get_string(strings, offset):
+    s = strings[offset:].split(b'\0', 1)[0].decode('ascii', 'replace')
+    # Format strings use the printf syntax supported by log_text()
+    return s.replace('\r\n', '\n')
+
+def decode(strings, data, out):
+    pos = 0
+    while pos < len(data):
+        if (pos + 8 <= len(data)) and (data[pos + 3] == 0xA5):
+            (hdr, ts) = struct.unpack_from('<II', data, pos)
+            n = (hdr >> 16) & 0xFF
+            sid = hdr & 0xFFFF
+            if (n <= 3) and (sid < len(strings)) and \
+               (pos + 8 + 4 * n <= len(data)):
+                args = struct.unpack_from('<%dI' % n, data, pos + 8)
+                fmt = get_string(strings, sid)
+                try:
+                    text = fmt % args
+                except (TypeError, ValueError):
+                    text = '%s %s' % (fmt, args)
+                out.write('[%10d.%03d] %s' % (ts // 1000, ts % 1000, text))
+                pos += 8 + 4 * n
+                continue
+        # Not a record, copy raw byte
+        out.write(chr(data[pos]))
+        pos += 1
+
+def listen_udp(strings, port, out):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(('', port))
+    next_seq = None
+    lost = 0
+    while True:
+        data = sock.recv(2048)
+        if len(data) < 8:
+            continue
+        (seq, drops) = struct.unpack_from('<II', data, 0)
+        if (next_seq is not None) and (seq != next_seq):
+            out.write('*** %d datagram(s) lost\n' % ((seq - next_seq) & 0xFFFFFFFF))
+        if drops != lost:
+            out.write('*** %d record(s) dropped on target\n' % (drops - lost))
+            lost = drops
+        next_seq = (seq + 1) & 0xFFFFFFFF
+        decode(strings, data[8:], out)
+        out.flush()
+
+def main():
+    if len(sys.argv) < 2:
+        raise SystemExit('Usage: %s <elf> [capture]' % sys.argv[0])
+    strings = load_strings(sys.argv[1])
+    if (len(sys.argv) > 2) and sys.argv[2].startswith('udp:'):
+        listen_udp(strings, int(sys.argv[2][4:]), sys.stdout)
+        return
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], 'rb') as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+    decode(strings, data, sys.stdout)
+
+if __name__ == '__main__':
+    main()
@@ -13,11 +13,20 @@
  * License along with this program, see LICENSE.md file for more details.
  * This program is distributed WITHOUT ANY WARRANTY see README file.
  */
+#include "api.h"
+#include "dma.h"
 #include "hardware.h"
 #include "libc.h"
+#include "log.h"
 #include "net.h"
 #include "net_ipv4.h"
+#include "net_log.h"
+#include "net_pcap.h"
+#include "net_prof.h"
+#include "net_stats.h"
 #include "net_upgrd.h"
+#include "prof.h"
+#include "timer.h"
 #include "uart.h"
 #include "usb.h"
 #include "usb_ecm.h"
@@ -34,32 +43,43 @@ usb_module usbmod;
  */
 int main(void)
 {
+	u32 stack, handler;
+
+	BOOT_MARK(1);
+#ifdef USE_FAST_BOOT
+	/* Only push-button is initialized, clocks are kept in reset state */
+	hw_init_early();
+#else
 	/* Initialize low-level hardware*/
 	hw_init();
+#endif
+
+	/* Get stack address from firmware vector 0 */
+	stack   = *(u32 *)0x00004000;
+	/* Get firmware entry point from vector 1 */
+	handler = *(u32 *)0x00004004;
 
 	/* If button is pressed at power on, start into Bootloader mode */
-	if (button_status())
-		bootloader();
-	/* Else, start the main firmware */
-	else
+	/* In case of invalid stack address, start bootloader too       */
+	if (button_status() || (stack < 0x20000000) || (stack > 0x20008000))
 	{
-		/* Get stack address from firmware vector 0 */
-		u32 stack   = *(u32 *)0x00004000;
-		/* Get firmware entry point from vector 1 */
-		u32 handler = *(u32 *)0x00004004;
-
-		/* In case of invalid stack address, start bootloader */
-		if ((stack < 0x20000000) || (stack > 0x20008000))
-			bootloader();
+#ifdef USE_FAST_BOOT
+		/* Bootloader needs clocks, LED and UART */
+		hw_init();
+#endif
+		bootloader();
+	}
 
-		led_status(0x00020028);
+#ifndef USE_FAST_BOOT
+	led_status(0x00020028);
+#endif
+	BOOT_MARK(0);
 
-		/* Update Vector Table Offset Register */
-		reg_wr(0xE000ED08, 0x00004000);
+	/* Update Vector Table Offset Register */
+	reg_wr(0xE000ED08, 0x00004000);
 
-		/* Go ! Go ! Go ! */
-		Jumper(handler, stack);
-	}
+	/* Go ! Go ! Go ! */
+	Jumper(handler, stack);
 
 	/* Never comes here */
 	return(0);
@@ -68,6 +88,7 @@ int main(void)
 /* Bootloader variables */
 static u8 bl_net_rx_buffer[512];
 static u8 bl_net_tx_buffer[512];
+static u8 bl_usb_desc[sizeof(usb_ecm_desc)];
 
 /**
  * @brief Main function when start in bootloader mode
@@ -78,31 +99,57 @@ static void bootloader(void)
 	usb_class   ecm_class;
 	network     net_cfg;
 	tcp_conn    tcp_conns[2];
-	tcp_service tcp_services;
+	tcp_service tcp_services[2];
 	upgrd       upgrd_session;
+	u8          host_mac[6];
+#ifdef USE_PCAP
+	pcap_session pcap;
+#endif
 
 	/* Initialize UART debug port */
 	uart_init();
+	/* Initialize memory copy engine */
+	dma_init();
+	/* Initialize timebase and software timers */
+	timer_init();
+	/* Initialize log ring */
+	log_init();
+#ifdef USE_PROF
+	/* Clear profiler counters */
+	prof_init();
+#endif
 	/* Initialize USB stack */
 	usb_init();
 
 	uart_puts("--=={ Cowstick Bootloader }==--\r\n");
 
 	/* Initialize sock-upgrade service */
-	upgrd_init(&tcp_services, &upgrd_session);
+	upgrd_init(&tcp_services[0], &upgrd_session);
+#ifdef USE_PCAP
+	/* Initialize capture streaming service */
+	pcap_init(&tcp_services[1], &pcap);
+#endif
 
 	/* Init TCP connections */
 	net_cfg.tcp.conns = &tcp_conns[0];
 	net_cfg.tcp.conn_count = 2;
 	/* Init TCP services */
-	net_cfg.tcp.services = &tcp_services;
+	net_cfg.tcp.services = &tcp_services[0];
 	net_cfg.tcp.service_count = 1;
+#ifdef USE_PCAP
+	net_cfg.tcp.service_count = 2;
+#endif
 	/* Initialize network interface */
 	net_init(&net_cfg);
+	/* Initialize UDP services */
+	netlog_init(&net_cfg);
+	netprof_init(&net_cfg);
+	stats_init(&net_cfg);
 	/* Configure network interface : set RX/TX buffers */
 	net_cfg.rx_buffer = bl_net_rx_buffer;
 	net_cfg.rx_length = 0;
 	net_cfg.rx_state  = 0;
+	net_cfg.rx_flow   = 0;
 	net_cfg.tx_buffer = bl_net_tx_buffer;
 	net_cfg.tx_more   = 0;
 	/* Save pointer to USB ECM driver */
@@ -110,7 +157,12 @@ static void bootloader(void)
 
 	/* Configure USB device (and attach it) */
 	memset(&usbmod, 0, sizeof(usb_module));
-	usbmod.desc = (u8*)usb_ecm_desc;
+	/* Descriptors are copied into RAM to set the MAC address string */
+	memcpy(bl_usb_desc, usb_ecm_desc, sizeof(usb_ecm_desc));
+	usbmod.desc = bl_usb_desc;
+	memcpy(host_mac, net_cfg.mac, 6);
+	host_mac[5] &= 0xFE;
+	ecm_set_mac(&usbmod, host_mac);
 	ecm_init(&usbmod, &ecm_class);
 	ecm_class.priv = (void *)&net_cfg;
 	usb_config(&usbmod);
@@ -121,6 +173,12 @@ static void bootloader(void)
 	while(1)
 	{
 		net_periodic(&net_cfg);
+		timer_periodic();
+		log_periodic();
+		netlog_periodic(&net_cfg);
+#ifdef USE_PCAP
+		pcap_periodic(&pcap);
+#endif
 	}
 }
 
@@ -132,4 +190,31 @@ void USB_Handler(void)
 {
 	usb_irq(&usbmod);
 }
+
+/**
+ * @brief SysTick interrupt handler (1ms timebase)
+ *
+ */
+void SysTick_Handler(void)
+{
+	timer_irq();
+}
+
+/**
+ * @brief SERCOM3 interrupt handler (debug UART)
+ *
+ */
+void SERCOM3_Handler(void)
+{
+	uart_irq();
+}
+
+/**
+ * @brief DMA controller interrupt handler
+ *
+ */
+void DMAC_Handler(void)
+{
+	dma_irq();
+}
 /* EOF */
@@ -16,13 +16,29 @@
 #include "net.h"
 #include "net_arp.h"
 #include "net_ipv4.h"
+#include "net_ipv6.h"
+#include "net_mdns.h"
+#include "prof.h"
+#include "hardware.h"
 #include "libc.h"
+#include "timer.h"
 #include "types.h"
 #include "uart.h"
 #include "usb_ecm.h"
 
 static const u8 cfg_mac[6] = {0x70, 0xB3, 0xD5, 0x4C, 0xE8, 0x01};
 
+static void net_addr_init(network *mod);
+static int  net_rx_filter(network *mod, int *plen);
+#ifdef USE_PCAP
+static void net_cap_record(u8 *frame, int len, int dir, int flow);
+
+static net_cap cap_ring[NET_CAP_SLOTS];
+static u16 cap_head;
+static u16 cap_tail;
+static u32 cap_lost; /* Frames overwritten before being read */
+#endif
+
 /**
  * @brief Generic function to convert a long value to network byte order
  *
@@ -58,11 +74,75 @@ u16  htons(u16 v)
  */
 void net_init(network *mod)
 {
-	/* Set the default MAC address for the interface */
-	memcpy(mod->mac, cfg_mac, 6);
+	/* Set MAC and IP addresses of the interface */
+	net_addr_init(mod);
+	/* Clear counters */
+	memset(&mod->stats, 0, sizeof(net_stats));
+	/* Clear ARP cache */
+	arp_init(mod);
+#ifdef USE_PCAP
+	/* Clear capture ring */
+	cap_head = 0;
+	cap_tail = 0;
+	cap_lost = 0;
+#endif
 
 	/* Initialize IPv4 for this interface */
 	ipv4_init(mod);
+#ifdef USE_IPV6
+	/* Set link-local address and clear neighbor cache */
+	ipv6_init(mod);
+#endif
+#ifdef USE_MDNS
+	/* Make the mDNS response (services must be configured) */
+	mdns_init(mod);
+#endif
+}
+
+/**
+ * @brief Set MAC and IP addresses of the interface
+ *
+ * With USE_SERIAL_ADDR, addresses are derived from the serial number of the
+ * chip so each key has its own addresses and can be used with others on the
+ * same host : MAC is locally administered (02:xx:xx:xx:xx:xx) and the network
+ * part of the IP addresses is replaced (ex: 10.x.y.254 for a /24 mask).
+ *
+ * @param mod Pointer to the network interface structure
+ */
+static void net_addr_init(network *mod)
+{
+#ifdef USE_SERIAL_ADDR
+	u32 sn[4];
+	u8 *p = (u8 *)sn;
+	u32 h1, h2;
+	u32 subnet;
+	int i;
+
+	hw_serial(sn);
+	/* FNV-1a hash of the serial number, a second pass for more bits */
+	h1 = 0x811C9DC5;
+	for (i = 0; i < 16; i++)
+		h1 = (h1 ^ p[i]) * 0x01000193;
+	h2 = h1;
+	for (i = 0; i < 16; i++)
+		h2 = (h2 ^ p[i]) * 0x01000193;
+
+	mod->mac[0] = 0x02;
+	mod->mac[1] = (h1 >> 24) & 0xFF;
+	mod->mac[2] = (h1 >> 16) & 0xFF;
+	mod->mac[3] = (h1 >>  8) & 0xFF;
+	mod->mac[4] = (h1 >>  0) & 0xFF;
+	mod->mac[5] = (h2 & 0xFE) | 0x01;
+	/* Keep the first byte of the network (ex: 10/8), replace the others */
+	subnet = (CFG_IP_LOCAL & 0xFF000000) | ((h2 >> 8) & 0x00FFFFFF);
+	subnet &= CFG_IP_MASK;
+	mod->ip_local  = subnet | (CFG_IP_LOCAL  & ~CFG_IP_MASK);
+	mod->ip_remote = subnet | (CFG_IP_REMOTE & ~CFG_IP_MASK);
+#else
+	memcpy(mod->mac, cfg_mac, 6);
+	mod->ip_local  = CFG_IP_LOCAL;
+	mod->ip_remote = CFG_IP_REMOTE;
+#endif
 }
 
 /**
@@ -75,6 +155,14 @@ void net_periodic(network *mod)
 {
 	eth_frame *frame;
 
+	/* If the RX buffer is sent back, wait end of transfer */
+	if (mod->rx_state == NET_RX_TX)
+		return;
+
+	/* Send the frame waiting for address resolution (if any) */
+	if (arp_periodic(mod))
+		return;
+
 	/* If a module wait to send more datas */
 	if (mod->tx_more)
 	{
@@ -90,28 +178,180 @@ void net_periodic(network *mod)
 	/* If the network RX buffer is empty ... nothing to do */
 	if (mod->rx_length == 0)
 		return;
+	/* If the TX buffer is still used by a previous frame (sent by another */
+	/* module) process the received frame later, responses would overwrite */
+	frame = (eth_frame *)mod->tx_buffer;
+	if (frame->proto != 0x0000)
+		return;
 
-	frame = (eth_frame *)mod->rx_buffer;
-	
-	switch( htons(frame->proto) )
+	PROF_START(PROF_NET_PERIODIC);
+	/* Frame has already been classified by net_rx_classify() */
+	switch(mod->rx_flow)
 	{
-		case 0x0800:
+		case NET_FLOW_IPV4_UDP:
+		case NET_FLOW_IPV4_TCP:
+		case NET_FLOW_IPV4_ICMP:
+			mod->stats.ip_rx++;
+			/* Save MAC address of the sender into ARP cache */
+			arp_learn(mod, htonl(((ip_dgram *)(mod->rx_buffer+14))->src),
+			          mod->rx_buffer + 6);
 			ipv4_receive(mod, mod->rx_buffer+14, mod->rx_length-14);
 			break;
-		case 0x0806:
+		case NET_FLOW_ARP:
+			mod->stats.arp_rx++;
 			arp_receive(mod, mod->rx_buffer+14, mod->rx_length-14);
 			break;
-		case 0x86DD:
-#ifdef NET_DBG_IPV6
-			uart_puts("NET: received an IPv6 datagram\r\n");
-#endif
+#ifdef USE_IPV6
+		case NET_FLOW_IPV6:
+			mod->stats.ip6_rx++;
+			ipv6_receive(mod, mod->rx_buffer+14, mod->rx_length-14);
 			break;
+#endif
 #ifdef NET_DBG
 		default:
-			uart_puts("NET: data received (unknown protocol)\r\n");
+			uart_puts("NET: data received (unknown flow)\r\n");
 #endif
 	}
-	ecm_rx_prepare(mod->driver);
+	/* When the frame is sent back in place, driver re-arm reception */
+	/* at the end of the transfer                                    */
+	if (mod->rx_state != NET_RX_TX)
+		ecm_rx_prepare(mod->driver);
+	PROF_END(PROF_NET_PERIODIC);
+}
+
+/**
+ * @brief Classify a received frame (called from USB interrupt)
+ *
+ * This function is called by the low-level driver as soon as a frame is
+ * received. Frames that can not be processed by the stack (not for us,
+ * unknown protocols, broadcast noise from the host) are rejected here, so
+ * the driver can re-arm reception without waking the main loop.
+ *
+ * @param mod  Pointer to the network interface structure
+ * @param plen Pointer to the frame length, updated if padding is removed
+ * @return integer Flow of the frame (NET_FLOW_x) or drop reason (NET_DROP_x)
+ */
+int net_rx_classify(network *mod, int *plen)
+{
+	int flow;
+
+	flow = net_rx_filter(mod, plen);
+	/* Update counters */
+	mod->stats.rx_frames++;
+	mod->stats.rx_bytes += *plen;
+	if (flow < 0)
+		mod->stats.rx_drop[-flow - 1]++;
+#ifdef USE_PCAP
+	net_cap_record(mod->rx_buffer, *plen, NET_CAP_RX, flow);
+#endif
+	return(flow);
+}
+
+/**
+ * @brief Test if a received frame can be processed by the stack
+ *
+ * @param mod  Pointer to the network interface structure
+ * @param plen Pointer to the frame length, updated if padding is removed
+ * @return integer Flow of the frame (NET_FLOW_x) or drop reason (NET_DROP_x)
+ */
+static int net_rx_filter(network *mod, int *plen)
+{
+	eth_frame *frame = (eth_frame *)mod->rx_buffer;
+	u8 *data = mod->rx_buffer + 14;
+	int len = *plen;
+	int i;
+
+	if (len < (14 + 28))
+		return(NET_DROP_RUNT);
+
+	/* Unicast frames must be for our MAC, multicast is only supported */
+	/* for IPv6 (filtered by address, see ipv6_rx_filter)               */
+	if (frame->dst[0] & 0x01)
+	{
+		for (i = 0; i < 6; i++)
+			if (frame->dst[i] != 0xFF)
+				break;
+#ifdef USE_IPV6
+		if ((frame->dst[0] == 0x33) && (frame->dst[1] == 0x33))
+			i = 6;
+#endif
+#ifdef USE_MDNS
+		/* IPv4 mDNS group (224.0.0.251) */
+		if ((frame->dst[0] == 0x01) && (frame->dst[1] == 0x00) &&
+		    (frame->dst[2] == 0x5E) && (frame->dst[3] == 0x00) &&
+		    (frame->dst[4] == 0x00) && (frame->dst[5] == 0xFB))
+			i = 6;
+#endif
+		if (i != 6)
+			return(NET_DROP_MAC);
+	}
+	else
+	{
+		for (i = 0; i < 6; i++)
+			if (frame->dst[i] != mod->mac[i])
+				return(NET_DROP_MAC);
+	}
+
+	/* ARP : only requests for our address are processed */
+	if (frame->proto == htons(0x0806))
+	{
+		arp_packet *arp = (arp_packet *)data;
+		if (arp->dst_ip != htonl(mod->ip_local))
+			return(NET_DROP_ADDR);
+		return(NET_FLOW_ARP);
+	}
+#ifdef USE_IPV6
+	if (frame->proto == htons(0x86DD))
+		return(ipv6_rx_filter(mod, data, plen));
+#endif
+	/* Only IPv4 is supported */
+	if (frame->proto != htons(0x0800))
+		return(NET_DROP_TYPE);
+
+	ip_dgram *ip = (ip_dgram *)data;
+	/* IPv4 without options only */
+	if ((ip->vihl != 0x45) || (len < (14 + 20 + 8)))
+		return(NET_DROP_PROTO);
+	/* Verify header checksum (sum of a valid header is 0xFFFF) */
+	if (ip_cksum(0, data, 20) != 0xFFFF)
+		return(NET_DROP_CKSUM);
+	/* Datagram length must cover the header and be into the frame */
+	if ((htons(ip->length) > (len - 14)) ||
+	    (htons(ip->length) < ((ip->vihl & 0x0F) * 4)))
+		return(NET_DROP_RUNT);
+	/* Remove ethernet padding (if any) */
+	if ((14 + htons(ip->length)) < len)
+		*plen = 14 + htons(ip->length);
+
+	if (ip->dst == htonl(mod->ip_local))
+	{
+		if (ip->proto == IP_PROTO_TCP)
+			return(NET_FLOW_IPV4_TCP);
+		if (ip->proto == IP_PROTO_UDP)
+			return(NET_FLOW_IPV4_UDP);
+		if (ip->proto == IP_PROTO_ICMP)
+			return(NET_FLOW_IPV4_ICMP);
+		return(NET_DROP_PROTO);
+	}
+	/* Broadcast datagrams are only accepted for DHCP server */
+	if (ip->dst == 0xFFFFFFFF)
+	{
+		udp_packet *udp = (udp_packet *)(data + 20);
+		if ((ip->proto == IP_PROTO_UDP) && (udp->dst_port == htons(0x43)))
+			return(NET_FLOW_IPV4_UDP);
+		return(NET_DROP_PROTO);
+	}
+#ifdef USE_MDNS
+	/* Multicast datagrams are only accepted for mDNS responder */
+	if (ip->dst == htonl(MDNS_IP4))
+	{
+		udp_packet *udp = (udp_packet *)(data + 20);
+		if ((ip->proto == IP_PROTO_UDP) && (udp->dst_port == htons(MDNS_PORT)))
+			return(NET_FLOW_IPV4_UDP);
+		return(NET_DROP_PROTO);
+	}
+#endif
+	return(NET_DROP_ADDR);
 }
 
 /**
@@ -122,13 +362,82 @@ void net_periodic(network *mod)
  */
 void net_send(network *mod, u32 size)
 {
+#ifdef USE_PCAP
+	net_cap_record(mod->tx_buffer, size + 14, NET_CAP_TX, 0);
+#endif
 	/* Call USB ECM layer to process */
-	ecm_tx(mod->driver, mod->tx_buffer, size + 14);
+	if (ecm_tx(mod->driver, mod->tx_buffer, size + 14) != 0)
+	{
+		/* Frame refused (not sent) : TX buffer can be used again */
+		((eth_frame *)mod->tx_buffer)->proto = 0x0000;
+		return;
+	}
+	mod->stats.tx_frames++;
+	mod->stats.tx_bytes += (size + 14);
+}
+
+/**
+ * @brief Send back the received frame, in place (without copy)
+ *
+ * The frame into RX buffer is sent to its source. The buffer is not re-armed
+ * for reception until the transfer is complete (see NET_RX_TX).
+ *
+ * @param mod  Pointer to the network interface structure
+ * @param size Number of bytes to send (after ethernet header)
+ */
+void net_send_rx(network *mod, u32 size)
+{
+	eth_frame *frame = (eth_frame *)mod->rx_buffer;
+	int i;
+
+	/* Swap MAC addresses */
+	for (i = 0; i < 6; i++)
+	{
+		frame->dst[i] = frame->src[i];
+		frame->src[i] = mod->mac[i];
+	}
+#ifdef USE_PCAP
+	net_cap_record(mod->rx_buffer, size + 14, NET_CAP_TX, 0);
+#endif
+	mod->stats.tx_frames++;
+	mod->stats.tx_bytes += (size + 14);
+
+	mod->rx_state = NET_RX_TX;
+	if (ecm_tx(mod->driver, mod->rx_buffer, size + 14) != 0)
+		mod->rx_state = NET_RX_READY;
+}
+
+/**
+ * @brief Test if a frame is currently sent by the driver
+ *
+ * Frames sent in place (see net_send_rx) must only be prepared when the
+ * driver is idle, else the received frame is modified for nothing.
+ *
+ * @param mod Pointer to the network interface structure
+ * @return integer Non-zero if the driver is busy
+ */
+int net_tx_busy(network *mod)
+{
+	return(ecm_tx_busy(mod->driver));
+}
+
+/**
+ * @brief Get a pointer to the counters of a network interface
+ *
+ * @param mod Pointer to the network interface structure
+ * @return Pointer to the statistics block
+ */
+net_stats *net_get_stats(network *mod)
+{
+	return(&mod->stats);
 }
 
 /**
  * @brief Get a pointer on a buffer that can be used for TX
  *
+ * The destination MAC address is not set here, it must be filled by the
+ * sender (see ipv4_send and the ARP module).
+ *
  * @param mod   Pointer to the network interface structure
  * @param proto ID of the ethernet protocol to use into the frame
  */
@@ -143,10 +452,6 @@ u8* net_tx_buffer(network *mod, u16 proto)
 		const u8 *s;
 		int i;
 
-		/* Set MAC dest (copy from received frame) */
-		s = (mod->rx_buffer + 6);
-		for (i = 0; i < 6; i++)
-			frame->dst[i] = *s++;
 		/* Set MAC source (from network interface) */
 		s = mod->mac;
 		for (i = 0; i < 6; i++)
@@ -157,4 +462,89 @@ u8* net_tx_buffer(network *mod, u16 proto)
 
 	return (mod->tx_buffer + 14);
 }
+
+#ifdef USE_PCAP
+/**
+ * @brief Get the oldest frame of the capture ring
+ *
+ * @param rec  Pointer to a structure where the frame is copied
+ * @param lost Pointer to a counter of frames lost since the previous read
+ * @return integer True if a frame has been copied, false if ring is empty
+ */
+int net_cap_read(net_cap *rec, u32 *lost)
+{
+	u32 irq;
+
+	irq = irq_save();
+	if (cap_tail == cap_head)
+	{
+		irq_restore(irq);
+		return(0);
+	}
+	memcpy(rec, &cap_ring[cap_tail], sizeof(net_cap));
+	cap_tail = (cap_tail + 1) & (NET_CAP_SLOTS - 1);
+	*lost = cap_lost;
+	cap_lost = 0;
+	irq_restore(irq);
+	return(1);
+}
+
+/**
+ * @brief Save the headers of a frame into the capture ring
+ *
+ * This function can be called from interrupt (RX classifier). When the ring
+ * is full, the oldest frame is overwritten. Frames of the capture stream
+ * itself (TCP port CFG_PCAP_PORT) are ignored.
+ *
+ * @param frame Pointer to the ethernet frame
+ * @param len   Length of the frame (in bytes)
+ * @param dir   Direction of the frame (NET_CAP_RX or NET_CAP_TX)
+ * @param flow  Flow of the frame (NET_FLOW_x) or drop reason (NET_DROP_x)
+ */
+static void net_cap_record(u8 *frame, int len, int dir, int flow)
+{
+	net_cap *rec;
+	u32 irq;
+	u16 next;
+
+	/* IPv4 (without options) and TCP : test ports */
+	if ((len >= (14 + 20 + 4)) && (frame[12] == 0x08) &&
+	    (frame[13] == 0x00) && (frame[23] == IP_PROTO_TCP))
+	{
+		u16 src_port = (frame[34] << 8) | frame[35];
+		u16 dst_port = (frame[36] << 8) | frame[37];
+		if ((src_port == CFG_PCAP_PORT) || (dst_port == CFG_PCAP_PORT))
+			return;
+	}
+	/* IPv6 (without extension header) and TCP : test ports */
+	if ((len >= (14 + 40 + 4)) && (frame[12] == 0x86) &&
+	    (frame[13] == 0xDD) && (frame[20] == IP_PROTO_TCP))
+	{
+		u16 src_port = (frame[54] << 8) | frame[55];
+		u16 dst_port = (frame[56] << 8) | frame[57];
+		if ((src_port == CFG_PCAP_PORT) || (dst_port == CFG_PCAP_PORT))
+			return;
+	}
+
+	irq = irq_save();
+	rec  = &cap_ring[cap_head];
+	next = (cap_head + 1) & (NET_CAP_SLOTS - 1);
+	/* If the ring is full, drop the oldest frame */
+	if (next == cap_tail)
+	{
+		cap_tail = (cap_tail + 1) & (NET_CAP_SLOTS - 1);
+		cap_lost++;
+	}
+	cap_head = next;
+
+	rec->time   = timer_now();
+	rec->length = len;
+	rec->dir    = dir;
+	rec->flow   = flow;
+	if (len > NET_CAP_SNAPLEN)
+		len = NET_CAP_SNAPLEN;
+	memcpy(rec->data, frame, len);
+	irq_restore(irq);
+}
+#endif
 /* EOF */
@@ -17,6 +17,9 @@
 #define NET_H
 #include "types.h"
 
+/* Default addresses. With USE_SERIAL_ADDR, the network part is replaced by */
+/* a value derived from the chip serial number (see net_init)               */
+
 /* Set the local IP address (if not already defined) */
 #ifndef CFG_IP_LOCAL
 #define CFG_IP_LOCAL 0x0A0A0AFE
@@ -26,17 +29,122 @@
 #define CFG_IP_REMOTE 0x0A0A0A03
 #endif
 
+/* Set the netmask of the local network (if not already defined) */
+#ifndef CFG_IP_MASK
+#define CFG_IP_MASK 0xFFFFFF00
+#endif
+
+/* Flow of a received frame, set by net_rx_classify() */
+#define NET_FLOW_ARP       1
+#define NET_FLOW_IPV4_UDP  2
+#define NET_FLOW_IPV4_TCP  3
+#define NET_FLOW_IPV4_ICMP 4
+#define NET_FLOW_IPV6      5
+/* Reasons to drop a received frame (negative values) */
+#define NET_DROP_RUNT     -1
+#define NET_DROP_MAC      -2
+#define NET_DROP_TYPE     -3
+#define NET_DROP_ADDR     -4
+#define NET_DROP_PROTO    -5
+#define NET_DROP_CKSUM    -6
+/* Number of drop reasons */
+#define NET_DROP_COUNT     6
+
+/* Number of frames into the capture ring (must be a power of two) */
+#ifndef NET_CAP_SLOTS
+#define NET_CAP_SLOTS   16
+#endif
+/* Number of bytes saved for each captured frame (headers only) */
+#ifndef NET_CAP_SNAPLEN
+#define NET_CAP_SNAPLEN 64
+#endif
+/* TCP port used to stream the capture (not captured itself) */
+#ifndef CFG_PCAP_PORT
+#define CFG_PCAP_PORT   2002
+#endif
+
+#define NET_CAP_RX 1
+#define NET_CAP_TX 2
+
+/* Max number of bound UDP sockets (see udp4_bind) */
+#ifndef NET_UDP_SOCKETS
+#define NET_UDP_SOCKETS 6
+#endif
+
+/* Address family of a connection */
+#define NET_AF_INET  4
+#define NET_AF_INET6 6
+
+/* State of the RX buffer (rx_state) */
+#define NET_RX_READY 0 /* Owned by the stack, re-armed after processing */
+#define NET_RX_TX    1 /* Sent back in place, re-armed when TX complete  */
+
+/* Counters of the network stack (see net_stats.c for query service) */
+typedef struct
+{
+	/* Interface */
+	u32 rx_frames;   /* Frames received (including dropped ones)    */
+	u32 rx_bytes;
+	u32 rx_drop[NET_DROP_COUNT]; /* Dropped by classifier, per reason */
+	u32 tx_frames;   /* Frames sent                                 */
+	u32 tx_bytes;
+	u32 tx_err;      /* Frames refused by driver (previous not sent) */
+	/* ARP */
+	u32 arp_rx;      /* Requests received                           */
+	u32 arp_tx;      /* Replies sent                                */
+	/* IPv4 */
+	u32 ip_rx;       /* Datagrams received                          */
+	u32 ip_tx;       /* Datagrams sent                              */
+	u32 ip_noproto;  /* Datagrams with unsupported protocol         */
+	/* UDP */
+	u32 udp_rx;      /* Datagrams received                          */
+	u32 udp_tx;      /* Datagrams sent                              */
+	u32 udp_noport;  /* Datagrams for a closed port                 */
+	/* TCP */
+	u32 tcp_rx;      /* Segments received                           */
+	u32 tcp_tx;      /* Segments sent                               */
+	u32 tcp_dupack;  /* Duplicate ACKs received                     */
+	u32 tcp_rst_rx;  /* Resets received                             */
+	u32 tcp_rst_tx;  /* Resets sent (connection refused)            */
+	u32 tcp_noconn;  /* Segments for an unknown connection          */
+	/* ICMP */
+	u32 icmp_rx;     /* Echo requests received                      */
+	u32 icmp_tx;     /* Echo replies sent                           */
+	u32 icmp_limit;  /* Echo requests dropped by rate limiter       */
+	/* ARP (continued) */
+	u32 arp_req;     /* Requests sent to resolve a next hop         */
+	u32 arp_drop;    /* Frames dropped while waiting for resolution */
+	/* IPv6 */
+	u32 ip6_rx;      /* Datagrams received                          */
+	u32 ip6_tx;      /* Datagrams sent                              */
+	u32 ip6_drop;    /* Datagrams dropped (protocol, neighbor, ...) */
+	/* TCP (continued) */
+	u32 tcp_rto;     /* Segments retransmitted after a timeout      */
+	u32 tcp_fastrtx; /* Segments retransmitted after 3 dup ACKs     */
+	u32 tcp_nortx;   /* Data segments sent without copy (no room)   */
+	/* UDP (continued) */
+	u32 udp_err;     /* Datagrams with a bad length                 */
+} net_stats;
+
 typedef struct _network
 {
 	u8  *rx_buffer;
 	int  rx_length;
 	int  rx_state;
+	int  rx_flow;
 	u8  *tx_buffer;
 	void (*tx_more)(struct _network *mod);
 	/* Pointer to low-level driver */
 	void *driver;
-	/* MAC address of the interface */
+	/* MAC address of the interface (host side has bit 0 of mac[5] cleared) */
 	u8    mac[6];
+	/* IPv4 addresses of the interface and of the host (host byte order) */
+	u32   ip_local;
+	u32   ip_remote;
+	/* IPv6 link-local address (see USE_IPV6) */
+	u8    ip6_local[16];
+	/* Counters */
+	net_stats stats;
 	/* Extension for TCP */
 	struct
 	{
@@ -44,7 +152,14 @@ typedef struct _network
 		int    conn_count;
 		struct _tcp_service *services;
 		int    service_count;
+		u16    port_next; /* Next ephemeral port, 0 until first tcp4_connect */
 	} tcp;
+	/* Extension for UDP : dispatch table of bound sockets */
+	struct
+	{
+		u16    ports[NET_UDP_SOCKETS]; /* Local port, 0 if slot is free */
+		struct _udp_socket *socks[NET_UDP_SOCKETS];
+	} udp;
 } network;
 
 typedef struct __attribute__((packed))
@@ -54,11 +169,25 @@ typedef struct __attribute__((packed))
 	u16 proto;
 } eth_frame;
 
+typedef struct
+{
+	u32  time;   /* Timestamp (ms) */
+	u16  length; /* Original length of the frame */
+	u8   dir;    /* Direction : NET_CAP_RX or NET_CAP_TX */
+	signed char flow; /* Flow (NET_FLOW_x) or drop reason (NET_DROP_x) */
+	u8   data[NET_CAP_SNAPLEN];
+} net_cap;
+
 u32  htonl(u32 v);
 u16  htons(u16 v);
+int  net_cap_read(net_cap *rec, u32 *lost);
+net_stats *net_get_stats(network *mod);
 void net_init    (network *mod);
 void net_periodic(network *mod);
+int  net_rx_classify(network *mod, int *len);
 void net_send(network *mod, u32 size);
+void net_send_rx(network *mod, u32 size);
+int  net_tx_busy (network *mod);
 u8*  net_tx_buffer(network *mod, u16 proto);
 
 #endif
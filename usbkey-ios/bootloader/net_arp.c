@@ -17,6 +17,31 @@
 #include "net.h"
 #include "net_arp.h"
 #include "libc.h"
+#include "timer.h"
+
+static arp_entry *arp_find(u32 ip);
+static void arp_request(network *mod, u32 ip);
+
+static arp_entry arp_cache[ARP_CACHE_SIZE];
+/* Frame waiting for address resolution */
+static u8  arp_pending[ARP_HOLD_SIZE];
+static int arp_pending_len;  /* Size after ethernet header, 0 if empty */
+static u32 arp_pending_ip;
+static u32 arp_pending_time; /* Time of the last request (ms)       */
+static int arp_pending_tries;
+
+/**
+ * @brief Initialize the ARP module (clear cache)
+ *
+ * @param mod Pointer to the network interface structure
+ */
+void arp_init(network *mod)
+{
+	(void)mod;
+
+	memset(arp_cache, 0, sizeof(arp_cache));
+	arp_pending_len = 0;
+}
 
 /**
  * @brief Called when an ARP packet is received
@@ -46,21 +71,27 @@ void arp_receive(network *mod, u8 *buffer, int length)
 		return;
 	}
 
+	/* Requests and replies for us : save address of the sender */
+	if (htonl(req->dst_ip) == mod->ip_local)
+		arp_learn(mod, htonl(req->src_ip), req->src_phy);
+
 	if (htons(req->op) == 0x0001)
 	{
 		/* Is the requested IP is me ? */
-		if (htonl(req->dst_ip) == CFG_IP_LOCAL)
+		if (htonl(req->dst_ip) == mod->ip_local)
 		{
+			eth_frame  *frame = (eth_frame *)mod->tx_buffer;
 			arp_packet *rsp;
 			
 			rsp = (arp_packet *)net_tx_buffer(mod, 0x806);
+			memcpy(frame->dst, req->src_phy, 6);
 			rsp->type  = 0x0100; /* equal to htons(0x0001) */
 			rsp->proto = req->proto;
 			rsp->hlen  = 0x06;
 			rsp->llen  = 0x04;
 			rsp->op    = 0x0200; /* equal to htons(0x0002) */
 			memcpy(rsp->src_phy, mod->mac, 6);
-			rsp->src_ip= htonl(CFG_IP_LOCAL);
+			rsp->src_ip= htonl(mod->ip_local);
 			memcpy(rsp->dst_phy, req->src_phy, 6);
 			rsp->dst_ip= req->src_ip;
 			
@@ -77,11 +108,219 @@ void arp_receive(network *mod, u8 *buffer, int length)
 
 			/* Send response */
 			net_send(mod, sizeof(arp_packet));
+			mod->stats.arp_tx++;
 		}
 	}
 	else
 	{
-		/* Packet is not a request */
+		/* Replies are only used to update the cache (see above) */
+	}
+}
+
+/**
+ * @brief Get the MAC address associated with an IP address
+ *
+ * @param mod Pointer to the network interface structure
+ * @param ip  IP address to resolve (host byte order)
+ * @param mac Pointer to a buffer where the MAC address is copied (6 bytes)
+ * @return integer Zero if the address is known, -1 if not (or expired)
+ */
+int arp_resolve(network *mod, u32 ip, u8 *mac)
+{
+	arp_entry *entry;
+
+	(void)mod;
+
+	if (ip == 0xFFFFFFFF)
+	{
+		memset(mac, 0xFF, 6);
+		return(0);
+	}
+	/* Multicast : 01:00:5E and 23 low bits of the group address */
+	if ((ip & 0xF0000000) == 0xE0000000)
+	{
+		mac[0] = 0x01;
+		mac[1] = 0x00;
+		mac[2] = 0x5E;
+		mac[3] = (ip >> 16) & 0x7F;
+		mac[4] = (ip >>  8) & 0xFF;
+		mac[5] = (ip >>  0) & 0xFF;
+		return(0);
+	}
+	entry = arp_find(ip);
+	if (entry == 0)
+		return(-1);
+	if ((timer_now() - entry->time) >= ARP_TIMEOUT)
+	{
+		entry->ip = 0;
+		return(-1);
 	}
+	memcpy(mac, entry->mac, 6);
+	return(0);
+}
+
+/**
+ * @brief Add or refresh an entry into the ARP cache
+ *
+ * When the cache is full, the oldest entry is replaced.
+ *
+ * @param mod Pointer to the network interface structure
+ * @param ip  IP address of the peer (host byte order)
+ * @param mac Pointer to the MAC address of the peer
+ */
+void arp_learn(network *mod, u32 ip, const u8 *mac)
+{
+	arp_entry *entry;
+	u32 now = timer_now();
+	int i;
+
+	(void)mod;
+
+	/* Unspecified and broadcast addresses are not saved */
+	if ((ip == 0) || (ip == 0xFFFFFFFF))
+		return;
+
+	entry = arp_find(ip);
+	if (entry == 0)
+	{
+		/* Use a free entry or the oldest one */
+		entry = &arp_cache[0];
+		for (i = 0; i < ARP_CACHE_SIZE; i++)
+		{
+			if (arp_cache[i].ip == 0)
+			{
+				entry = &arp_cache[i];
+				break;
+			}
+			if ((now - arp_cache[i].time) > (now - entry->time))
+				entry = &arp_cache[i];
+		}
+		entry->ip = ip;
+	}
+	memcpy(entry->mac, mac, 6);
+	entry->time = now;
+}
+
+/**
+ * @brief Hold the frame of the TX buffer until its destination is resolved
+ *
+ * The frame is copied into the pending buffer (replacing a previous one, if
+ * any) and an ARP request is sent using the TX buffer.
+ *
+ * @param mod Pointer to the network interface structure
+ * @param ip  IP address of the next hop (host byte order)
+ * @param len Size of the frame (after ethernet header)
+ */
+void arp_hold(network *mod, u32 ip, int len)
+{
+	eth_frame *frame = (eth_frame *)mod->tx_buffer;
+
+	if (arp_pending_len)
+		mod->stats.arp_drop++;
+	arp_pending_len = 0;
+
+	if ((len + 14) <= ARP_HOLD_SIZE)
+	{
+		memcpy(arp_pending, mod->tx_buffer, len + 14);
+		arp_pending_len   = len;
+		arp_pending_ip    = ip;
+		arp_pending_tries = 0;
+	}
+	else
+		mod->stats.arp_drop++;
+	/* Release TX buffer */
+	frame->proto = 0x0000;
+
+	if (arp_pending_len)
+	{
+		arp_request(mod, ip);
+		arp_pending_tries = 1;
+		arp_pending_time  = timer_now();
+	}
+}
+
+/**
+ * @brief Process pending frame (send it if resolved, retry request if not)
+ *
+ * This function must be called periodically, when the TX buffer is free.
+ *
+ * @param mod Pointer to the network interface structure
+ * @return integer True if a frame has been sent
+ */
+int arp_periodic(network *mod)
+{
+	eth_frame *frame = (eth_frame *)mod->tx_buffer;
+
+	/* Nothing to do, or TX buffer not free (proto cleared when sent) */
+	if ((arp_pending_len == 0) || (frame->proto != 0x0000))
+		return(0);
+
+	/* Destination resolved, send the frame */
+	if (arp_resolve(mod, arp_pending_ip, arp_pending) == 0)
+	{
+		memcpy(mod->tx_buffer, arp_pending, arp_pending_len + 14);
+		net_send(mod, arp_pending_len);
+		arp_pending_len = 0;
+		return(1);
+	}
+
+	if ((timer_now() - arp_pending_time) < ARP_RETRY)
+		return(0);
+	/* No response, drop the frame */
+	if (arp_pending_tries >= ARP_TRIES)
+	{
+		ARP_PUTS("NET_ARP: no response, frame dropped\r\n");
+		mod->stats.arp_drop++;
+		arp_pending_len = 0;
+		return(0);
+	}
+	/* Send the request again */
+	arp_request(mod, arp_pending_ip);
+	arp_pending_tries++;
+	arp_pending_time = timer_now();
+	return(1);
+}
+
+/**
+ * @brief Search an IP address into the cache
+ *
+ * @param ip IP address (host byte order)
+ * @return Pointer to the cache entry, or 0 if not found
+ */
+static arp_entry *arp_find(u32 ip)
+{
+	int i;
+
+	for (i = 0; i < ARP_CACHE_SIZE; i++)
+		if (arp_cache[i].ip == ip)
+			return(&arp_cache[i]);
+	return(0);
+}
+
+/**
+ * @brief Broadcast an ARP request
+ *
+ * @param mod Pointer to the network interface structure
+ * @param ip  IP address to resolve (host byte order)
+ */
+static void arp_request(network *mod, u32 ip)
+{
+	eth_frame  *frame = (eth_frame *)mod->tx_buffer;
+	arp_packet *req;
+
+	req = (arp_packet *)net_tx_buffer(mod, 0x806);
+	memset(frame->dst, 0xFF, 6);
+	req->type  = 0x0100; /* equal to htons(0x0001) */
+	req->proto = 0x0008; /* equal to htons(0x0800) */
+	req->hlen  = 0x06;
+	req->llen  = 0x04;
+	req->op    = 0x0100; /* equal to htons(0x0001) */
+	memcpy(req->src_phy, mod->mac, 6);
+	req->src_ip = htonl(mod->ip_local);
+	memset(req->dst_phy, 0, 6);
+	req->dst_ip = htonl(ip);
+
+	net_send(mod, sizeof(arp_packet));
+	mod->stats.arp_req++;
 }
 /* EOF */
@@ -24,6 +24,33 @@
 #define ARP_PUTS(x) {}
 #endif
 
+/* Number of entries into the ARP cache */
+#ifndef ARP_CACHE_SIZE
+#define ARP_CACHE_SIZE 4
+#endif
+/* Lifetime of a cache entry (ms) */
+#ifndef ARP_TIMEOUT
+#define ARP_TIMEOUT  60000
+#endif
+/* Delay between two requests (ms) and max number of requests */
+#ifndef ARP_RETRY
+#define ARP_RETRY      500
+#endif
+#ifndef ARP_TRIES
+#define ARP_TRIES        3
+#endif
+/* Max size of the frame held while waiting for resolution */
+#ifndef ARP_HOLD_SIZE
+#define ARP_HOLD_SIZE  512
+#endif
+
+typedef struct
+{
+	u32 ip;     /* IP address (host order), 0 if the entry is free */
+	u32 time;   /* Time of the last update (ms)                    */
+	u8  mac[6];
+} arp_entry;
+
 typedef struct __attribute__((packed))
 {
 	u16 type;
@@ -37,6 +64,11 @@ typedef struct __attribute__((packed))
 	u32 dst_ip;
 } arp_packet;
 
+void arp_hold   (network *mod, u32 ip, int len);
+void arp_init   (network *mod);
+void arp_learn  (network *mod, u32 ip, const u8 *mac);
+int  arp_periodic(network *mod);
 void arp_receive(network *mod, u8 *data, int length);
+int  arp_resolve(network *mod, u32 ip, u8 *mac);
 
 #endif
@@ -17,97 +17,335 @@
 #include "net.h"
 #include "net_dhcp.h"
 #include "net_ipv4.h"
+#include "timer.h"
 #include "uart.h"
 
-static void dhcpd_discover(network *netif, udp_packet *udp, int is_dhcp);
-static void dhcpd_request (network *netif, udp_packet *udp);
-static u8*  find_option(dhcp_packet *pkt, u8 id);
+static void dhcpd_decline (dhcp_packet *pkt);
+static void dhcpd_discover(network *netif, udp_packet *udp, int optlen);
+static void dhcpd_receive (network *netif, udp_packet *udp, int len);
+static void dhcpd_release (dhcp_packet *pkt);
+static void dhcpd_reply   (network *netif, udp_packet *udp,
+                           dhcp_lease *lease, u8 type);
+static void dhcpd_request (network *netif, udp_packet *udp, int optlen);
+static u8*  find_option(dhcp_packet *pkt, int len, u8 id);
+static u32  get32(const u8 *p);
+static dhcp_lease *lease_alloc(const u8 *mac, u32 hint, int exact);
+static void lease_expire(timer *tmr);
+static dhcp_lease *lease_find(const u8 *mac);
+static void lease_free(dhcp_lease *lease);
+static u32  lease_ip(dhcp_lease *lease);
+static void dhcp_sock_recv(udp_socket *sock, udp_packet *udp, ip_dgram *ip,
+                           int len);
+
+static dhcp_lease dhcp_leases[DHCP_POOL_SIZE];
+static u32 dhcp_pool; /* First address of the pool */
+static udp_socket dhcp_sock;
 
 /**
- * @brief Called by UDP layer when a packet is received on DHCP port
+ * @brief Initialize the DHCP server (clear the lease table)
+ *
+ * @param netif Pointer to the network interface structure
+ */
+void dhcp_init(network *netif)
+{
+	int i;
+
+#ifdef DHCP_POOL_START
+	(void)netif;
+	dhcp_pool = DHCP_POOL_START;
+#else
+	dhcp_pool = netif->ip_remote;
+#endif
+	memset(dhcp_leases, 0, sizeof(dhcp_leases));
+	for (i = 0; i < DHCP_POOL_SIZE; i++)
+	{
+		dhcp_leases[i].tmr.handler = lease_expire;
+		dhcp_leases[i].tmr.priv    = &dhcp_leases[i];
+	}
+	/* Bind the server port */
+	dhcp_sock.recv  = dhcp_sock_recv;
+	dhcp_sock.queue = 0;
+	dhcp_sock.netif = 0;
+	udp4_bind(netif, &dhcp_sock, 0x43);
+}
+
+/**
+ * @brief Called by UDP layer when a packet is received on DHCP socket
+ *
+ * @param sock Pointer to the socket of the server
+ * @param udp  Pointer to the UDP packet structure
+ * @param ip   Pointer to the received IPv4 datagram (0 for IPv6)
+ * @param len  Size of the datas (checked by UDP layer)
+ */
+static void dhcp_sock_recv(udp_socket *sock, udp_packet *udp, ip_dgram *ip,
+                           int len)
+{
+	/* DHCP server is only for IPv4 */
+	if (ip == 0)
+		return;
+	dhcpd_receive(sock->netif, udp, len);
+}
+
+/**
+ * @brief Process a packet received on DHCP port (exported by the API)
+ *
+ * The UDP length is checked against the IP datagram, as the UDP layer does
+ * for packets received on the DHCP socket.
  *
  * @param netif Pointer to the network interface structure
  * @param udp   Pointer to the UDP packet structure
  * @param ip    Pointer to the received IP datagram
  */
 void dhcp_recv(network *netif, udp_packet *udp, ip_dgram *ip)
+{
+	int plen = htons(ip->length) - 20;
+
+	if ((htons(udp->length) < 8) || (htons(udp->length) > plen))
+		return;
+	dhcpd_receive(netif, udp, htons(udp->length) - 8);
+}
+
+/**
+ * @brief Process a DHCP (or BOOTP) packet
+ *
+ * @param netif Pointer to the network interface structure
+ * @param udp   Pointer to the UDP packet structure
+ * @param len   Size of the DHCP packet (checked UDP datas)
+ */
+static void dhcpd_receive(network *netif, udp_packet *udp, int len)
 {
 	dhcp_packet *pkt = (dhcp_packet *)( ((u8 *)udp) + 8);
-	
-	(void)ip; /* To avoid compiler warning */
 
-	if (pkt->op == DHCP_DISCOVER)
+	if (pkt->op != DHCP_DISCOVER)
+		return;
+
+	/* Test if packet length can contain BOOTP fields, for Ethernet */
+	if ((len < (int)sizeof(dhcp_packet)) ||
+	    (pkt->htype != 1) || (pkt->hlen != 6))
 	{
-		/* Test if packet length can contain DHCP fields */
-		if (htons(udp->length) > (sizeof(dhcp_packet) + 4))
+		DHCP_PUTS("DHCP: invalid packet\r\n");
+		return;
+	}
+
+	/* Test if packet length can contain DHCP fields */
+	if (len > (int)(sizeof(dhcp_packet) + 4))
+	{
+		u8 *options = (u8 *)pkt + sizeof(dhcp_packet);
+		int optlen  = len - sizeof(dhcp_packet) - 4;
+		/* If the first BOOTP vendor extension is DHCP magic cookie */
+		if (get32(options) == 0x63825363)
 		{
-			u8 *options = (u8 *)pkt + sizeof(dhcp_packet);
-			/* Get the first BOOTP vendor extension */
-			u32 cookie = (options[0] << 24) | (options[1] << 16) |
-			             (options[2] <<  8) | (options[3]);
-			/* If the extension contains DHCP magic cookie */
-			if (cookie == 0x63825363)
+			u8 *ptype = find_option(pkt, optlen, 53);
+			/* If the DHCP message type is not found ... */
+			if ((ptype == 0) || (ptype[1] < 1))
+			{
+				/* revert to BOOTP mode */
+				dhcpd_discover(netif, udp, -1);
+				return;
+			}
+
+			switch (ptype[2])
 			{
-				u8 *ptype = find_option(pkt, 53);
-				u8 type;
-				/* If the DHCP message type is not found ... */
-				if (ptype == 0)
-				{
-					/* revert to BOOTP mode */
-					dhcpd_discover(netif, udp, 0);
-					return;
-				}
-
-				type = ptype[2];
-				/* In case of a DHCP DISCOVER */
-				if (type == 1)
-					dhcpd_discover(netif, udp, 1);
-				/* In case of a DHCP REQUEST */
-				else if (type == 3)
-					dhcpd_request(netif, udp);
+				case DHCP_MSG_DISCOVER:
+					dhcpd_discover(netif, udp, optlen);
+					break;
+				case DHCP_MSG_REQUEST:
+					dhcpd_request(netif, udp, optlen);
+					break;
+				case DHCP_MSG_DECLINE:
+					dhcpd_decline(pkt);
+					break;
+				case DHCP_MSG_RELEASE:
+					dhcpd_release(pkt);
+					break;
 			}
-			/* Failed to find magic cookie, use BOOTP mode */
-			else
-				dhcpd_discover(netif, udp, 0);
+			return;
 		}
-		/* No :( Use the BOOTP mode */
-		else
-			dhcpd_discover(netif, udp, 0);
 	}
+	/* No DHCP extension, use the BOOTP mode */
+	dhcpd_discover(netif, udp, -1);
 }
 
 /**
  * @brief Process a DHCP discover (or a BOOTP request)
  *
- * @param netif   Pointer to the network interface structure
- * @param udp     Pointer to the UDP packet of the request
- * @param is_dhcp Boolean, true if DHCP request, false if BOOTP request
+ * @param netif  Pointer to the network interface structure
+ * @param udp    Pointer to the UDP packet of the request
+ * @param optlen Size of DHCP options, or -1 for a BOOTP request
  */
-static void dhcpd_discover(network *netif, udp_packet *udp, int is_dhcp)
+static void dhcpd_discover(network *netif, udp_packet *udp, int optlen)
 {
-	udp_conn     conn;
-	int size;
-
 	dhcp_packet *pkt = (dhcp_packet *)( ((u8 *)udp) + 8);
+	dhcp_lease *lease;
+	u32 hint = 0;
+	u8 *opt;
 
 	DHCP_PUTS("DHCP DISCOVER\r\n");
 
+	lease = lease_find(pkt->chaddr);
+	if (lease == 0)
+	{
+		/* Use the address requested by the client, if available */
+		if (optlen >= 0)
+		{
+			opt = find_option(pkt, optlen, 50);
+			if (opt && (opt[1] == 4))
+				hint = get32(opt + 2);
+		}
+		lease = lease_alloc(pkt->chaddr, hint, 0);
+		if (lease == 0)
+		{
+			DHCP_PUTS("DHCP: pool is full\r\n");
+			return;
+		}
+	}
+
+	if (optlen < 0)
+	{
+		/* BOOTP has no request, address is immediately allocated */
+		lease->state = DHCP_LEASE_BOUND;
+		timer_arm(&lease->tmr, DHCP_LEASE_TIME * 1000);
+		dhcpd_reply(netif, udp, lease, 0);
+		return;
+	}
+	/* Reserve the address until the client request it */
+	if (lease->state != DHCP_LEASE_BOUND)
+	{
+		lease->state = DHCP_LEASE_OFFERED;
+		timer_arm(&lease->tmr, DHCP_OFFER_TIME);
+	}
+	dhcpd_reply(netif, udp, lease, DHCP_MSG_OFFER);
+}
+
+/**
+ * @brief Process a DHCP request
+ *
+ * @param netif  Pointer to the network interface structure
+ * @param udp    Pointer to the UDP packet of the request
+ * @param optlen Size of DHCP options
+ */
+static void dhcpd_request(network *netif, udp_packet *udp, int optlen)
+{
+	dhcp_packet *pkt = (dhcp_packet *)( ((u8 *)udp) + 8);
+	dhcp_lease *lease;
+	u32 addr;
+	u8 *opt;
+
+	DHCP_PUTS("DHCP REQUEST\r\n");
+
+	lease = lease_find(pkt->chaddr);
+
+	/* If the client has selected another server, release our offer */
+	opt = find_option(pkt, optlen, 54);
+	if (opt && (opt[1] == 4) && (get32(opt + 2) != netif->ip_local))
+	{
+		if (lease && (lease->state == DHCP_LEASE_OFFERED))
+			lease_free(lease);
+		return;
+	}
+
+	/* Requested address : option 50, or ciaddr when renewing */
+	opt = find_option(pkt, optlen, 50);
+	if (opt && (opt[1] == 4))
+		addr = get32(opt + 2);
+	else
+		addr = htonl(pkt->ciaddr);
+
+	/* Client reboots with an address not known (ex: after our reset), */
+	/* it can only get this address, if free                           */
+	if (lease == 0)
+		lease = lease_alloc(pkt->chaddr, addr, 1);
+
+	if ((lease == 0) || (addr != lease_ip(lease)))
+	{
+		DHCP_PUTS("DHCP: address refused\r\n");
+		dhcpd_reply(netif, udp, 0, DHCP_MSG_NAK);
+		return;
+	}
+
+	lease->state = DHCP_LEASE_BOUND;
+	timer_arm(&lease->tmr, DHCP_LEASE_TIME * 1000);
+	dhcpd_reply(netif, udp, lease, DHCP_MSG_ACK);
+}
+
+/**
+ * @brief Process a DHCP decline, the offered address is already used
+ *
+ * The address is not returned to the pool : it is kept out of allocation
+ * for DHCP_DECLINE_TIME, so the next discover of the client gets another
+ * address of the pool.
+ *
+ * @param pkt Pointer to the received DHCP packet
+ */
+static void dhcpd_decline(dhcp_packet *pkt)
+{
+	dhcp_lease *lease;
+
+	DHCP_PUTS("DHCP DECLINE\r\n");
+
+	lease = lease_find(pkt->chaddr);
+	if (lease == 0)
+		return;
+	memset(lease->mac, 0, 6);
+	lease->state = DHCP_LEASE_DECLINED;
+	timer_arm(&lease->tmr, DHCP_DECLINE_TIME);
+}
+
+/**
+ * @brief Process a DHCP release, free the lease of the client
+ *
+ * @param pkt Pointer to the received DHCP packet
+ */
+static void dhcpd_release(dhcp_packet *pkt)
+{
+	dhcp_lease *lease;
+
+	DHCP_PUTS("DHCP RELEASE\r\n");
+
+	lease = lease_find(pkt->chaddr);
+	if (lease)
+		lease_free(lease);
+}
+
+/**
+ * @brief Send a response to the client
+ *
+ * @param netif Pointer to the network interface structure
+ * @param udp   Pointer to the UDP packet of the request
+ * @param lease Pointer to the lease of the client (0 for a NAK)
+ * @param type  DHCP message type (DHCP_MSG_x), or 0 for a BOOTP reply
+ */
+static void dhcpd_reply(network *netif, udp_packet *udp,
+                        dhcp_lease *lease, u8 type)
+{
+	dhcp_packet *pkt = (dhcp_packet *)( ((u8 *)udp) + 8);
+	dhcp_packet *dhcp;
+	udp_conn     conn;
+	u8 *options;
+	int size;
+
 	/* Initialize a temporary UDP connection */
-	conn.ip_remote   = 0xFFFFFFFF;
+	/* Renewing clients have an address, others use broadcast */
+	if (pkt->ciaddr && (type != DHCP_MSG_NAK))
+		conn.ip_remote = htonl(pkt->ciaddr);
+	else
+		conn.ip_remote = 0xFFFFFFFF;
+	conn.family      = NET_AF_INET;
 	conn.port_remote = udp->src_port;
 	conn.port_local  = htons(0x43);
 	conn.rsp = 0;
 	/* Make DHCP response */
-	dhcp_packet *dhcp = (dhcp_packet *)udp4_tx_buffer(netif, &conn);
+	dhcp = (dhcp_packet *)udp4_tx_buffer(netif, &conn);
 	dhcp->op     = DHCP_OFFER;
 	dhcp->htype  = 1;
 	dhcp->hlen   = 6;
+	dhcp->hops   = 0;
 	dhcp->xid    = pkt->xid;
 	dhcp->secs   = 0;
-	dhcp->flags  = 0;
+	dhcp->flags  = pkt->flags;
 	dhcp->ciaddr = 0x00000000;
-	dhcp->yiaddr = htonl(CFG_IP_REMOTE);
-	dhcp->siaddr = htonl(CFG_IP_LOCAL);
+	dhcp->yiaddr = lease ? htonl(lease_ip(lease)) : 0x00000000;
+	dhcp->siaddr = htonl(netif->ip_local);
 	dhcp->giaddr = 0x00000000;
 	memset(dhcp->chaddr, 0,  16);
 	memcpy(dhcp->chaddr, pkt->chaddr, dhcp->hlen);
@@ -115,9 +353,8 @@ static void dhcpd_discover(network *netif, udp_packet *udp, int is_dhcp)
 	memset(dhcp->file,   0, 128);
 	size = sizeof(dhcp_packet);
 
-	if (is_dhcp)
+	if (type != 0)
 	{
-		u8 *options;
 		options = ((u8 *)dhcp) + sizeof(dhcp_packet);
 		/* Insert DHCP magic cookie */
 		options[0] = 0x63;
@@ -128,116 +365,70 @@ static void dhcpd_discover(network *netif, udp_packet *udp, int is_dhcp)
 		/* DHCP message type */
 		options[0] = 53;
 		options[1] = 1;
-		options[2] = 2; /* OFFER */
+		options[2] = type;
 		options += 3;
-		/* Lease time */
-		options[0] = 51;
-		options[1] = 4;
-		options[2] = 0;  /* 4h */
-		options[3] = 0;
-		options[4] = 0x38;
-		options[5] = 0x40;
-		options += 6;
-		/* Renewal time */
-		options[0] = 58;
+		/* Server identifier */
+		options[0] = 54;
 		options[1] = 4;
-		options[2] = 0; /* 2h */
-		options[3] = 0;
-		options[4] = 0x1C;
-		options[5] = 0x20;
+		options[2] = (netif->ip_local >> 24) & 0xFF;
+		options[3] = (netif->ip_local >> 16) & 0xFF;
+		options[4] = (netif->ip_local >>  8) & 0xFF;
+		options[5] = (netif->ip_local >>  0) & 0xFF;
 		options += 6;
+		if (type != DHCP_MSG_NAK)
+		{
+			/* Lease time */
+			options[0] = 51;
+			options[1] = 4;
+			options[2] = (DHCP_LEASE_TIME >> 24) & 0xFF;
+			options[3] = (DHCP_LEASE_TIME >> 16) & 0xFF;
+			options[4] = (DHCP_LEASE_TIME >>  8) & 0xFF;
+			options[5] = (DHCP_LEASE_TIME >>  0) & 0xFF;
+			options += 6;
+			/* Renewal time (half of the lease) */
+			options[0] = 58;
+			options[1] = 4;
+			options[2] = ((DHCP_LEASE_TIME / 2) >> 24) & 0xFF;
+			options[3] = ((DHCP_LEASE_TIME / 2) >> 16) & 0xFF;
+			options[4] = ((DHCP_LEASE_TIME / 2) >>  8) & 0xFF;
+			options[5] = ((DHCP_LEASE_TIME / 2) >>  0) & 0xFF;
+			options += 6;
+			/* Subnet mask */
+			options[0] = 1;
+			options[1] = 4;
+			options[2] = (CFG_IP_MASK >> 24) & 0xFF;
+			options[3] = (CFG_IP_MASK >> 16) & 0xFF;
+			options[4] = (CFG_IP_MASK >>  8) & 0xFF;
+			options[5] = (CFG_IP_MASK >>  0) & 0xFF;
+			options += 6;
+		}
 		/* End of options */
 		options[0] = 0xFF;
+		options++;
 		/* Update packet size */
-		size += 4 + 3 + 6 + 6 + 1;
+		size = options - (u8 *)dhcp;
 	}
 	/* Send response into a UDP packet */
 	udp4_send(netif, &conn, size);
 }
 
-/**
- * @brief Process a DHCP request
- *
- * @param netif   Pointer to the network interface structure
- * @param udp     Pointer to the UDP packet of the request
- */
-static void dhcpd_request(network *netif, udp_packet *udp)
-{
-	udp_conn     conn;
-	u8 *options;
-
-	dhcp_packet *pkt = (dhcp_packet *)( ((u8 *)udp) + 8);
-
-	DHCP_PUTS("DHCP REQUEST\r\n");
-
-	/* Initialize a temporary UDP connection */
-	conn.ip_remote   = 0xFFFFFFFF;
-	conn.port_remote = udp->src_port;
-	conn.port_local  = htons(0x43);
-	conn.rsp = 0;
-	/* Make DHCP response */
-	dhcp_packet *dhcp = (dhcp_packet *)udp4_tx_buffer(netif, &conn);
-	dhcp->op     = DHCP_OFFER;
-	dhcp->htype  = 1;
-	dhcp->hlen   = 6;
-	dhcp->xid    = pkt->xid;
-	dhcp->secs   = 0;
-	dhcp->flags  = 0;
-	dhcp->ciaddr = 0x00000000;
-	dhcp->yiaddr = htonl(CFG_IP_REMOTE);
-	dhcp->siaddr = htonl(CFG_IP_LOCAL);
-	dhcp->giaddr = 0x00000000;
-	memset(dhcp->chaddr, 0,  16);
-	memcpy(dhcp->chaddr, pkt->chaddr, dhcp->hlen);
-	memset(dhcp->sname,  0,  64);
-	memset(dhcp->file,   0, 128);
-	/* Include DHCP options */
-	options = ((u8 *)dhcp) + sizeof(dhcp_packet);
-	options[0] = 0x63;
-	options[1] = 0x82;
-	options[2] = 0x53;
-	options[3] = 0x63;
-	options += 4;
-	/* DHCP message type */
-	options[0] = 53;
-	options[1] = 1;
-	options[2] = 5; /* ACK */
-	options += 3;
-	/* Lease time */
-	options[0] = 51;
-	options[1] = 4;
-	options[2] = 0; /* 4h */
-	options[3] = 0;
-	options[4] = 0x38;
-	options[5] = 0x40;
-	options += 6;
-	/* Renewal time */
-	options[0] = 58;
-	options[1] = 4;
-	options[2] = 0; /* 2h */
-	options[3] = 0;
-	options[4] = 0x1C;
-	options[5] = 0x20;
-	options += 6;
-	/* End of options */
-	options[0] = 0xFF;
-	/* Send response into a UDP packet */
-	udp4_send(netif, &conn, sizeof(dhcp_packet)+20 );
-}
-
 /**
  * @brief Search a specific DHCP option into a packet
  *
+ * Only options that are entirely into the packet are returned, so the
+ * length byte (pnt[1]) of the result can be trusted.
+ *
  * @param pkt Pointer to the DHCP packet where to search
+ * @param len Size of the options (after the magic cookie)
  * @param id  Identifier of the searched option
  * @return Pointer to the extension (or NULL if not found)
  */
-static u8* find_option(dhcp_packet *pkt, u8 id)
+static u8* find_option(dhcp_packet *pkt, int len, u8 id)
 {
 	u8 *pnt = (u8 *)pkt + sizeof(dhcp_packet) + 4;
-	u8 *result = 0;
+	u8 *end = pnt + len;
 
-	while(1)
+	while (pnt < end)
 	{
 		/* If the current option is a padding */
 		if (*pnt == 0x00)
@@ -248,15 +439,112 @@ static u8* find_option(dhcp_packet *pkt, u8 id)
 		/* If the End-Of-Options has been reached */
 		if (*pnt == 0xFF)
 			break;
+		/* Option header and content must be into the packet */
+		if (((pnt + 2) > end) || ((pnt + 2 + pnt[1]) > end))
+			break;
 		/* If the current extension has the requested ID */
 		if (*pnt == id)
-		{
-			result = pnt;
-			break;
-		}
+			return(pnt);
 		/* Go to next option */
 		pnt += 2 + pnt[1];
 	}
-	return result;
+	return(0);
+}
+
+/**
+ * @brief Read a 32bits big-endian word (unaligned)
+ *
+ * @param p Pointer to the first byte
+ * @return Value of the word (host order)
+ */
+static u32 get32(const u8 *p)
+{
+	return((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+/**
+ * @brief Allocate a lease for a new client
+ *
+ * @param mac   Hardware address of the client
+ * @param hint  Address wanted by the client (or 0)
+ * @param exact When set, only the wanted address can be allocated
+ * @return Pointer to the lease, or 0 if the pool is full (or the wanted
+ *         address is not available, for an exact allocation)
+ */
+static dhcp_lease *lease_alloc(const u8 *mac, u32 hint, int exact)
+{
+	dhcp_lease *lease = 0;
+	u32 index;
+	int i;
+
+	/* Use the wanted address, if into the pool and free */
+	index = hint - dhcp_pool;
+	if ((index < DHCP_POOL_SIZE) &&
+	    (dhcp_leases[index].state == DHCP_LEASE_FREE))
+		lease = &dhcp_leases[index];
+	/* Else, use the first free address */
+	for (i = 0; (lease == 0) && ( ! exact) && (i < DHCP_POOL_SIZE); i++)
+		if (dhcp_leases[i].state == DHCP_LEASE_FREE)
+			lease = &dhcp_leases[i];
+	if (lease == 0)
+		return(0);
+
+	memcpy(lease->mac, mac, 6);
+	return(lease);
+}
+
+/**
+ * @brief Timer handler, called when an offer, a lease or a decline expires
+ *
+ * @param tmr Pointer to the timer of the lease
+ */
+static void lease_expire(timer *tmr)
+{
+	DHCP_PUTS("DHCP: lease expired\r\n");
+	lease_free((dhcp_lease *)tmr->priv);
+}
+
+/**
+ * @brief Search the lease of a client
+ *
+ * @param mac Hardware address of the client
+ * @return Pointer to the lease, or 0 if the client has no lease
+ */
+static dhcp_lease *lease_find(const u8 *mac)
+{
+	int i;
+
+	for (i = 0; i < DHCP_POOL_SIZE; i++)
+	{
+		if ((dhcp_leases[i].state == DHCP_LEASE_FREE) ||
+		    (dhcp_leases[i].state == DHCP_LEASE_DECLINED))
+			continue;
+		if (memcmp(dhcp_leases[i].mac, mac, 6) == 0)
+			return(&dhcp_leases[i]);
+	}
+	return(0);
+}
+
+/**
+ * @brief Release a lease
+ *
+ * @param lease Pointer to the lease
+ */
+static void lease_free(dhcp_lease *lease)
+{
+	timer_cancel(&lease->tmr);
+	memset(lease->mac, 0, 6);
+	lease->state = DHCP_LEASE_FREE;
+}
+
+/**
+ * @brief Get the IP address associated with a lease
+ *
+ * @param lease Pointer to the lease
+ * @return IP address (host order)
+ */
+static u32 lease_ip(dhcp_lease *lease)
+{
+	return(dhcp_pool + (lease - dhcp_leases));
 }
 /* EOF */
@@ -16,8 +16,10 @@
 #ifndef NET_DHCP_H
 #define NET_DHCP_H
 #include "log.h"
-#include "types.h"
+#include "net.h"
 #include "net_ipv4.h"
+#include "timer.h"
+#include "types.h"
 
 #ifdef DEBUG_DHCP
 #define DHCP_PUTS(x) DBG_PUTS(x)
@@ -25,9 +27,43 @@
 #define DHCP_PUTS(x) {}
 #endif
 
+/* First address of the pool (host order, default is the remote address */
+/* of the interface, see net_init) and number of leases                   */
+#ifndef DHCP_POOL_SIZE
+#define DHCP_POOL_SIZE  4
+#endif
+/* Lease time given to clients (seconds) */
+#ifndef DHCP_LEASE_TIME
+#define DHCP_LEASE_TIME 14400
+#endif
+/* Time an offered address is reserved, waiting for a request (ms) */
+#ifndef DHCP_OFFER_TIME
+#define DHCP_OFFER_TIME 30000
+#endif
+/* Time an address declined by a client (already used) is not offered (ms) */
+#ifndef DHCP_DECLINE_TIME
+#define DHCP_DECLINE_TIME 300000
+#endif
+
+/* BOOTP operation code */
 #define DHCP_DISCOVER 1
 #define DHCP_OFFER    2
 
+/* DHCP message type (option 53) */
+#define DHCP_MSG_DISCOVER 1
+#define DHCP_MSG_OFFER    2
+#define DHCP_MSG_REQUEST  3
+#define DHCP_MSG_DECLINE  4
+#define DHCP_MSG_ACK      5
+#define DHCP_MSG_NAK      6
+#define DHCP_MSG_RELEASE  7
+
+/* State of a lease */
+#define DHCP_LEASE_FREE    0
+#define DHCP_LEASE_OFFERED 1
+#define DHCP_LEASE_BOUND   2
+#define DHCP_LEASE_DECLINED 3
+
 typedef struct __attribute__((packed))
 {
 	u8  op;
@@ -47,6 +83,14 @@ typedef struct __attribute__((packed))
         u8  file [128];
 } dhcp_packet;
 
+typedef struct
+{
+	u8    mac[6]; /* Hardware address of the client (chaddr) */
+	u8    state;  /* DHCP_LEASE_x                            */
+	timer tmr;    /* Expiration of the offer or the lease    */
+} dhcp_lease;
+
+void dhcp_init(network *netif);
 void dhcp_recv(network *netif, udp_packet *pkt, ip_dgram *ip);
 
 #endif
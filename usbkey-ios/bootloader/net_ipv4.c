@@ -13,20 +13,50 @@
  * License along with this program, see LICENSE.md file for more details.
  * This program is distributed WITHOUT ANY WARRANTY see README file.
  */
+#include "hardware.h"
 #include "libc.h"
 #include "net.h"
+#include "net_arp.h"
 #include "net_dhcp.h"
 #include "net_ipv4.h"
+#include "net_ipv6.h"
+#include "prof.h"
+#include "timer.h"
 #include "types.h"
 #include "uart.h"
 
+/* ICMP functions */
+static void icmp4_receive(network *mod, ip_dgram *ip, int length);
+/* Common IPv4/IPv6 functions (used by TCP and UDP) */
+static u16  ip_tx_cksum(network *mod, u8 proto, u8 *pkt, int len);
+static u8  *ip_tx_reply(network *mod, u8 proto);
+static void ip_tx_send (network *mod, int len);
+
 /* TCP functions */
 static void tcp4_accept (network *netif, tcp_packet *req);
+static void tcp4_connected(tcp_conn *conn, tcp_packet *req);
+static void tcp4_fin_sent(tcp_conn *conn);
+static void tcp4_free   (tcp_conn *conn);
+static u16  tcp4_port   (network *netif);
+static int  tcp4_ack    (tcp_conn *conn, tcp_packet *req, int dlen);
+static void tcp4_output (tcp_conn *conn, int len);
 static tcp_packet *tcp4_prepare(tcp_conn *conn);
-static void tcp4_receive(network *netif, tcp_packet *pkt, int len);
+static void tcp4_retransmit(tcp_conn *conn);
+static void tcp4_rtt    (tcp_conn *conn, u32 rtt);
+static void tcp4_rtx_reset(tcp_conn *conn);
+static void tcp4_rtx_timeout(timer *tmr);
+static int  tcp4_tx_busy(tcp_conn *conn);
 static void tcp4_tx_wait(tcp_conn *conn);
 /* UDP functions */
-static void udp4_receive(network *mod, udp_packet *pkt, ip_dgram *ip);
+static void udp4_enqueue(udp_socket *sock, udp_packet *pkt, int len);
+
+/* ICMP echo rate limiter (token bucket) */
+static int icmp_tokens;
+static u32 icmp_refill;
+#if TCP_RTX_BUDGET > 0
+/* Memory for the retransmit buffers of TCP connections */
+static u8  tcp_rtx_pool[TCP_RTX_BUDGET];
+#endif
 
 /**
  * @brief Initialize the IPv4 protocol module
@@ -35,16 +65,47 @@ static void udp4_receive(network *mod, udp_packet *pkt, ip_dgram *ip);
  */
 void ipv4_init(network *mod)
 {
+	tcp_conn *conn;
+	int used = 0;
 	int i;
 
 	for (i = 0; i < mod->tcp.conn_count; i++)
 	{
-		mod->tcp.conns[i].ip_remote = 0;
-		mod->tcp.conns[i].state     = TCP_CONN_CLOSED;
-		mod->tcp.conns[i].closed    = 0;
-		mod->tcp.conns[i].process   = 0;
-		mod->tcp.conns[i].tx_more   = 0;
+		conn = &mod->tcp.conns[i];
+		conn->ip_remote = 0;
+		conn->state     = TCP_CONN_CLOSED;
+		conn->seq_acked = 0;
+		conn->closed    = 0;
+		conn->process   = 0;
+		conn->tx_more   = 0;
+		/* Give a retransmit buffer while the memory budget allows it */
+		conn->rtx_buf   = 0;
+#if TCP_RTX_BUDGET > 0
+		if ((used + TCP_RTX_SIZE) <= TCP_RTX_BUDGET)
+		{
+			conn->rtx_buf = &tcp_rtx_pool[used];
+			used += TCP_RTX_SIZE;
+		}
+#endif
+		memset(&conn->rtx_tmr, 0, sizeof(timer));
+		conn->rtx_tmr.handler = tcp4_rtx_timeout;
+		conn->rtx_tmr.priv    = conn;
+		tcp4_rtx_reset(conn);
+	}
+	(void)used;
+	/* First ephemeral port is chosen on first active open (tcp4_port) */
+	mod->tcp.port_next = 0;
+	/* Clear UDP dispatch table */
+	for (i = 0; i < NET_UDP_SOCKETS; i++)
+	{
+		mod->udp.ports[i] = 0;
+		mod->udp.socks[i] = 0;
 	}
+	/* Rate limiter starts with a full bucket */
+	icmp_tokens = ICMP_BURST;
+	icmp_refill = timer_now();
+	/* Clear DHCP leases */
+	dhcp_init(mod);
 }
 
 /**
@@ -65,20 +126,22 @@ void ipv4_receive(network *mod, u8 *buffer, int length)
 		NET_PUTS("IPv4: Missing parameter for receive function\r\n");
 		return;
 	}
+	PROF_START(PROF_IPV4_RECEIVE);
 
 	/* Process datagram according to the IP protocol used */
 	switch (req->proto)
 	{
 		case IP_PROTO_ICMP:
-			NET_PUTS("IPv4: receive an ICMP packet\r\n");
+			icmp4_receive(mod, req, length);
 			break;
 		case IP_PROTO_IGMP:
 			/* Not used yet */
+			mod->stats.ip_noproto++;
 			break;
 		case IP_PROTO_UDP:
 		{
 			udp_packet *pkt = (udp_packet *)(buffer + 20);
-			udp4_receive(mod, pkt, req);
+			udp4_receive(mod, pkt, req, length - 20);
 			break;
 		}
 		case IP_PROTO_TCP:
@@ -88,16 +151,14 @@ void ipv4_receive(network *mod, u8 *buffer, int length)
 			break;
 		}
 		default:
+			mod->stats.ip_noproto++;
 #ifdef DEBUG_NET
-			uart_puts("IPv4:");
-			uart_puts(" src="); uart_puthex( htonl(req->src) );
-			uart_puts(" dst="); uart_puthex( htonl(req->dst) );
-			uart_puts(" proto="); uart_puthex8( req->proto );
-			uart_crlf();
+			LOG3("IPv4: src=%08X dst=%08X proto=%02X\r\n",
+			     htonl(req->src), htonl(req->dst), req->proto);
 #endif
 			break;
 	}
-
+	PROF_END(PROF_IPV4_RECEIVE);
 }
 
 /**
@@ -109,6 +170,7 @@ void ipv4_receive(network *mod, u8 *buffer, int length)
 void ipv4_send(network *mod, int len)
 {
 	ip_dgram *rsp;
+	u32 next_hop;
 	u16 cksum;
 
 	/* Get the buffer of TX frame from network layer */
@@ -120,8 +182,18 @@ void ipv4_send(network *mod, int len)
 	cksum = ip_cksum(0, (u8 *)rsp, 20);
 	rsp->cksum = htons(~cksum);
 
-	/* Call underlying net layer to send datagram */
-	net_send(mod, len + 20);
+	/* Datagrams for another network are sent to the host (gateway) */
+	next_hop = htonl(rsp->dst);
+	if ((next_hop != 0xFFFFFFFF) && ((next_hop & 0xF0000000) != 0xE0000000) &&
+	    ((next_hop ^ mod->ip_local) & CFG_IP_MASK))
+		next_hop = mod->ip_remote;
+	/* Set destination MAC, or wait for ARP resolution */
+	if (arp_resolve(mod, next_hop, mod->tx_buffer) != 0)
+		arp_hold(mod, next_hop, len + 20);
+	else
+		/* Call underlying net layer to send datagram */
+		net_send(mod, len + 20);
+	mod->stats.ip_tx++;
 }
 
 /**
@@ -148,7 +220,7 @@ u8 *ipv4_tx_buffer(network *mod, u32 dest, u8 proto)
 	rsp->ttl    = 0x40;
 	rsp->proto  = proto;
 	rsp->cksum  = 0x0000;
-	rsp->src    = htonl(CFG_IP_LOCAL);
+	rsp->src    = htonl(mod->ip_local);
 	rsp->dst    = htonl(dest);
 	
 	return (((u8 *)rsp) + 20);
@@ -161,11 +233,12 @@ u8 *ipv4_tx_buffer(network *mod, u32 dest, u8 proto)
  * @param data Pointer to the data buffer
  * @param len  Length of the data buffer
  */
-u16 ip_cksum(u32 sum, const u8 *data, u16 len)
+RAMFUNC_CKSUM u16 ip_cksum(u32 sum, const u8 *data, u16 len)
 {
 	u16 t;
 	const u8 *dataptr;
 	const u8 *last_byte;
+	PROF_START(PROF_IP_CKSUM);
 
 	dataptr = data;
 	last_byte = data + len - 1;
@@ -195,10 +268,189 @@ u16 ip_cksum(u32 sum, const u8 *data, u16 len)
 		sum = (sum & 0xFFFF) + plop;
 	}
 	
+	PROF_END(PROF_IP_CKSUM);
 	/* Return sum in host byte order. */
 	return (u16)sum;
 }
 
+/**
+ * @brief Update a checksum when a 16bits word of the data is modified
+ *
+ * This is the incremental update of RFC 1624 (eqn. 3), values are in host
+ * byte order.
+ *
+ * @param cksum Checksum field before update
+ * @param old   Previous value of the modified word
+ * @param new   New value of the modified word
+ * @return Value of the updated checksum field
+ */
+u16 ip_cksum_adjust(u16 cksum, u16 old, u16 new)
+{
+	u32 sum;
+
+	sum  = (u16)~cksum + (u16)~old + new;
+	sum  = (sum & 0xFFFF) + (sum >> 16);
+	sum  = (sum & 0xFFFF) + (sum >> 16);
+	return((u16)~sum);
+}
+
+/**
+ * @brief Compute the checksum of a TCP or UDP packet into the TX buffer
+ *
+ * The pseudo-header is taken from the IP header of the TX datagram, so the
+ * same function is used for IPv4 and IPv6.
+ *
+ * @param mod   Pointer to the network interface structure
+ * @param proto ID of the protocol (IP_PROTO_TCP or IP_PROTO_UDP)
+ * @param pkt   Pointer to the packet (header and datas)
+ * @param len   Length of the packet (in bytes)
+ * @return Value of the checksum field (host byte order)
+ */
+static u16 ip_tx_cksum(network *mod, u8 proto, u8 *pkt, int len)
+{
+	u8 *dgram = mod->tx_buffer + 14;
+	u32 sum;
+
+	/* Pseudo-header : source and destination addresses */
+	if ((dgram[0] >> 4) == NET_AF_INET6)
+		sum = ip_cksum(0, dgram + 8, 32);
+	else
+		sum = ip_cksum(0, dgram + 12, 8);
+	/* Pseudo-header : protocol and length */
+	sum += proto + len;
+
+	return((u16)~ip_cksum(sum, pkt, len));
+}
+
+/**
+ * @brief Get a TX buffer for a response to the received datagram
+ *
+ * @param mod   Pointer to the network interface structure
+ * @param proto ID of the protocol used inside the datagram
+ * @return Pointer to the payload of the TX datagram
+ */
+static u8 *ip_tx_reply(network *mod, u8 proto)
+{
+	u8 *dgram = mod->rx_buffer + 14;
+
+#ifdef USE_IPV6
+	if ((dgram[0] >> 4) == NET_AF_INET6)
+		return(ipv6_tx_buffer(mod, ((ip6_dgram *)dgram)->src, proto));
+#endif
+	return(ipv4_tx_buffer(mod, htonl(((ip_dgram *)dgram)->src), proto));
+}
+
+/**
+ * @brief Send the TX datagram with the IP layer used to prepare it
+ *
+ * @param mod Pointer to the network interface structure
+ * @param len Size of the payload (in bytes)
+ */
+static void ip_tx_send(network *mod, int len)
+{
+#ifdef USE_IPV6
+	u8 *dgram = mod->tx_buffer + 14;
+
+	if ((dgram[0] >> 4) == NET_AF_INET6)
+	{
+		ipv6_send(mod, len);
+		return;
+	}
+#endif
+	ipv4_send(mod, len);
+}
+
+/* ------------------------------------------------------------------------- */
+/* --                                 ICMP                                -- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * @brief Test if an echo reply can be sent (token bucket rate limiter)
+ *
+ * The bucket is shared by ICMP and ICMPv6 echo.
+ *
+ * @param mod Pointer to the network interface structure
+ * @return integer True if the reply can be sent (a token is consumed)
+ */
+int icmp_allow(network *mod)
+{
+	u32 now;
+
+	/* Refill the bucket, one token per elapsed interval */
+	now = timer_now();
+	while ((now - icmp_refill) >= ICMP_INTERVAL)
+	{
+		if (icmp_tokens == ICMP_BURST)
+		{
+			icmp_refill = now;
+			break;
+		}
+		icmp_tokens++;
+		icmp_refill += ICMP_INTERVAL;
+	}
+	if (icmp_tokens == 0)
+	{
+		mod->stats.icmp_limit++;
+		return(0);
+	}
+	icmp_tokens--;
+	return(1);
+}
+
+/**
+ * @brief Called by IPv4 layer when an ICMP packet is received
+ *
+ * Echo requests are answered in place : the received frame is modified
+ * (addresses swapped, type and TTL updated with incremental checksums) and
+ * sent back from the RX buffer. Replies are limited by a token bucket so a
+ * flood can not use all the bandwidth of the other services.
+ *
+ * @param mod    Pointer to the network interface structure
+ * @param ip     Pointer to the received IP datagram
+ * @param length Size of the received datagram (in bytes)
+ */
+static void icmp4_receive(network *mod, ip_dgram *ip, int length)
+{
+	icmp_packet *pkt = (icmp_packet *)((u8 *)ip + 20);
+	u16 old, new;
+	u32 addr;
+
+	if ((length < (20 + 8)) || (pkt->type != ICMP_ECHO_REQUEST))
+	{
+		NET_PUTS("IPv4: ICMP packet ignored\r\n");
+		mod->stats.ip_noproto++;
+		return;
+	}
+	mod->stats.icmp_rx++;
+
+	/* Reply is sent in place : drop the request if driver is busy */
+	if (net_tx_busy(mod))
+	{
+		mod->stats.tx_err++;
+		return;
+	}
+	if ( ! icmp_allow(mod))
+		return;
+
+	/* Echo reply : only the type changes into ICMP header */
+	pkt->type  = ICMP_ECHO_REPLY;
+	pkt->cksum = htons(ip_cksum_adjust(htons(pkt->cksum),
+	                   (ICMP_ECHO_REQUEST << 8), (ICMP_ECHO_REPLY << 8)));
+	/* Swap IP addresses (checksum is not modified) */
+	addr    = ip->src;
+	ip->src = ip->dst;
+	ip->dst = addr;
+	/* Set a new TTL */
+	old = (ip->ttl << 8) | ip->proto;
+	ip->ttl = 0x40;
+	new = (ip->ttl << 8) | ip->proto;
+	ip->cksum = htons(ip_cksum_adjust(htons(ip->cksum), old, new));
+
+	net_send_rx(mod, htons(ip->length));
+	mod->stats.ip_tx++;
+	mod->stats.icmp_tx++;
+}
+
 /* ------------------------------------------------------------------------- */
 /* --                                 TCP                                 -- */
 /* ------------------------------------------------------------------------- */
@@ -214,12 +466,10 @@ static void tcp4_accept(network *netif, tcp_packet *req)
 	tcp_packet *rsp;
 	tcp_conn   *newconn = 0;
 	tcp_conn   tmpconn;
-	ip_dgram *ip;
+	u8  *dgram = netif->rx_buffer + 14;
 	u8  *buffer;
 	int i;
 
-	ip = (ip_dgram *)(((u8*)req) - 20);
-
 	/* Create a new TCP connection for this network interface */
 	for (i = 0; i < netif->tcp.conn_count; i++)
 	{
@@ -230,22 +480,33 @@ static void tcp4_accept(network *netif, tcp_packet *req)
 		newconn = &netif->tcp.conns[i];
 
 		/* Configure new connection */
-		newconn->ip_remote  = htonl(ip->src);
+		newconn->family     = (dgram[0] >> 4);
+#ifdef USE_IPV6
+		if (newconn->family == NET_AF_INET6)
+		{
+			newconn->ip_remote = 0xFFFFFFFF;
+			memcpy(newconn->ip6_remote, ((ip6_dgram *)dgram)->src, 16);
+		}
+		else
+#endif
+		newconn->ip_remote  = htonl(((ip_dgram *)dgram)->src);
 		newconn->port_local = htons(req->dst_port);
 		newconn->port_remote= htons(req->src_port);
 		newconn->seq_local  = 0x12345678;
+		newconn->seq_acked  = newconn->seq_local;
 		newconn->seq_remote = htonl(req->seq) + 1;
 		newconn->state      = TCP_CONN_SYN;
 		newconn->netif      = netif;
 		newconn->closed     = 0;
 		newconn->process    = 0;
 		newconn->tx_more    = 0;
+		tcp4_rtx_reset(newconn);
 
 		break;
 	}
 
-	/* Get the buffer of TX datagram from IPv4 underlayer */
-	buffer = (u8 *)ipv4_tx_buffer(netif, htonl(ip->src), 0x06);
+	/* Get the buffer of TX datagram from IP underlayer */
+	buffer = ip_tx_reply(netif, IP_PROTO_TCP);
 
 	rsp = (tcp_packet *)buffer;
 	rsp->src_port = req->dst_port;
@@ -284,16 +545,15 @@ static void tcp4_accept(network *netif, tcp_packet *req)
 #ifdef DEBUG_NET
 	else
 	{
-		uart_puts(" * ACCEPT from=");
-		uart_puthex(newconn->ip_remote);
-		uart_puts(" local port=");  uart_puthex16(newconn->port_local);
-		uart_puts(" remote port="); uart_puthex16(newconn->port_remote);
-		uart_crlf();
+		LOG3(" * ACCEPT from=%08X local port=%04X remote port=%04X\r\n",
+		     newconn->ip_remote, newconn->port_local, newconn->port_remote);
 	}
 #endif
 
 	rsp->flags |= TCP_SYN;
 	rsp->seq    = htonl(newconn->seq_local);
+	/* SYN-ACK is retransmitted until the ACK of the peer is received */
+	timer_arm(&newconn->rtx_tmr, newconn->rto);
 	goto send;
 
 reject:
@@ -302,12 +562,291 @@ reject:
 	newconn->netif = netif;
 	rsp->flags |= TCP_RST;
 	rsp->seq    = 0x00000000;
+	netif->stats.tcp_rst_tx++;
 
 send:
 	newconn->rsp = rsp;
 	tcp4_send(newconn, 0);
 }
 
+/**
+ * @brief Process the ACK field of a segment received on a connection
+ *
+ * Acknowledged datas are removed from the retransmit buffer and the RTT is
+ * sampled when the timed segment is acknowledged. A third duplicate ACK
+ * (same value, no data, while datas are in flight) triggers a fast
+ * retransmit of the oldest segment.
+ *
+ * @param conn Pointer to the TCP connection
+ * @param req  Pointer to the received TCP packet
+ * @param dlen Length of the datas into the received packet
+ * @return integer True if new datas have been acknowledged
+ */
+static int tcp4_ack(tcp_conn *conn, tcp_packet *req, int dlen)
+{
+	network *netif = conn->netif;
+	u32 ack = htonl(req->ack);
+	u32 n;
+
+	if (ack == conn->seq_acked)
+	{
+		/* Same ACK again, without data, while data are in flight */
+		if ((dlen == 0) && ((req->flags & (TCP_SYN | TCP_FIN)) == 0) &&
+		    (ack != conn->seq_local))
+		{
+			netif->stats.tcp_dupack++;
+			if (++conn->dupacks == TCP_DUPACK_THRESHOLD)
+			{
+				netif->stats.tcp_fastrtx++;
+				tcp4_retransmit(conn);
+			}
+		}
+		return(0);
+	}
+	/* Old ACK (reordered segment) is ignored */
+	if ((int)(ack - conn->seq_acked) < 0)
+		return(0);
+	/* ACK for datas not sent, trust the peer (and resync) */
+	if ((int)(ack - conn->seq_local) > 0)
+		conn->seq_local = ack;
+
+	/* Remove acknowledged datas from retransmit buffer */
+	n = ack - conn->seq_acked;
+	if (n >= conn->rtx_len)
+		conn->rtx_len = 0;
+	else
+	{
+		memmove(conn->rtx_buf, conn->rtx_buf + n, conn->rtx_len - n);
+		conn->rtx_len -= n;
+	}
+	conn->seq_acked = ack;
+	conn->dupacks   = 0;
+	conn->rtx_count = 0;
+	/* FIN is acknowledged when all sequence numbers are */
+	if (conn->rtx_fin && (ack == conn->seq_local))
+		conn->rtx_fin = 0;
+
+	/* RTT sample (Karn : timing is cancelled by a retransmission) */
+	if (conn->rtt_timing && ((int)(ack - conn->rtt_seq) >= 0))
+	{
+		tcp4_rtt(conn, timer_now() - conn->rtt_start);
+		conn->rtt_timing = 0;
+	}
+	/* Restart the retransmit timer for the remaining datas (or FIN) */
+	if (conn->rtx_len || conn->rtx_fin)
+		timer_arm(&conn->rtx_tmr, conn->rto);
+	else
+		timer_cancel(&conn->rtx_tmr);
+	return(1);
+}
+
+/**
+ * @brief Open a connection to a remote host (active open)
+ *
+ * A free connection slot is configured with an ephemeral local port and a
+ * SYN is sent. The connection stays into SYN_SENT state until the SYN-ACK
+ * of the peer is received, then the 'accept' method of the service (if
+ * any) is called and the 'process' method receives the datas. When the
+ * peer refuse the connection, the 'closed' method is called.
+ *
+ * @param netif   Pointer to the network interface structure
+ * @param family  Address family of the peer (NET_AF_INET or NET_AF_INET6)
+ * @param addr    Pointer to the address of the peer : u32 in host byte order
+ *                for IPv4, 16 bytes for IPv6
+ * @param service Pointer to the service (gives remote port and callbacks)
+ * @return Pointer to the new connection, or NULL if no slot is available
+ */
+tcp_conn *tcp4_connect(network *netif, u8 family, const void *addr,
+                       tcp_service *service)
+{
+	tcp_packet *rsp;
+	tcp_conn   *conn = 0;
+	int i;
+
+	if ((service == 0) || (service->process == 0))
+		return(0);
+#ifndef USE_IPV6
+	if (family != NET_AF_INET)
+		return(0);
+#endif
+
+	for (i = 0; i < netif->tcp.conn_count; i++)
+	{
+		if (netif->tcp.conns[i].ip_remote != 0x00000000)
+			continue;
+		conn = &netif->tcp.conns[i];
+		break;
+	}
+	if (conn == 0)
+		return(0);
+
+	conn->family = family;
+#ifdef USE_IPV6
+	if (family == NET_AF_INET6)
+	{
+		conn->ip_remote = 0xFFFFFFFF;
+		memcpy(conn->ip6_remote, addr, 16);
+	}
+	else
+#endif
+	memcpy(&conn->ip_remote, addr, 4);
+	conn->port_local  = tcp4_port(netif);
+	conn->port_remote = service->port;
+	conn->seq_local   = (timer_now() << 12) ^ conn->port_local;
+	conn->seq_acked   = conn->seq_local;
+	conn->seq_remote  = 0;
+	conn->state       = TCP_CONN_SYN_SENT;
+	conn->netif       = netif;
+	conn->service     = service;
+	conn->closed      = 0;
+	conn->process     = service->process;
+	conn->tx_more     = 0;
+	conn->req         = 0;
+	tcp4_rtx_reset(conn);
+
+	/* Send the SYN (without ACK) */
+	rsp = tcp4_prepare(conn);
+	rsp->flags = TCP_SYN;
+	rsp->ack   = 0;
+	tcp4_send(conn, 0);
+	/* SYN use one sequence number */
+	conn->seq_local += 1;
+	/* SYN is retransmitted (and timed) until the SYN-ACK is received */
+	conn->rtt_timing = 1;
+	conn->rtt_seq    = conn->seq_local;
+	conn->rtt_start  = timer_now();
+	timer_arm(&conn->rtx_tmr, conn->rto);
+
+	return(conn);
+}
+
+/**
+ * @brief Complete an active open when the SYN-ACK of the peer is received
+ *
+ * @param conn Pointer to the connection (into SYN_SENT state)
+ * @param req  Pointer to the received TCP packet
+ */
+static void tcp4_connected(tcp_conn *conn, tcp_packet *req)
+{
+	tcp_packet *rsp;
+	u8 flags = req->flags & (TCP_SYN | TCP_ACK | TCP_RST);
+
+	/* The ACK must be for our SYN, else the segment is ignored */
+	if ((flags & TCP_ACK) && (htonl(req->ack) != conn->seq_local))
+		return;
+
+	/* Connection refused by the peer */
+	if (flags == (TCP_RST | TCP_ACK))
+	{
+		NET_PUTS("TCP4: Connection refused\r\n");
+		tcp4_free(conn);
+		return;
+	}
+	if (flags != (TCP_SYN | TCP_ACK))
+		return;
+
+	NET_PUTS("TCP4: Connection established\r\n");
+	conn->seq_remote = htonl(req->seq) + 1;
+	conn->seq_acked  = conn->seq_local;
+	conn->state      = TCP_CONN_ESTABLISHED;
+	/* First RTT sample, if the SYN has not been retransmitted */
+	if (conn->rtt_timing)
+		tcp4_rtt(conn, timer_now() - conn->rtt_start);
+	conn->rtt_timing = 0;
+	conn->rtx_count  = 0;
+	timer_cancel(&conn->rtx_tmr);
+
+	/* Acknowledge the SYN of the peer */
+	tcp4_prepare(conn);
+	tcp4_send(conn, 0);
+
+	/* Service can refuse the connection (ex: no more resource) */
+	if ((conn->service->accept != 0) && conn->service->accept(conn))
+	{
+		rsp = tcp4_prepare(conn);
+		rsp->flags = TCP_RST;
+		tcp4_send(conn, 0);
+		conn->netif->stats.tcp_rst_tx++;
+		tcp4_free(conn);
+	}
+}
+
+/**
+ * @brief Account for a FIN just sent on a connection
+ *
+ * FIN uses one sequence number, it is retransmitted (see tcp4_retransmit)
+ * until the peer acknowledges it.
+ *
+ * @param conn Pointer to the connection
+ */
+static void tcp4_fin_sent(tcp_conn *conn)
+{
+	conn->seq_local += 1;
+	conn->rtx_fin = 1;
+	if ( ! conn->rtx_tmr.armed)
+		timer_arm(&conn->rtx_tmr, conn->rto);
+}
+
+/**
+ * @brief Release a connection slot (and notify the service)
+ *
+ * @param conn Pointer to the connection
+ */
+static void tcp4_free(tcp_conn *conn)
+{
+	timer_cancel(&conn->rtx_tmr);
+	conn->rtx_len = 0;
+	if ((conn->service != 0) && (conn->service->closed != 0))
+		conn->service->closed(conn);
+	conn->ip_remote = 0;
+	conn->state = TCP_CONN_CLOSED;
+}
+
+/**
+ * @brief Allocate an ephemeral port for an active open
+ *
+ * Ports are used in sequence into the TCP_PORT_FIRST - TCP_PORT_LAST range,
+ * a port already used by a connection of the interface is skipped. The first
+ * port depends on the cycle counter when the first connection is opened and
+ * on the MAC address (serial number, see USE_SERIAL_ADDR), to avoid reuse of
+ * the same ports (and sequence numbers) after a reset.
+ *
+ * @param netif Pointer to the network interface structure
+ * @return Local port number (host byte order)
+ */
+static u16 tcp4_port(network *netif)
+{
+	u16 port;
+	int i;
+
+	if (netif->tcp.port_next == 0)
+	{
+		/* Cycle counter (time of first open) mixed with MAC address */
+		u32 seed = timer_cycles();
+		seed ^= (seed >> 12) ^ (netif->mac[3] << 8) ^ netif->mac[4];
+		netif->tcp.port_next = TCP_PORT_FIRST + (seed & 0x0FFF);
+	}
+
+	for (;;)
+	{
+		port = netif->tcp.port_next;
+		if (port >= TCP_PORT_LAST)
+			netif->tcp.port_next = TCP_PORT_FIRST;
+		else
+			netif->tcp.port_next = port + 1;
+
+		for (i = 0; i < netif->tcp.conn_count; i++)
+		{
+			if (netif->tcp.conns[i].ip_remote == 0x00000000)
+				continue;
+			if (netif->tcp.conns[i].port_local == port)
+				break;
+		}
+		if (i == netif->tcp.conn_count)
+			return(port);
+	}
+}
+
 /**
  * @brief Start a close sequence, initiated by local side of connection
  *
@@ -337,6 +876,7 @@ void tcp4_close(tcp_conn *conn)
 	conn->state = TCP_CONN_FIN_WAIT_1;
 	/* Send response */
 	tcp4_send(conn, 0);
+	tcp4_fin_sent(conn);
 }
 
 /**
@@ -349,6 +889,8 @@ void tcp4_close(tcp_conn *conn)
 static tcp_conn *tcp4_find(network *netif, tcp_packet *pkt)
 {
 	tcp_conn *result = 0;
+	tcp_conn *conn;
+	u8  *dgram = netif->rx_buffer + 14;
 	u16 req_rem_port;
 	u16 req_loc_port;
 	int i;
@@ -358,19 +900,31 @@ static tcp_conn *tcp4_find(network *netif, tcp_packet *pkt)
 
 	for (i = 0; i < netif->tcp.conn_count; i++)
 	{
+		conn = &netif->tcp.conns[i];
 		/* Use IP field to test if an entry is filled or empty */
-		if (netif->tcp.conns[i].ip_remote == 0x00000000)
+		if (conn->ip_remote == 0x00000000)
 			continue;
 		/* Test local port number field */
-		if (netif->tcp.conns[i].port_local != req_loc_port)
+		if (conn->port_local != req_loc_port)
 			continue;
 		/* Test remote port number field */
-		if (netif->tcp.conns[i].port_remote != req_rem_port)
+		if (conn->port_remote != req_rem_port)
+			continue;
+		/* Test remote address */
+		if (conn->family != (dgram[0] >> 4))
+			continue;
+#ifdef USE_IPV6
+		if (conn->family == NET_AF_INET6)
+		{
+			if (memcmp(conn->ip6_remote, ((ip6_dgram *)dgram)->src, 16))
+				continue;
+		}
+		else
+#endif
+		if (conn->ip_remote != htonl(((ip_dgram *)dgram)->src))
 			continue;
 
-		// ToDo : check IP
-
-		result = &netif->tcp.conns[i];
+		result = conn;
 		break;
 	}
 	return result;
@@ -396,7 +950,13 @@ static tcp_packet *tcp4_prepare(tcp_conn *conn)
 
 	tcp4_tx_wait(conn);
 
-	rsp = (tcp_packet *)ipv4_tx_buffer(netif, conn->ip_remote, 0x06);
+#ifdef USE_IPV6
+	if (conn->family == NET_AF_INET6)
+		rsp = (tcp_packet *)ipv6_tx_buffer(netif, conn->ip6_remote,
+		                                   IP_PROTO_TCP);
+	else
+#endif
+	rsp = (tcp_packet *)ipv4_tx_buffer(netif, conn->ip_remote, IP_PROTO_TCP);
 	rsp->src_port = 0;
 	rsp->dst_port = 0;
 	rsp->ack      = 0;
@@ -424,10 +984,15 @@ static tcp_packet *tcp4_prepare(tcp_conn *conn)
  * @param req   Pointer to the received TCP packet
  * @param len   Length of the received datas
  */
-static void tcp4_receive(network *netif, tcp_packet *req, int len)
+void tcp4_receive(network *netif, tcp_packet *req, int len)
 {
 	tcp_packet *rsp = 0;
 	tcp_conn   *conn;
+	PROF_START(PROF_TCP4_RECEIVE);
+
+	netif->stats.tcp_rx++;
+	if (req->flags & TCP_RST)
+		netif->stats.tcp_rst_rx++;
 
 	/* Search if the received packet refers to a known socket */
 	conn = tcp4_find(netif, req);
@@ -438,27 +1003,34 @@ static void tcp4_receive(network *netif, tcp_packet *req, int len)
 		if (req->flags & TCP_ACK)
 		{
 			NET_PUTS("TCP4: Connection closed\r\n");
-			if ((conn->service != 0) && (conn->service->closed != 0))
-				conn->service->closed(conn);
-			conn->ip_remote = 0;
-			conn->state = TCP_CONN_CLOSED;
+			tcp4_free(conn);
 		}
 	}
+	else if ((conn != 0) && (conn->state == TCP_CONN_SYN_SENT))
+	{
+		tcp4_connected(conn, req);
+	}
 	else if ((conn != 0) && (conn->state == TCP_CONN_SYN))
 	{
 		if (req->flags & TCP_ACK)
 		{
 			NET_PUTS("TCP4: Connection established\r\n");
 			conn->seq_local = htonl(req->ack);
+			conn->seq_acked = conn->seq_local;
 			conn->state = TCP_CONN_ESTABLISHED;
+			conn->rtx_count = 0;
+			timer_cancel(&conn->rtx_tmr);
 		}
+		/* SYN sent again by the peer : our SYN-ACK has been lost */
+		else if (req->flags & TCP_SYN)
+			tcp4_retransmit(conn);
 	}
 	else if ((conn != 0) && (conn->state == TCP_CONN_FIN_WAIT_1))
 	{
-		/* If the received packet contains a ACK value */
+		/* If the received packet contains a ACK value, release the */
+		/* acknowledged datas (ACK of our FIN resync seq_local)      */
 		if (req->flags & TCP_ACK)
-			/* Save it ! Note : Big security issue, but we assume to trust this link */
-			conn->seq_local = htonl(req->ack);
+			tcp4_ack(conn, req, len - ((req->offset >> 2) & 0x3C));
 
 		/* Update the (remote) sequence number */
 		conn->seq_remote = htonl(req->seq);
@@ -478,16 +1050,14 @@ static void tcp4_receive(network *netif, tcp_packet *req, int len)
 			tcp4_tx_wait(conn);
 
 			NET_PUTS("TCP4: Connection closed\r\n");
-			if ((conn->service != 0) && (conn->service->closed != 0))
-				conn->service->closed(conn);
-			conn->ip_remote = 0;
-			conn->state = TCP_CONN_CLOSED;
+			tcp4_free(conn);
 		}
 	}
 	/* Data packet received for a known connection */
 	else if (conn != 0)
 	{
 		int dlen, hlen;
+		int fin = 0;
 
 		/* Compute TCP header length */
 		hlen = ((req->offset >> 2) & 0x3C);
@@ -497,10 +1067,10 @@ static void tcp4_receive(network *netif, tcp_packet *req, int len)
 		/* If the received packet contains a ACK value */
 		if (req->flags & TCP_ACK)
 		{
-			/* Save it ! Note : Big security issue, but we assume to trust this link */
-			conn->seq_local = htonl(req->ack);
+			int acked = tcp4_ack(conn, req, dlen);
 
-			if (conn->tx_more)
+			/* Without retransmit buffer, any ACK restarts the stream */
+			if (conn->tx_more && (acked || (conn->rtx_buf == 0)))
 			{
 				conn->tx_more(conn);
 				// TODO: temporary reset of dlen to avoid bi-directional collision
@@ -527,10 +1097,13 @@ static void tcp4_receive(network *netif, tcp_packet *req, int len)
 				rsp->ack    = htonl(conn->seq_remote);
 				/* Set the connection into CLOSE_WAIT state */
 				conn->state = TCP_CONN_CLOSE_WAIT;
+				fin = 1;
 			}
 
 			/* Send response */
 			tcp4_send(conn, 0);
+			if (fin)
+				tcp4_fin_sent(conn);
 
 			/* Wait end of transmit */
 			tcp4_tx_wait(conn);
@@ -551,18 +1124,175 @@ static void tcp4_receive(network *netif, tcp_packet *req, int len)
 	}
 	else
 	{
-		int size = len - sizeof(tcp_packet);
-		if (size > 0)
+		netif->stats.tcp_noconn++;
+#ifdef DEBUG_NET
+		LOG2("TCP4: %08X bytes for unknown port %04X\r\n",
+		     len - sizeof(tcp_packet), htons(req->dst_port));
+#endif
+	}
+	PROF_END(PROF_TCP4_RECEIVE);
+}
+
+/**
+ * @brief Send again the oldest unacknowledged segment of a connection
+ *
+ * Into SYN_SENT (or SYN) state the SYN (or SYN-ACK) is sent again, else the
+ * first datas of the retransmit buffer (up to TCP_DATA_MAX bytes), with the
+ * FIN when it follows them. Sequence number and buffer are not modified.
+ *
+ * @param conn Pointer to the TCP connection
+ */
+static void tcp4_retransmit(tcp_conn *conn)
+{
+	tcp_packet *rsp;
+	int len = 0;
+
+	if ((conn->state != TCP_CONN_SYN_SENT) && (conn->state != TCP_CONN_SYN) &&
+	    (conn->rtx_len == 0) && (conn->rtx_fin == 0))
+		return;
+
+	rsp = tcp4_prepare(conn);
+	if (conn->state == TCP_CONN_SYN_SENT)
+	{
+		rsp->flags = TCP_SYN;
+		rsp->ack   = 0;
+		rsp->seq   = htonl(conn->seq_local - 1);
+	}
+	else if (conn->state == TCP_CONN_SYN)
+		rsp->flags = TCP_SYN | TCP_ACK;
+	else
+	{
+		len = conn->rtx_len;
+		if (len > TCP_DATA_MAX)
+			len = TCP_DATA_MAX;
+		rsp->seq = htonl(conn->seq_acked);
+		memcpy((u8 *)rsp + ((rsp->offset >> 2) & 0x3C), conn->rtx_buf, len);
+		/* FIN uses the last sequence number, after the datas (if any) */
+		if (conn->rtx_fin && (len == 0))
+			rsp->seq = htonl(conn->seq_local - 1);
+		if (conn->rtx_fin && ((htonl(rsp->seq) + len) == (conn->seq_local - 1)))
+			rsp->flags |= TCP_FIN;
+	}
+	/* Karn : a retransmitted segment can not be used to measure RTT */
+	conn->rtt_timing = 0;
+
+	tcp4_output(conn, len);
+}
+
+/**
+ * @brief Update the retransmission timeout with a new RTT sample
+ *
+ * Jacobson algorithm (RFC 6298) with scaled integers : srtt is kept x8
+ * and rttvar x4, so RTO = srtt + 4 * rttvar = (srtt >> 3) + rttvar.
+ *
+ * @param conn Pointer to the TCP connection
+ * @param rtt  Measured round trip time (ms)
+ */
+static void tcp4_rtt(tcp_conn *conn, u32 rtt)
+{
+	int delta;
+	u32 rto;
+
+	if (rtt > TCP_RTO_MAX)
+		rtt = TCP_RTO_MAX;
+
+	if (conn->srtt == 0)
+	{
+		/* First sample : srtt = rtt, rttvar = rtt / 2 */
+		conn->srtt   = rtt << 3;
+		conn->rttvar = rtt << 1;
+	}
+	else
+	{
+		/* srtt += (rtt - srtt) / 8 */
+		delta = (int)rtt - (conn->srtt >> 3);
+		conn->srtt += delta;
+		/* rttvar += (|delta| - rttvar) / 4 */
+		if (delta < 0)
+			delta = -delta;
+		conn->rttvar += delta - (conn->rttvar >> 2);
+	}
+
+	rto = (conn->srtt >> 3) + conn->rttvar;
+	if (rto < TCP_RTO_MIN)
+		rto = TCP_RTO_MIN;
+	if (rto > TCP_RTO_MAX)
+		rto = TCP_RTO_MAX;
+	conn->rto = rto;
+}
+
+/**
+ * @brief Reset the retransmission state of a connection (new connection)
+ *
+ * @param conn Pointer to the TCP connection
+ */
+static void tcp4_rtx_reset(tcp_conn *conn)
+{
+	timer_cancel(&conn->rtx_tmr);
+	conn->rtx_len    = 0;
+	conn->rtx_count  = 0;
+	conn->dupacks    = 0;
+	conn->srtt       = 0;
+	conn->rttvar     = 0;
+	conn->rto        = TCP_RTO_INIT;
+	conn->rtt_timing = 0;
+	conn->rtx_fin    = 0;
+}
+
+/**
+ * @brief Called by timer module when the retransmission timeout expires
+ *
+ * The oldest segment is sent again and the timeout is doubled (backoff).
+ * After TCP_RTX_RETRIES timeouts the connection is dropped. Timers run from
+ * the main loop : when the TX buffer is still used (frame of another module
+ * not sent, or waiting for ARP) the timeout is tried again TCP_RTX_DEFER ms
+ * later, without waiting.
+ *
+ * @param tmr Pointer to the retransmit timer of the connection
+ */
+static void tcp4_rtx_timeout(timer *tmr)
+{
+	tcp_conn *conn = (tcp_conn *)tmr->priv;
+	tcp_packet *rsp;
+	u32 rto;
+
+	if (conn->ip_remote == 0)
+		return;
+
+	if (tcp4_tx_busy(conn))
+	{
+		timer_arm(tmr, TCP_RTX_DEFER);
+		return;
+	}
+
+	if (conn->rtx_count >= TCP_RTX_RETRIES)
+	{
+		NET_PUTS("TCP4: Connection timeout\r\n");
+		if (conn->state != TCP_CONN_SYN_SENT)
 		{
-			u8 *buffer = (u8 *)req;
-			buffer += sizeof(tcp_packet);
-			uart_dump(buffer, size);
+			rsp = tcp4_prepare(conn);
+			rsp->flags = TCP_RST;
+			tcp4_output(conn, 0);
+			conn->netif->stats.tcp_rst_tx++;
 		}
+		tcp4_free(conn);
+		return;
 	}
+	conn->rtx_count++;
+	conn->netif->stats.tcp_rto++;
+
+	/* Exponential backoff, kept until a new RTT sample */
+	rto = conn->rto << 1;
+	if (rto > TCP_RTO_MAX)
+		rto = TCP_RTO_MAX;
+	conn->rto = rto;
+
+	tcp4_retransmit(conn);
+	timer_arm(tmr, conn->rto);
 }
 
 /**
- * @brief Send a TCP packet to a remote host
+ * @brief Send a TCP packet to a remote host (over IPv4 or IPv6)
  *
  * @param conn  Pointer to the TCP connection
  * @param len   Length of the datas into the packet
@@ -570,17 +1300,12 @@ static void tcp4_receive(network *netif, tcp_packet *req, int len)
 void tcp4_send(tcp_conn *conn, int len)
 {
 	network *netif;
-	u8 src_addr[4]  = {0x0A,0x0A,0x0A,0xFE};
-	u8 dest_addr[4] = {0x0A,0x0a,0x0a,0x03};
-	u16 *ip_src=(void *)&src_addr;
-	u16 *ip_dst=(void *)&dest_addr;
-	u32 sum;
-	int hlen, tmp_len;
+	int hlen;
 	tcp_packet *pkt;
-	u16 *p;
 
 	if (conn == 0)
 		return;
+	PROF_START(PROF_TCP4_SEND);
 
 	pkt   = conn->rsp;
 	netif = conn->netif;
@@ -588,46 +1313,66 @@ void tcp4_send(tcp_conn *conn, int len)
 	/* Compute the TCP header length */
 	hlen = (pkt->offset >> 2) & 0x3C;
 
+	if (len > 0)
+	{
+		/* Keep a copy of the datas until they are acknowledged. The */
+		/* buffer must contain all datas since seq_acked             */
+		if ((conn->rtx_buf != 0) &&
+		    ((conn->seq_local - conn->seq_acked) == conn->rtx_len) &&
+		    ((conn->rtx_len + len) <= TCP_RTX_SIZE))
+		{
+			memcpy(conn->rtx_buf + conn->rtx_len, (u8 *)pkt + hlen, len);
+			conn->rtx_len += len;
+			if ( ! conn->rtx_tmr.armed)
+				timer_arm(&conn->rtx_tmr, conn->rto);
+		}
+		else if (conn->ip_remote != 0)
+			netif->stats.tcp_nortx++;
+		/* Measure RTT with this segment (if none already timed) */
+		if ( ! conn->rtt_timing)
+		{
+			conn->rtt_timing = 1;
+			conn->rtt_seq    = conn->seq_local + len;
+			conn->rtt_start  = timer_now();
+		}
+	}
+
+	tcp4_output(conn, len);
+
+	/* Update sequence number */
+	conn->seq_local += len;
+	PROF_END(PROF_TCP4_SEND);
+}
+
+/**
+ * @brief Compute checksum and send the prepared packet of a connection
+ *
+ * @param conn Pointer to the TCP connection (packet into conn->rsp)
+ * @param len  Length of the datas into the packet
+ */
+static void tcp4_output(tcp_conn *conn, int len)
+{
+	network    *netif = conn->netif;
+	tcp_packet *pkt   = conn->rsp;
+	int hlen;
+
+	/* Compute the TCP header length */
+	hlen = (pkt->offset >> 2) & 0x3C;
+
 	/* If packet contains datas, include the PUSH flag */
 	if (len > 0)
 		pkt->flags |= TCP_PSH;
 
-	/* Reset checksum value */
+	/* Compute checksum of TCP header, datas and pseudo-header */
 	pkt->cksum = 0x0000;
-
-	/* Sum all values of TCP header and datas */
-	p   = (u16 *)pkt;
-	sum = 0;
-	tmp_len = hlen + len;
-	while (tmp_len > 1)
-	{
-		sum += *p++;
-		if (sum & 0x80000000)
-			sum = (sum & 0xFFFF) + (sum >> 16);
-		tmp_len -= 2;
-	}
-	if (tmp_len & 1)
-		sum += *((u8 *)p);
-	/* Add the pseudo-header sum */
-	sum += *(ip_src++);
-	sum += *ip_src;
-	sum += *(ip_dst++);
-	sum += *ip_dst;
-	sum += htons(0x06);
-	sum += htons(hlen + len);
-	/* Add the carries */
-	while (sum >> 16)
-		sum = (sum & 0xFFFF) + (sum >> 16);
-	/* Set the computed checksum into TCP header */
-	pkt->cksum = (u16)(~sum);
+	pkt->cksum = htons(ip_tx_cksum(netif, IP_PROTO_TCP, (u8 *)pkt, hlen + len));
 
 	/* Call underlying IP layer to send the packet */
-	ipv4_send(netif, len + sizeof(tcp_packet));
+	ip_tx_send(netif, len + sizeof(tcp_packet));
+	netif->stats.tcp_tx++;
 
 	/* Reset rsp pointer after sending packet */
 	conn->rsp = 0;
-	/* Update sequence number */
-	conn->seq_local += len;
 }
 
 /**
@@ -662,11 +1407,12 @@ u8 *tcp4_tx_buffer(tcp_conn *conn)
 }
 
 /**
- * @brief Test if TX buffer is ready for new packet, and wait if not empty
+ * @brief Test if TX buffer is still used by a previous packet
  *
  * @param conn Pointer to the TCP connection
+ * @return integer Non-zero if the buffer is not free
  */
-static void tcp4_tx_wait(tcp_conn *conn)
+static int tcp4_tx_busy(tcp_conn *conn)
 {
 	network  *netif = conn->netif;
 	volatile eth_frame *eth;
@@ -678,8 +1424,35 @@ static void tcp4_tx_wait(tcp_conn *conn)
 	eth   = (eth_frame *)(dgram - 14);
 
 	/* Field 'proto' is cleared by USB ECM when frame sent */
-	while (eth->proto != 0x0000)
-		;
+	return(eth->proto != 0x0000);
+}
+
+/**
+ * @brief Test if TX buffer is ready for new packet, and wait if not empty
+ *
+ * The wait is limited to TCP_TX_TIMEOUT ms (ex: host stops reading the bulk
+ * endpoint) : the previous frame is then considered as lost and the buffer
+ * is released, TCP retransmission recovers the datas.
+ *
+ * @param conn Pointer to the TCP connection
+ */
+static void tcp4_tx_wait(tcp_conn *conn)
+{
+	u32 start;
+
+	if ( ! tcp4_tx_busy(conn))
+		return;
+
+	start = timer_now();
+	while (tcp4_tx_busy(conn))
+	{
+		if ((timer_now() - start) >= TCP_TX_TIMEOUT)
+		{
+			conn->netif->stats.tx_err++;
+			((eth_frame *)conn->netif->tx_buffer)->proto = 0x0000;
+			break;
+		}
+	}
 }
 
 /* ------------------------------------------------------------------------- */
@@ -687,35 +1460,248 @@ static void tcp4_tx_wait(tcp_conn *conn)
 /* ------------------------------------------------------------------------- */
 
 /**
- * @brief Called by IPv4 layer when an UDP packet is received
+ * @brief Bind a socket to a local port
  *
- * @param pkt Pointer to the received UDP packet
+ * Datagrams received on this port are given to the 'recv' callback of the
+ * socket or, if there is no callback, copied into its receive queue. The
+ * socket fields 'recv', 'queue', 'queue_slot' and 'queue_count' must be set
+ * before this call.
  *
+ * @param mod  Pointer to the network interface structure
+ * @param sock Pointer to the socket structure
+ * @param port Local port (host byte order)
+ * @return integer Zero on success, -1 if port is used or table is full
  */
-static void udp4_receive(network *mod, udp_packet *pkt, ip_dgram *ip)
+int udp4_bind(network *mod, udp_socket *sock, u16 port)
 {
-	if (htons(pkt->dst_port) == 0x43)
-		dhcp_recv(mod, pkt, ip);
-#ifdef NET_UDP_DEBUG
+	int slot = -1;
+	int i;
+
+	if (port == 0)
+		return(-1);
+	for (i = 0; i < NET_UDP_SOCKETS; i++)
+	{
+		if (mod->udp.ports[i] == port)
+			return(-1);
+		if ((slot < 0) && (mod->udp.ports[i] == 0))
+			slot = i;
+	}
+	if (slot < 0)
+		return(-1);
+
+	sock->port       = port;
+	sock->netif      = mod;
+	sock->queue_head = 0;
+	sock->queue_tail = 0;
+	sock->queue_used = 0;
+	sock->drops      = 0;
+	mod->udp.socks[slot] = sock;
+	mod->udp.ports[slot] = port;
+	return(0);
+}
+
+/**
+ * @brief Release the port of a socket
+ *
+ * @param sock Pointer to the socket structure
+ */
+void udp4_unbind(udp_socket *sock)
+{
+	network *mod = sock->netif;
+	int i;
+
+	if (mod == 0)
+		return;
+	for (i = 0; i < NET_UDP_SOCKETS; i++)
+	{
+		if (mod->udp.socks[i] != sock)
+			continue;
+		mod->udp.ports[i] = 0;
+		mod->udp.socks[i] = 0;
+	}
+	sock->netif = 0;
+}
+
+/**
+ * @brief Called by IP layer when an UDP packet is received
+ *
+ * @param mod Pointer to the network interface structure
+ * @param pkt Pointer to the received UDP packet
+ * @param ip  Pointer to the received IPv4 datagram (0 for IPv6)
+ * @param len Size of the IP payload (UDP header and datas)
+ */
+void udp4_receive(network *mod, udp_packet *pkt, ip_dgram *ip, int len)
+{
+	udp_socket *sock;
+	u16 port;
+	int i;
+
+	mod->stats.udp_rx++;
+
+	/* UDP length must cover the header and be into the IP payload */
+	if ((len < 8) || (htons(pkt->length) < 8) || (htons(pkt->length) > len))
+	{
+		mod->stats.udp_err++;
+		return;
+	}
+	len = htons(pkt->length) - 8;
+
+	/* Search the socket bound to the destination port (0 is never bound) */
+	port = htons(pkt->dst_port);
+	i = NET_UDP_SOCKETS;
+	if (port != 0)
+	{
+		for (i = 0; i < NET_UDP_SOCKETS; i++)
+			if (mod->udp.ports[i] == port)
+				break;
+	}
+
+	if (i < NET_UDP_SOCKETS)
+	{
+		sock = mod->udp.socks[i];
+		if (sock->recv)
+			sock->recv(sock, pkt, ip, len);
+		else
+			udp4_enqueue(sock, pkt, len);
+	}
 	else
 	{
+		mod->stats.udp_noport++;
+#ifdef NET_UDP_DEBUG
 		int i;
 
-		uart_puts("UDP");
-		uart_puts(" src_port="); uart_puthex16( htons(pkt->src_port) );
-		uart_puts(" dst_port="); uart_puthex16( htons(pkt->dst_port) );
-		uart_crlf();
-		i = ip->length;
+		LOG2("UDP src_port=%04X dst_port=%04X\r\n",
+		     htons(pkt->src_port), htons(pkt->dst_port));
+		i = 8 + len;
 		if (i > 32)
 			i = 32;
 		uart_dump((u8 *)pkt, i);
+#endif
+	}
+}
+
+/**
+ * @brief Copy a received datagram into the queue of a socket
+ *
+ * @param sock Pointer to the socket structure
+ * @param pkt  Pointer to the received UDP packet
+ * @param len  Size of the datas (checked by udp4_receive)
+ */
+static void udp4_enqueue(udp_socket *sock, udp_packet *pkt, int len)
+{
+	udp_qhdr *hdr;
+
+	if ((sock->queue == 0) || (sock->queue_used == sock->queue_count) ||
+	    ((sizeof(udp_qhdr) + len) > sock->queue_slot))
+	{
+		sock->drops++;
+		return;
+	}
+	hdr = (udp_qhdr *)(sock->queue + (sock->queue_head * sock->queue_slot));
+	udp4_reply_init(sock->netif, &hdr->from, pkt);
+	hdr->length = len;
+	memcpy(hdr + 1, ((u8 *)pkt) + 8, len);
+
+	if (++sock->queue_head == sock->queue_count)
+		sock->queue_head = 0;
+	sock->queue_used++;
+}
+
+/**
+ * @brief Get the oldest datagram of the receive queue of a socket
+ *
+ * @param sock   Pointer to the socket structure
+ * @param from   Pointer to a connection set with the sender (optional), can
+ *               be used to reply with udp4_sendto()
+ * @param buffer Pointer to a buffer where datas are copied
+ * @param len    Size of the buffer, larger datagrams are truncated
+ * @return integer Number of bytes copied, or -1 if the queue is empty
+ */
+int udp4_recvfrom(udp_socket *sock, udp_conn *from, u8 *buffer, int len)
+{
+	udp_qhdr *hdr;
+
+	if (sock->queue_used == 0)
+		return(-1);
+
+	hdr = (udp_qhdr *)(sock->queue + (sock->queue_tail * sock->queue_slot));
+	if (len > hdr->length)
+		len = hdr->length;
+	memcpy(buffer, hdr + 1, len);
+	if (from)
+		memcpy(from, &hdr->from, sizeof(udp_conn));
+
+	if (++sock->queue_tail == sock->queue_count)
+		sock->queue_tail = 0;
+	sock->queue_used--;
+	return(len);
+}
+
+/**
+ * @brief Send a datagram from a socket
+ *
+ * Datas are copied into the TX buffer, the caller does not have to prepare
+ * the connection (only family, address and remote port are used).
+ *
+ * @param sock Pointer to the socket structure (gives the local port)
+ * @param to   Pointer to the destination (ex: from udp4_recvfrom)
+ * @param data Pointer to the datas to send
+ * @param len  Number of bytes to send (up to UDP_DATA_MAX)
+ * @return integer Number of bytes sent, or -1 if TX buffer is used
+ */
+int udp4_sendto(udp_socket *sock, udp_conn *to, const u8 *data, int len)
+{
+	network  *mod = sock->netif;
+	eth_frame *eth;
+	udp_conn  conn;
+	u8 *buffer;
+
+	if ((mod == 0) || (len > UDP_DATA_MAX))
+		return(-1);
+	/* TX buffer must be free (proto is cleared when frame sent) */
+	eth = (eth_frame *)mod->tx_buffer;
+	if (eth->proto != 0x0000)
+		return(-1);
+
+	memcpy(&conn, to, sizeof(udp_conn));
+	conn.port_local = htons(sock->port);
+	conn.rsp = 0;
+	buffer = udp4_tx_buffer(mod, &conn);
+	memcpy(buffer, data, len);
+	udp4_send(mod, &conn, len);
+	return(len);
+}
+
+/**
+ * @brief Initialize a connection to reply to a received UDP packet
+ *
+ * @param mod  Pointer to the network interface structure
+ * @param conn Pointer to the UDP connection structure to initialize
+ * @param req  Pointer to the received UDP packet
+ */
+void udp4_reply_init(network *mod, udp_conn *conn, udp_packet *req)
+{
+	u8 *dgram = mod->rx_buffer + 14;
+
+	conn->family = (dgram[0] >> 4);
+#ifdef USE_IPV6
+	if (conn->family == NET_AF_INET6)
+	{
+		conn->ip_remote = 0xFFFFFFFF;
+		memcpy(conn->ip6_remote, ((ip6_dgram *)dgram)->src, 16);
 	}
+	else
 #endif
+	conn->ip_remote   = htonl(((ip_dgram *)dgram)->src);
+	conn->port_local  = req->dst_port;
+	conn->port_remote = req->src_port;
+	conn->rsp = 0;
 }
 
 /**
  * @brief Transmit an UDP packet
  *
+ * @param mod  Pointer to the network interface structure
  * @param conn Pointer to the UDP connection structure
  * @param len  Size of the packet to send (in bytes)
  */
@@ -725,9 +1711,16 @@ void udp4_send(network *mod, udp_conn *conn, int len)
 	udp_packet *pkt = (udp_packet *)conn->rsp;
 	pkt->length = htons(8 + len);
 	pkt->cksum  = 0;
+	/* Checksum is optional for IPv4, but mandatory for IPv6 */
+	if (conn->family == NET_AF_INET6)
+	{
+		u16 cksum = ip_tx_cksum(mod, IP_PROTO_UDP, (u8 *)pkt, 8 + len);
+		pkt->cksum = htons(cksum ? cksum : 0xFFFF);
+	}
 
 	/* Call underlying IP layer to send the packet */
-	ipv4_send(mod, len + sizeof(udp_packet));
+	ip_tx_send(mod, len + sizeof(udp_packet));
+	mod->stats.udp_tx++;
 }
 
 /**
@@ -745,7 +1738,13 @@ u8 *udp4_tx_buffer(network *mod, udp_conn *conn)
 		rsp = conn->rsp;
 	else
 	{
-		rsp = (udp_packet *)ipv4_tx_buffer(mod, conn->ip_remote, 0x11);
+#ifdef USE_IPV6
+		if (conn->family == NET_AF_INET6)
+			rsp = (udp_packet *)ipv6_tx_buffer(mod, conn->ip6_remote,
+			                                   IP_PROTO_UDP);
+		else
+#endif
+		rsp = (udp_packet *)ipv4_tx_buffer(mod, conn->ip_remote, IP_PROTO_UDP);
 		rsp->src_port = conn->port_local;
 		rsp->dst_port = conn->port_remote;
 		conn->rsp = rsp;
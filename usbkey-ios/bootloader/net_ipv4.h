@@ -16,10 +16,11 @@
 #ifndef NET_IPV4_H
 #define NET_IPV4_H
 #include "log.h"
+#include "timer.h"
 #include "types.h"
 
 #ifdef DEBUG_NET
-#define NET_PUTS(c) DBG_PUTS(x)
+#define NET_PUTS(x) DBG_PUTS(x)
 #else
 #define NET_PUTS(x) {}
 #endif
@@ -44,13 +45,39 @@ typedef struct __attribute__((packed))
 	u8  data;
 } ip_dgram;
 
+/* -------------------------------------------------------------------------- */
+/*                                   ICMP                                     */
+/* -------------------------------------------------------------------------- */
+
+#define ICMP_ECHO_REPLY   0
+#define ICMP_ECHO_REQUEST 8
+
+/* Echo rate limiter : one token every ICMP_INTERVAL ms, up to ICMP_BURST */
+#ifndef ICMP_INTERVAL
+#define ICMP_INTERVAL 20
+#endif
+#ifndef ICMP_BURST
+#define ICMP_BURST     8
+#endif
+
+typedef struct __attribute__((packed))
+{
+	u8  type;
+	u8  code;
+	u16 cksum;
+	u16 id;
+	u16 seq;
+} icmp_packet;
+
 struct _network;
 
 u16  ip_cksum(u32 sum, const u8 *data, u16 len);
+u16  ip_cksum_adjust(u16 cksum, u16 old, u16 new);
 void ipv4_init(struct _network *mod);
 void ipv4_receive(struct _network *mod, u8 *buffer, int length);
 void ipv4_send(network *mod, int len);
 u8  *ipv4_tx_buffer(network *mod, u32 dest, u8 proto);
+int  icmp_allow(network *mod);
 
 /* -------------------------------------------------------------------------- */
 /*                                    TCP                                     */
@@ -81,15 +108,77 @@ typedef struct __attribute__((packed))
 #define TCP_CONN_CLOSE_WAIT  3
 #define TCP_CONN_FIN_WAIT_1  4
 #define TCP_CONN_CLOSING     5
+#define TCP_CONN_SYN_SENT    6
+
+/* Max size of the datas of one segment (IPv6 header into 512 bytes) */
+#define TCP_DATA_MAX (512 - 14 - 40 - 20)
+
+/* Memory used to keep unacknowledged datas, shared by the connections */
+/* (TCP_RTX_SIZE bytes each while the budget allows, 0 to disable)      */
+#ifndef TCP_RTX_BUDGET
+#define TCP_RTX_BUDGET 1024
+#endif
+#ifndef TCP_RTX_SIZE
+#define TCP_RTX_SIZE   512
+#endif
+/* Retransmission timeout : initial value and limits (ms) */
+#ifndef TCP_RTO_INIT
+#define TCP_RTO_INIT 1000
+#endif
+#ifndef TCP_RTO_MIN
+#define TCP_RTO_MIN  200
+#endif
+#ifndef TCP_RTO_MAX
+#define TCP_RTO_MAX  8000
+#endif
+/* Number of timeouts before the connection is dropped */
+#ifndef TCP_RTX_RETRIES
+#define TCP_RTX_RETRIES 6
+#endif
+/* Number of duplicate ACKs that trigger a fast retransmit */
+#define TCP_DUPACK_THRESHOLD 3
+/* Max time to wait for the TX buffer before the previous frame is lost (ms) */
+#ifndef TCP_TX_TIMEOUT
+#define TCP_TX_TIMEOUT 100
+#endif
+/* Delay before a new try when the TX buffer is busy at timeout (ms) */
+#ifndef TCP_RTX_DEFER
+#define TCP_RTX_DEFER 10
+#endif
+
+/* Range of local ports used by active open (tcp4_connect), at least */
+/* 4096 ports because the first one is random (see tcp4_port)         */
+#ifndef TCP_PORT_FIRST
+#define TCP_PORT_FIRST 49152
+#endif
+#ifndef TCP_PORT_LAST
+#define TCP_PORT_LAST  65535
+#endif
 
 typedef struct _tcp_conn
 {
-	u32 ip_remote;
+	u32 ip_remote;  /* Address of the peer (0xFFFFFFFF for IPv6), 0 if free */
+	u8  family;     /* NET_AF_INET or NET_AF_INET6                         */
+	u8  ip6_remote[16];
 	u16 port_local;
 	u16 port_remote;
 	u32 seq_local;
 	u32 seq_remote;
+	u32 seq_acked;  /* Last ACK value received from remote */
 	u8  state;
+	/* Retransmission : copy of datas from seq_acked (see TCP_RTX_BUDGET) */
+	u8 *rtx_buf;    /* 0 if the connection has no retransmit buffer */
+	u16 rtx_len;
+	u8  rtx_count;  /* Timeouts for the oldest segment              */
+	u8  dupacks;    /* Duplicate ACKs received for seq_acked        */
+	u16 srtt;       /* Smoothed RTT (ms x 8), 0 before first sample */
+	u16 rttvar;     /* RTT variation (ms x 4)                       */
+	u16 rto;        /* Retransmission timeout (ms)                  */
+	u8  rtt_timing; /* True when a segment is timed (Karn)          */
+	u8  rtx_fin;    /* FIN sent (seq_local - 1), not acknowledged   */
+	u32 rtt_seq;    /* Sequence number that ends the timed segment  */
+	u32 rtt_start;  /* Time (ms) when the timed segment was sent    */
+	timer rtx_tmr;
 	tcp_packet *req;
 	tcp_packet *rsp;
 	struct _network  *netif;
@@ -102,7 +191,9 @@ typedef struct _tcp_conn
 
 typedef struct _tcp_service
 {
-	u16   port;
+	u16   port;       /* Local port, or remote port for tcp4_connect     */
+	const char *name; /* DNS-SD service type (without '_'), 0 to hide */
+	/* Called when a connection is established (passive or active open) */
 	int (*accept) (tcp_conn *conn);
 	int (*closed) (tcp_conn *conn);
 	int (*process)(tcp_conn *conn, u8 *data, int len);
@@ -110,6 +201,9 @@ typedef struct _tcp_service
 } tcp_service;
 
 void tcp4_close(tcp_conn *conn);
+tcp_conn *tcp4_connect(network *netif, u8 family, const void *addr,
+                       tcp_service *service);
+void tcp4_receive(network *netif, tcp_packet *pkt, int len);
 void tcp4_send (tcp_conn *conn, int len);
 u8  *tcp4_tx_buffer(tcp_conn *conn);
 
@@ -125,15 +219,54 @@ typedef struct __attribute__((packed))
 	u16 cksum;
 } udp_packet;
 
+/* Max size of the datas of a datagram sent with udp4_sendto() */
+#ifndef UDP_DATA_MAX
+#define UDP_DATA_MAX (512 - 14 - 40 - 8)
+#endif
+
 typedef struct _udp_conn
 {
 	u32 ip_remote;
+	u8  family;     /* NET_AF_INET or NET_AF_INET6 */
+	u8  ip6_remote[16];
 	u16 port_local;
 	u16 port_remote;
 	udp_packet *rsp;
 } udp_conn;
 
-void udp4_send(network *mod, udp_conn *conn, int len);
+typedef struct _udp_socket
+{
+	u16   port;        /* Local port (host order), set by udp4_bind */
+	/* Called when a datagram is received, or 0 to use the queue. The  */
+	/* length of the datas (after UDP header) has been checked (ABI 1.3) */
+	void (*recv)(struct _udp_socket *sock, udp_packet *pkt, ip_dgram *ip,
+	             int len);
+	/* Receive queue : queue_count slots of queue_slot bytes (optional) */
+	u8   *queue;
+	u16   queue_slot;
+	u8    queue_count;
+	u8    queue_head;
+	u8    queue_tail;
+	u8    queue_used;
+	u32   drops;       /* Datagrams dropped (queue full or too large)  */
+	struct _network *netif;
+	void *priv;
+} udp_socket;
+
+/* Header of a datagram into the receive queue of a socket */
+typedef struct
+{
+	udp_conn from;     /* Sender of the datagram (see udp4_recvfrom) */
+	u16      length;   /* Size of the datas, after this header       */
+} udp_qhdr;
+
+int  udp4_bind    (network *mod, udp_socket *sock, u16 port);
+void udp4_receive (network *mod, udp_packet *pkt, ip_dgram *ip, int len);
+int  udp4_recvfrom(udp_socket *sock, udp_conn *from, u8 *buffer, int len);
+void udp4_reply_init(network *mod, udp_conn *conn, udp_packet *req);
+void udp4_send    (network *mod, udp_conn *conn, int len);
+int  udp4_sendto  (udp_socket *sock, udp_conn *to, const u8 *data, int len);
 u8  *udp4_tx_buffer(network *mod, udp_conn *conn);
+void udp4_unbind  (udp_socket *sock);
 
 #endif
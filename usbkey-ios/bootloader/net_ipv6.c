@@ -0,0 +1,402 @@
+/**
+ * @file  net_ipv6.c
+ * @brief Implement IPv6 network protocol (link-local only)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "libc.h"
+#include "net.h"
+#include "net_ipv4.h"
+#include "net_ipv6.h"
+#include "net_mdns.h"
+#include "types.h"
+
+#ifdef USE_IPV6
+static void icmp6_receive(network *mod, ip6_dgram *ip);
+static void icmp6_neigh_advert(network *mod, ip6_dgram *req);
+static int  ipv6_mcast_match(network *mod, const u8 *addr);
+static void neigh_learn(const u8 *ip, const u8 *mac);
+
+/* Neighbor cache, entries are replaced in round-robin */
+static ip6_neigh neigh_cache[IPV6_NEIGH_SIZE];
+static int       neigh_next;
+
+/* All-nodes multicast address (ff02::1) */
+static const u8 ip6_all_nodes[16] =
+	{0xFF,0x02, 0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0,0x01};
+
+/**
+ * @brief Initialize the IPv6 module
+ *
+ * The link-local address (fe80::/64) is made from the MAC address of the
+ * interface (modified EUI-64), so it must be set before this call.
+ *
+ * @param mod Pointer to the network interface structure
+ */
+void ipv6_init(network *mod)
+{
+	u8 *addr = mod->ip6_local;
+
+	memset(addr, 0, 16);
+	addr[0]  = 0xFE;
+	addr[1]  = 0x80;
+	addr[8]  = mod->mac[0] ^ 0x02; /* Universal/local bit */
+	addr[9]  = mod->mac[1];
+	addr[10] = mod->mac[2];
+	addr[11] = 0xFF;
+	addr[12] = 0xFE;
+	addr[13] = mod->mac[3];
+	addr[14] = mod->mac[4];
+	addr[15] = mod->mac[5];
+
+	memset(neigh_cache, 0, sizeof(neigh_cache));
+	neigh_next = 0;
+}
+
+/**
+ * @brief Test if a received IPv6 datagram can be processed (from interrupt)
+ *
+ * @param mod  Pointer to the network interface structure
+ * @param data Pointer to the datagram (after ethernet header)
+ * @param plen Pointer to the frame length, updated if padding is removed
+ * @return integer NET_FLOW_IPV6 or drop reason (NET_DROP_x)
+ */
+int ipv6_rx_filter(network *mod, u8 *data, int *plen)
+{
+	ip6_dgram *ip = (ip6_dgram *)data;
+	int len;
+
+	if (*plen < (14 + 40 + 8))
+		return(NET_DROP_RUNT);
+	if ((data[0] >> 4) != 6)
+		return(NET_DROP_PROTO);
+	len = 14 + 40 + htons(ip->length);
+	if (len > *plen)
+		return(NET_DROP_RUNT);
+	/* Remove ethernet padding (if any) */
+	if (len < *plen)
+		*plen = len;
+
+	/* Unicast to our link-local address */
+	if (memcmp(ip->dst, mod->ip6_local, 16) == 0)
+	{
+		if ((ip->next == IP_PROTO_ICMPV6) || (ip->next == IP_PROTO_TCP) ||
+		    (ip->next == IP_PROTO_UDP))
+			return(NET_FLOW_IPV6);
+		return(NET_DROP_PROTO);
+	}
+	/* Multicast is only used for neighbor discovery and echo */
+	if (ipv6_mcast_match(mod, ip->dst))
+	{
+		if (ip->next == IP_PROTO_ICMPV6)
+			return(NET_FLOW_IPV6);
+		return(NET_DROP_PROTO);
+	}
+#ifdef USE_MDNS
+	/* mDNS group (ff02::fb) */
+	if (memcmp(ip->dst, mdns_ip6, 16) == 0)
+	{
+		udp_packet *udp = (udp_packet *)(data + 40);
+		if ((ip->next == IP_PROTO_UDP) && (udp->dst_port == htons(MDNS_PORT)))
+			return(NET_FLOW_IPV6);
+		return(NET_DROP_PROTO);
+	}
+#endif
+	return(NET_DROP_ADDR);
+}
+
+/**
+ * @brief Called by network layer when an IPv6 datagram is received
+ *
+ * TCP and UDP are processed by the same functions than IPv4, they use the
+ * version of the received datagram to select the protocol for responses.
+ *
+ * @param mod    Pointer to the network interface structure
+ * @param buffer Pointer to the received datagram
+ * @param length Size of the received datagram (in bytes)
+ */
+void ipv6_receive(network *mod, u8 *buffer, int length)
+{
+	ip6_dgram *ip = (ip6_dgram *)buffer;
+	int plen;
+
+	/* Payload length must be into the received datagram */
+	plen = htons(ip->length);
+	if ((length < 40) || (plen > (length - 40)))
+	{
+		mod->stats.ip6_drop++;
+		return;
+	}
+
+	/* Save MAC address of the sender (if it has an address) */
+	if (ip->src[0] == 0xFE)
+		neigh_learn(ip->src, mod->rx_buffer + 6);
+
+	switch (ip->next)
+	{
+		case IP_PROTO_ICMPV6:
+			icmp6_receive(mod, ip);
+			break;
+		case IP_PROTO_TCP:
+			tcp4_receive(mod, (tcp_packet *)(buffer + 40), plen);
+			break;
+		case IP_PROTO_UDP:
+			udp4_receive(mod, (udp_packet *)(buffer + 40), 0, plen);
+			break;
+		default:
+			mod->stats.ip6_drop++;
+			break;
+	}
+}
+
+/**
+ * @brief Transmit an IPv6 datagram
+ *
+ * The destination MAC address is made from multicast addresses, or taken
+ * from the neighbor cache. Datagrams for an unknown neighbor are dropped
+ * (only responses are sent, the peer is always into the cache).
+ *
+ * @param mod Pointer to the network interface structure
+ * @param len Size of the payload (in bytes)
+ */
+void ipv6_send(network *mod, int len)
+{
+	eth_frame *frame = (eth_frame *)mod->tx_buffer;
+	ip6_dgram *rsp;
+	int i;
+
+	rsp = (ip6_dgram *)net_tx_buffer(mod, 0);
+	rsp->length = htons(len);
+
+	if (rsp->dst[0] == 0xFF)
+	{
+		frame->dst[0] = 0x33;
+		frame->dst[1] = 0x33;
+		memcpy(frame->dst + 2, rsp->dst + 12, 4);
+	}
+	else
+	{
+		for (i = 0; i < IPV6_NEIGH_SIZE; i++)
+			if (memcmp(neigh_cache[i].ip, rsp->dst, 16) == 0)
+				break;
+		if (i == IPV6_NEIGH_SIZE)
+		{
+			mod->stats.ip6_drop++;
+			/* Release TX buffer */
+			frame->proto = 0x0000;
+			return;
+		}
+		memcpy(frame->dst, neigh_cache[i].mac, 6);
+	}
+	net_send(mod, len + 40);
+	mod->stats.ip6_tx++;
+}
+
+/**
+ * @brief Get a pointer on a buffer that can be used to transmit a datagram
+ *
+ * @param mod  Pointer to the network interface structure
+ * @param dest IPv6 address of the remote peer
+ * @param next ID of the protocol used inside the datagram
+ * @return Pointer to the payload of the datagram
+ */
+u8 *ipv6_tx_buffer(network *mod, const u8 *dest, u8 next)
+{
+	ip6_dgram *rsp;
+
+	rsp = (ip6_dgram *)net_tx_buffer(mod, 0x86DD);
+	if (rsp == 0)
+		return(0);
+
+	rsp->vtcfl  = htonl(0x60000000);
+	rsp->length = 0x0000;
+	rsp->next   = next;
+	rsp->hop    = IPV6_HOP_LIMIT;
+	memcpy(rsp->src, mod->ip6_local, 16);
+	memcpy(rsp->dst, dest, 16);
+
+	return(((u8 *)rsp) + 40);
+}
+
+/**
+ * @brief Compute the sum of the payload of an IPv6 datagram
+ *
+ * The pseudo-header (addresses, length and next header) is included. For
+ * a received datagram with a valid checksum, the result is 0xFFFF.
+ *
+ * @param ip  Pointer to the IPv6 datagram
+ * @param len Size of the payload (in bytes)
+ * @return Sum in host byte order (not inverted)
+ */
+u16 ip6_cksum(ip6_dgram *ip, u16 len)
+{
+	u32 sum;
+
+	sum  = ip_cksum(0, ip->src, 32);
+	sum += ip->next + len;
+	return(ip_cksum(sum, ((u8 *)ip) + 40, len));
+}
+
+/**
+ * @brief Process a received ICMPv6 message
+ *
+ * Echo requests are answered in place (see icmp4_receive), neighbor
+ * solicitations for our address are answered with an advertisement. Other
+ * messages (router discovery, MLD) are ignored.
+ *
+ * @param mod Pointer to the network interface structure
+ * @param ip  Pointer to the received datagram
+ */
+static void icmp6_receive(network *mod, ip6_dgram *ip)
+{
+	icmp_packet *pkt = (icmp_packet *)((u8 *)ip + 40);
+	u16 len = htons(ip->length);
+	u8  addr[16];
+
+	if ((len < 8) || (ip6_cksum(ip, len) != 0xFFFF))
+	{
+		mod->stats.ip6_drop++;
+		return;
+	}
+
+	switch (pkt->type)
+	{
+		case ICMP6_ECHO_REQUEST:
+			/* Echo to multicast addresses are not answered */
+			if (ip->dst[0] == 0xFF)
+				break;
+			mod->stats.icmp_rx++;
+			/* Reply is sent in place : drop if driver is busy */
+			if (net_tx_busy(mod))
+			{
+				mod->stats.tx_err++;
+				break;
+			}
+			if ( ! icmp_allow(mod))
+				break;
+			pkt->type  = ICMP6_ECHO_REPLY;
+			pkt->cksum = htons(ip_cksum_adjust(htons(pkt->cksum),
+			                   (ICMP6_ECHO_REQUEST << 8), (ICMP6_ECHO_REPLY << 8)));
+			/* Swap addresses (pseudo-header sum is not modified) */
+			memcpy(addr,    ip->src, 16);
+			memcpy(ip->src, ip->dst, 16);
+			memcpy(ip->dst, addr,    16);
+			ip->hop = IPV6_HOP_LIMIT;
+
+			net_send_rx(mod, 40 + len);
+			mod->stats.ip6_tx++;
+			mod->stats.icmp_tx++;
+			break;
+		case ICMP6_NEIGH_SOLICIT:
+			icmp6_neigh_advert(mod, ip);
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * @brief Answer a neighbor solicitation for our address
+ *
+ * @param mod Pointer to the network interface structure
+ * @param req Pointer to the received datagram
+ */
+static void icmp6_neigh_advert(network *mod, ip6_dgram *req)
+{
+	u8 *target = ((u8 *)req) + 40 + 8;
+	ip6_dgram *ip;
+	u8 *rsp;
+	u16 cksum;
+
+	/* Must come from the link (hop limit not decremented) */
+	if ((req->hop != 255) || (htons(req->length) < 24))
+		return;
+	if (memcmp(target, mod->ip6_local, 16) != 0)
+		return;
+	/* Duplicate address detection of another node, ignored */
+	if (req->src[0] == 0x00)
+		return;
+
+	rsp = ipv6_tx_buffer(mod, req->src, IP_PROTO_ICMPV6);
+	ip  = (ip6_dgram *)(rsp - 40);
+	ip->hop = 255;
+	rsp[0] = ICMP6_NEIGH_ADVERT;
+	rsp[1] = 0;
+	rsp[2] = 0;
+	rsp[3] = 0;
+	rsp[4] = 0x60; /* Solicited and Override flags */
+	rsp[5] = 0;
+	rsp[6] = 0;
+	rsp[7] = 0;
+	memcpy(rsp + 8, mod->ip6_local, 16);
+	/* Option : target link-layer address */
+	rsp[24] = 2;
+	rsp[25] = 1;
+	memcpy(rsp + 26, mod->mac, 6);
+
+	ip->length = htons(32);
+	cksum  = ~ip6_cksum(ip, 32);
+	rsp[2] = (cksum >> 8);
+	rsp[3] = (cksum & 0xFF);
+
+	ipv6_send(mod, 32);
+}
+
+/**
+ * @brief Test if a multicast address is for this interface
+ *
+ * @param mod  Pointer to the network interface structure
+ * @param addr Pointer to the IPv6 destination address
+ * @return integer True for all-nodes or our solicited-node address
+ */
+static int ipv6_mcast_match(network *mod, const u8 *addr)
+{
+	int i;
+
+	if (memcmp(addr, ip6_all_nodes, 16) == 0)
+		return(1);
+	/* Solicited-node : ff02::1:ffXX:XXXX with 24 low bits of our address */
+	for (i = 0; i < 13; i++)
+	{
+		u8 v = (i == 11) ? 0x01 : (i == 12) ? 0xFF : ip6_all_nodes[i];
+		if (addr[i] != v)
+			return(0);
+	}
+	return(memcmp(addr + 13, mod->ip6_local + 13, 3) == 0);
+}
+
+/**
+ * @brief Save the MAC address of a neighbor into the cache
+ *
+ * @param ip  Pointer to the IPv6 address of the neighbor
+ * @param mac Pointer to the MAC address of the neighbor
+ */
+static void neigh_learn(const u8 *ip, const u8 *mac)
+{
+	ip6_neigh *entry;
+	int i;
+
+	for (i = 0; i < IPV6_NEIGH_SIZE; i++)
+		if (memcmp(neigh_cache[i].ip, ip, 16) == 0)
+			break;
+	if (i == IPV6_NEIGH_SIZE)
+	{
+		i = neigh_next;
+		if (++neigh_next == IPV6_NEIGH_SIZE)
+			neigh_next = 0;
+	}
+	entry = &neigh_cache[i];
+	memcpy(entry->ip,  ip,  16);
+	memcpy(entry->mac, mac, 6);
+}
+#endif
+/* EOF */
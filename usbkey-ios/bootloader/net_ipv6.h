@@ -0,0 +1,60 @@
+/**
+ * @file  net_ipv6.h
+ * @brief Definitions and prototypes for IPv6 network protocol (link-local)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef NET_IPV6_H
+#define NET_IPV6_H
+#include "net.h"
+#include "types.h"
+
+/* Number of entries into the neighbor cache */
+#ifndef IPV6_NEIGH_SIZE
+#define IPV6_NEIGH_SIZE 4
+#endif
+/* Hop limit of sent datagrams */
+#ifndef IPV6_HOP_LIMIT
+#define IPV6_HOP_LIMIT 64
+#endif
+
+#define IP_PROTO_ICMPV6 58
+
+#define ICMP6_ECHO_REQUEST  128
+#define ICMP6_ECHO_REPLY    129
+#define ICMP6_NEIGH_SOLICIT 135
+#define ICMP6_NEIGH_ADVERT  136
+
+typedef struct __attribute__((packed))
+{
+	u32 vtcfl;  /* Version, traffic class and flow label */
+	u16 length; /* Payload length                        */
+	u8  next;   /* Next header (upper layer protocol)    */
+	u8  hop;    /* Hop limit                             */
+	u8  src[16];
+	u8  dst[16];
+} ip6_dgram;
+
+typedef struct
+{
+	u8  ip[16]; /* Link-local address, first byte is 0 if entry is free */
+	u8  mac[6];
+} ip6_neigh;
+
+u16  ip6_cksum(ip6_dgram *ip, u16 len);
+void ipv6_init(network *mod);
+void ipv6_receive(network *mod, u8 *buffer, int length);
+int  ipv6_rx_filter(network *mod, u8 *data, int *plen);
+void ipv6_send(network *mod, int len);
+u8  *ipv6_tx_buffer(network *mod, const u8 *dest, u8 next);
+
+#endif
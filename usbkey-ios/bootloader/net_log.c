@@ -0,0 +1,135 @@
+/**
+ * @file  net_log.c
+ * @brief Send binary log records to the host into UDP datagrams
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "log.h"
+#include "net.h"
+#include "net_ipv4.h"
+#include "net_log.h"
+#include "timer.h"
+
+#ifdef USE_NET_LOG
+#ifndef USE_LOG_BIN
+#error "UDP log sink (USE_NET_LOG) needs binary log records (USE_LOG_BIN)"
+#endif
+
+static u32 netlog_seq;   /* Sequence number of the next datagram   */
+static u32 netlog_first; /* Time when pending records was detected */
+static u32 netlog_last;  /* Time when last datagram has been sent  */
+static int netlog_wait;  /* True when records are waiting          */
+static udp_socket netlog_sock; /* Only used to reserve the local port */
+#endif
+
+/**
+ * @brief Initialize the UDP log sink
+ *
+ * @param netif Pointer to the network interface structure
+ */
+void netlog_init(network *netif)
+{
+#ifdef USE_NET_LOG
+	netlog_seq   = 0;
+	netlog_first = 0;
+	netlog_last  = 0;
+	netlog_wait  = 0;
+	/* Received datagrams are ignored (no callback, no queue) */
+	netlog_sock.recv  = 0;
+	netlog_sock.queue = 0;
+	netlog_sock.netif = 0;
+	udp4_bind(netif, &netlog_sock, CFG_NETLOG_PORT);
+#else
+	(void)netif;
+#endif
+}
+
+/**
+ * @brief Send pending log records (if any) to the host
+ *
+ * This function must be called periodically (from main loop). Records are
+ * coalesced : a datagram is sent when NETLOG_MAX bytes are pending or when
+ * the oldest record has waited NETLOG_DELAY ms. Nothing is sent while the
+ * network stack has work to do (TX buffer used, RX frame pending) so the
+ * sink never delays the processing of incoming packets.
+ *
+ * @param netif Pointer to the network interface structure
+ */
+void netlog_periodic(network *netif)
+{
+#ifdef USE_NET_LOG
+	volatile eth_frame *eth;
+	udp_conn conn;
+	u32 now;
+	u8 *data;
+	int len;
+
+	len = log_pending();
+	if (len == 0)
+	{
+		netlog_wait = 0;
+		return;
+	}
+	now = timer_now();
+	if ( ! netlog_wait)
+	{
+		netlog_first = now;
+		netlog_wait  = 1;
+	}
+	/* Coalesce records until the datagram is full or delay elapsed */
+	if ((len < NETLOG_MAX) && ((now - netlog_first) < NETLOG_DELAY))
+		return;
+	/* Rate limit */
+	if ((now - netlog_last) < NETLOG_INTERVAL)
+		return;
+
+	/* The host MAC address is taken from the last received frame, wait */
+	/* until the host has sent something (rx_flow is set by classifier) */
+	if (netif->rx_flow == 0)
+		return;
+	/* Network fast path has priority : wait for an idle interface */
+	if (netif->tx_more || netif->rx_length)
+		return;
+	eth = (eth_frame *)netif->tx_buffer;
+	if (eth->proto != 0x0000)
+		return;
+
+	conn.family      = NET_AF_INET;
+	conn.ip_remote   = netif->ip_remote;
+	conn.port_local  = htons(netlog_sock.port);
+	conn.port_remote = htons(CFG_NETLOG_PORT);
+	conn.rsp = 0;
+	data = udp4_tx_buffer(netif, &conn);
+
+	/* Datagram header : sequence number and count of lost records */
+	data[0] = (netlog_seq >>  0) & 0xFF;
+	data[1] = (netlog_seq >>  8) & 0xFF;
+	data[2] = (netlog_seq >> 16) & 0xFF;
+	data[3] = (netlog_seq >> 24) & 0xFF;
+	len = log_drops();
+	data[4] = (len >>  0) & 0xFF;
+	data[5] = (len >>  8) & 0xFF;
+	data[6] = (len >> 16) & 0xFF;
+	data[7] = (len >> 24) & 0xFF;
+	/* Copy as many complete records as possible */
+	len = log_read(data + 8, NETLOG_MAX);
+
+	udp4_send(netif, &conn, len + 8);
+
+	netlog_seq++;
+	netlog_last = now;
+	netlog_wait = 0;
+#else
+	(void)netif;
+#endif
+}
+/* EOF */
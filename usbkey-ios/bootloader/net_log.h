@@ -0,0 +1,41 @@
+/**
+ * @file  net_log.h
+ * @brief Definitions and prototypes for the UDP log sink
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef NET_LOG_H
+#define NET_LOG_H
+#include "net.h"
+
+/* UDP port of the host that receive log datagrams */
+#ifndef CFG_NETLOG_PORT
+#define CFG_NETLOG_PORT 1514
+#endif
+/* Maximum size of log records into one datagram (in bytes) */
+#ifndef NETLOG_MAX
+#define NETLOG_MAX 256
+#endif
+/* Time to wait for more records before sending a datagram (in ms) */
+#ifndef NETLOG_DELAY
+#define NETLOG_DELAY 20
+#endif
+/* Minimum time between two datagrams (in ms) */
+#ifndef NETLOG_INTERVAL
+#define NETLOG_INTERVAL 10
+#endif
+
+void netlog_init    (network *netif);
+void netlog_periodic(network *netif);
+
+#endif
+/* EOF */
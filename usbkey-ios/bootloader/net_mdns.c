@@ -0,0 +1,416 @@
+/**
+ * @file  net_mdns.c
+ * @brief Implement a tiny mDNS / DNS-SD responder (zero-configuration)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "libc.h"
+#include "net.h"
+#include "net_ipv4.h"
+#include "net_mdns.h"
+
+#ifdef USE_MDNS
+/* Max size of the records of one service (see mdns_init) */
+#define MDNS_SVC_MAX 140
+
+static int mdns_name_eq (const u8 *msg, int len, int a, int b);
+static int mdns_name_end(const u8 *msg, int len, int off);
+static u8 *put_host (u8 *p, network *netif);
+static u8 *put_label(u8 *p, const char *s, int len);
+static u8 *put_ptr  (u8 *p, int off);
+static u8 *put_rr   (u8 *p, u16 type, u16 class);
+static u8 *put16(u8 *p, u16 v);
+static u8 *put32(u8 *p, u32 v);
+
+/* IPv6 multicast group (ff02::fb) */
+const u8 mdns_ip6[16] = {0xFF,0x02, 0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0,0xFB};
+
+/* Precomputed response, with all the records of the device */
+static u8  mdns_tpl[MDNS_TPL_SIZE];
+static int mdns_tpl_len;
+/* Offset of the names (into response) that can be queried */
+static u16 mdns_names[2 + (MDNS_SERVICES * 2)];
+static int mdns_name_count;
+static udp_socket mdns_sock;
+
+/**
+ * @brief Initialize the responder (make the response and bind the port)
+ *
+ * The response contains the address records of the host name and, for
+ * each TCP service with a name, the DNS-SD records (PTR, SRV and TXT). It
+ * must be called when addresses and services are configured.
+ *
+ * @param netif Pointer to the network interface structure
+ */
+void mdns_init(network *netif)
+{
+	tcp_service *srv;
+	u8 *p, *rdata;
+	int host, local, types, name, inst;
+	int count = 0;
+	int len;
+	int i;
+
+	mdns_name_count = 0;
+	types = 0;
+
+	/* Header : response, authoritative answer */
+	memset(mdns_tpl, 0, 12);
+	mdns_tpl[2] = 0x84;
+	p = mdns_tpl + 12;
+
+	/* Address of the host : <host>.local */
+	host  = (p - mdns_tpl);
+	p     = put_host(p, netif);
+	local = (p - mdns_tpl);
+	p     = put_label(p, "local", 5);
+	*p++  = 0;
+	p = put_rr(p, MDNS_TYPE_A, MDNS_CLASS_FLUSH);
+	p = put16(p, 4);
+	p = put32(p, netif->ip_local);
+	count++;
+#ifdef USE_IPV6
+	p = put_ptr(p, host);
+	p = put_rr(p, MDNS_TYPE_AAAA, MDNS_CLASS_FLUSH);
+	p = put16(p, 16);
+	memcpy(p, netif->ip6_local, 16);
+	p += 16;
+	count++;
+#endif
+	mdns_names[mdns_name_count++] = host;
+
+	/* DNS-SD records of the TCP services */
+	for (i = 0; i < netif->tcp.service_count; i++)
+	{
+		srv = &netif->tcp.services[i];
+		if (srv->name == 0)
+			continue;
+		for (len = 0; srv->name[len]; len++)
+			;
+		/* Service type is limited to 15 characters (RFC 6335) */
+		if ((len == 0) || (len > 15))
+			continue;
+		if ((mdns_name_count == (1 + (MDNS_SERVICES * 2))) ||
+		    ((p - mdns_tpl) + MDNS_SVC_MAX > MDNS_TPL_SIZE))
+			break;
+
+		/* PTR _services._dns-sd._udp.local -> _<name>._tcp.local */
+		if (types == 0)
+		{
+			types = (p - mdns_tpl);
+			p = put_label(p, "_services", 9);
+			p = put_label(p, "_dns-sd", 7);
+			p = put_label(p, "_udp", 4);
+			p = put_ptr(p, local);
+		}
+		else
+			p = put_ptr(p, types);
+		p = put_rr(p, MDNS_TYPE_PTR, MDNS_CLASS_IN);
+		rdata = p + 2;
+		name  = (rdata - mdns_tpl);
+		*rdata = (len + 1);
+		rdata[1] = '_';
+		memcpy(rdata + 2, srv->name, len);
+		rdata = put_label(rdata + 2 + len, "_tcp", 4);
+		rdata = put_ptr(rdata, local);
+		put16(p, rdata - (p + 2));
+		p = rdata;
+
+		/* PTR _<name>._tcp.local -> <host>._<name>._tcp.local */
+		p = put_ptr(p, name);
+		p = put_rr(p, MDNS_TYPE_PTR, MDNS_CLASS_IN);
+		rdata = p + 2;
+		inst  = (rdata - mdns_tpl);
+		rdata = put_host(rdata, netif);
+		rdata = put_ptr(rdata, name);
+		put16(p, rdata - (p + 2));
+		p = rdata;
+
+		/* SRV <host>._<name>._tcp.local -> port, <host>.local */
+		p = put_ptr(p, inst);
+		p = put_rr(p, MDNS_TYPE_SRV, MDNS_CLASS_FLUSH);
+		p = put16(p, 8);
+		p = put16(p, 0);          /* Priority */
+		p = put16(p, 0);          /* Weight   */
+		p = put16(p, srv->port);
+		p = put_ptr(p, host);
+
+		/* TXT <host>._<name>._tcp.local (empty) */
+		p = put_ptr(p, inst);
+		p = put_rr(p, MDNS_TYPE_TXT, MDNS_CLASS_FLUSH);
+		p = put16(p, 1);
+		*p++ = 0;
+
+		count += 4;
+		mdns_names[mdns_name_count++] = name;
+		mdns_names[mdns_name_count++] = inst;
+	}
+	if (types)
+		mdns_names[mdns_name_count++] = types;
+
+	/* Number of answers */
+	put16(mdns_tpl + 6, count);
+	mdns_tpl_len = (p - mdns_tpl);
+
+	/* Bind the mDNS port */
+	mdns_sock.recv  = mdns_recv;
+	mdns_sock.queue = 0;
+	mdns_sock.netif = 0;
+	udp4_bind(netif, &mdns_sock, MDNS_PORT);
+}
+
+/**
+ * @brief Called by UDP layer when a packet is received on mDNS port
+ *
+ * When a question is for one of our names, the precomputed response is
+ * sent (all records, whatever the requested type). Responses are sent to
+ * the multicast group, or to the sender for legacy queries (source port is
+ * not 5353) with the ID of the query.
+ *
+ * @param sock Pointer to the socket of the responder
+ * @param udp  Pointer to the UDP packet structure
+ * @param ip   Pointer to the received IPv4 datagram (0 for IPv6)
+ * @param len  Size of the datas (checked by UDP layer)
+ */
+void mdns_recv(udp_socket *sock, udp_packet *udp, ip_dgram *ip, int len)
+{
+	network *netif = sock->netif;
+	u8 *msg = ((u8 *)udp) + 8;
+	udp_conn conn;
+	u8 *data;
+	int off;
+	int count;
+	int i, n;
+	(void)ip;
+
+	/* Only standard queries are processed (QR = 0, opcode = 0) */
+	if ((len < 12) || (msg[2] & 0xF8))
+		return;
+	count = (msg[4] << 8) | msg[5];
+
+	/* Search a question for one of our names */
+	off = 12;
+	for (i = 0; i < count; i++)
+	{
+		for (n = 0; n < mdns_name_count; n++)
+			if (mdns_name_eq(msg, len, off, mdns_names[n]))
+				break;
+		if (n < mdns_name_count)
+			break;
+		/* Skip name, type and class */
+		off = mdns_name_end(msg, len, off);
+		if ((off < 0) || ((off + 4) > len))
+			return;
+		off += 4;
+	}
+	if (i == count)
+		return;
+
+	/* Legacy query, respond to the sender */
+	if (udp->src_port != htons(MDNS_PORT))
+		udp4_reply_init(netif, &conn, udp);
+	else
+	{
+		conn.family = (netif->rx_buffer[14] >> 4);
+		conn.ip_remote = MDNS_IP4;
+		if (conn.family == NET_AF_INET6)
+		{
+			conn.ip_remote = 0xFFFFFFFF;
+			memcpy(conn.ip6_remote, mdns_ip6, 16);
+		}
+		conn.port_local  = htons(MDNS_PORT);
+		conn.port_remote = htons(MDNS_PORT);
+		conn.rsp = 0;
+	}
+	data = udp4_tx_buffer(netif, &conn);
+	memcpy(data, mdns_tpl, mdns_tpl_len);
+	if (conn.port_remote != htons(MDNS_PORT))
+	{
+		data[0] = msg[0];
+		data[1] = msg[1];
+	}
+	udp4_send(netif, &conn, mdns_tpl_len);
+}
+
+/**
+ * @brief Compare a name of a received message with a name of the response
+ *
+ * Both names may use compression, comparison is case-insensitive.
+ *
+ * @param msg Pointer to the received message
+ * @param len Length of the received message
+ * @param a   Offset of the name into the received message
+ * @param b   Offset of the name into the response
+ * @return integer True if names are equal
+ */
+static int mdns_name_eq(const u8 *msg, int len, int a, int b)
+{
+	int hops = 0;
+	int i;
+	u8  ca, cb;
+
+	while (1)
+	{
+		/* Follow compression pointers (limited, to avoid loops) */
+		while ((a < len) && ((msg[a] & 0xC0) == 0xC0))
+		{
+			if (((a + 1) >= len) || (++hops > 16))
+				return(0);
+			a = ((msg[a] & 0x3F) << 8) | msg[a + 1];
+		}
+		while ((mdns_tpl[b] & 0xC0) == 0xC0)
+			b = ((mdns_tpl[b] & 0x3F) << 8) | mdns_tpl[b + 1];
+
+		if ((a >= len) || (msg[a] != mdns_tpl[b]))
+			return(0);
+		if (msg[a] == 0)
+			return(1);
+		if ((a + 1 + msg[a]) > len)
+			return(0);
+		for (i = 1; i <= msg[a]; i++)
+		{
+			ca = msg[a + i];
+			cb = mdns_tpl[b + i];
+			if ((ca >= 'A') && (ca <= 'Z'))
+				ca += 0x20;
+			if ((cb >= 'A') && (cb <= 'Z'))
+				cb += 0x20;
+			if (ca != cb)
+				return(0);
+		}
+		b += mdns_tpl[b] + 1;
+		a += msg[a] + 1;
+	}
+}
+
+/**
+ * @brief Get the offset of the first byte after a name
+ *
+ * @param msg Pointer to the received message
+ * @param len Length of the received message
+ * @param off Offset of the name
+ * @return integer Offset after the name, or -1 if the name is truncated or
+ *         uses a reserved label type (0x40 / 0x80)
+ */
+static int mdns_name_end(const u8 *msg, int len, int off)
+{
+	while (off < len)
+	{
+		if ((msg[off] & 0xC0) == 0xC0)
+			return(off + 2);
+		if (msg[off] & 0xC0)
+			return(-1);
+		if (msg[off] == 0)
+			return(off + 1);
+		off += msg[off] + 1;
+	}
+	return(-1);
+}
+
+/**
+ * @brief Write the host label (prefix and MAC address)
+ *
+ * @param p     Pointer to the output buffer
+ * @param netif Pointer to the network interface structure
+ * @return Pointer to the next byte after the label
+ */
+static u8 *put_host(u8 *p, network *netif)
+{
+	static const char hex[16] = "0123456789abcdef";
+	const char *s = MDNS_HOST;
+	u8 *start = p++;
+	int i;
+
+	while (*s)
+		*p++ = *s++;
+	for (i = 0; i < 6; i++)
+	{
+		*p++ = hex[netif->mac[i] >> 4];
+		*p++ = hex[netif->mac[i] & 0x0F];
+	}
+	*start = (p - start - 1);
+	return(p);
+}
+
+/**
+ * @brief Write a label (length and characters)
+ *
+ * @param p   Pointer to the output buffer
+ * @param s   Pointer to the characters of the label
+ * @param len Number of characters
+ * @return Pointer to the next byte after the label
+ */
+static u8 *put_label(u8 *p, const char *s, int len)
+{
+	*p++ = len;
+	memcpy(p, s, len);
+	return(p + len);
+}
+
+/**
+ * @brief Write a compression pointer (end of a name)
+ *
+ * @param p   Pointer to the output buffer
+ * @param off Offset of the name into the response
+ * @return Pointer to the next byte after the pointer
+ */
+static u8 *put_ptr(u8 *p, int off)
+{
+	return(put16(p, 0xC000 | off));
+}
+
+/**
+ * @brief Write type, class and TTL of a record (before data length)
+ *
+ * @param p     Pointer to the output buffer
+ * @param type  Type of the record (MDNS_TYPE_x)
+ * @param class Class of the record (MDNS_CLASS_x)
+ * @return Pointer to the data length field
+ */
+static u8 *put_rr(u8 *p, u16 type, u16 class)
+{
+	p = put16(p, type);
+	p = put16(p, class);
+	return(put32(p, MDNS_TTL));
+}
+
+/**
+ * @brief Write a 16bits word in network byte order (unaligned buffer)
+ *
+ * @param p Pointer to the destination buffer
+ * @param v Value to write
+ * @return Pointer to the next byte after the word
+ */
+static u8 *put16(u8 *p, u16 v)
+{
+	p[0] = (v >> 8) & 0xFF;
+	p[1] = (v >> 0) & 0xFF;
+	return(p + 2);
+}
+
+/**
+ * @brief Write a 32bits word in network byte order (unaligned buffer)
+ *
+ * @param p Pointer to the destination buffer
+ * @param v Value to write
+ * @return Pointer to the next byte after the word
+ */
+static u8 *put32(u8 *p, u32 v)
+{
+	p[0] = (v >> 24) & 0xFF;
+	p[1] = (v >> 16) & 0xFF;
+	p[2] = (v >>  8) & 0xFF;
+	p[3] = (v >>  0) & 0xFF;
+	return(p + 4);
+}
+#endif
+/* EOF */
@@ -0,0 +1,57 @@
+/**
+ * @file  net_mdns.h
+ * @brief Definitions and prototypes for the mDNS / DNS-SD responder
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef NET_MDNS_H
+#define NET_MDNS_H
+#include "net.h"
+#include "net_ipv4.h"
+
+#define MDNS_PORT 5353
+/* IPv4 multicast group (224.0.0.251) */
+#define MDNS_IP4  0xE00000FB
+
+/* Prefix of the host name (followed by the MAC address) */
+#ifndef MDNS_HOST
+#define MDNS_HOST "cowstick-"
+#endif
+/* Time-to-live of the records (seconds) */
+#ifndef MDNS_TTL
+#define MDNS_TTL  120
+#endif
+/* Max size of the precomputed response */
+#ifndef MDNS_TPL_SIZE
+#define MDNS_TPL_SIZE 384
+#endif
+/* Max number of announced TCP services */
+#ifndef MDNS_SERVICES
+#define MDNS_SERVICES 4
+#endif
+
+#define MDNS_TYPE_A     1
+#define MDNS_TYPE_PTR  12
+#define MDNS_TYPE_TXT  16
+#define MDNS_TYPE_AAAA 28
+#define MDNS_TYPE_SRV  33
+/* Class IN, with cache-flush bit for unique records */
+#define MDNS_CLASS_IN    0x0001
+#define MDNS_CLASS_FLUSH 0x8001
+
+extern const u8 mdns_ip6[16];
+
+void mdns_init(network *netif);
+void mdns_recv(udp_socket *sock, udp_packet *udp, ip_dgram *ip, int len);
+
+#endif
+/* EOF */
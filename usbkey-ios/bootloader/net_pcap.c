@@ -0,0 +1,337 @@
+/**
+ * @file  net_pcap.c
+ * @brief Stream the capture ring to a TCP client (pcapng file format)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "libc.h"
+#include "net.h"
+#include "net_ipv4.h"
+#include "net_pcap.h"
+
+#ifdef USE_PCAP
+/* Max size of an Enhanced Packet Block : header (28), data, options */
+/* (flags 8, dropcount 12, comment 16, end 4) and trailing length (4) */
+#define PCAP_EPB_MAX (28 + NET_CAP_SNAPLEN + 8 + 12 + 16 + 4 + 4)
+
+static int pcap_send(pcap_session *session);
+static u8 *pcap_epb (u8 *p, net_cap *rec, u32 lost);
+static u8 *pcap_head(u8 *p);
+static u8 *put16(u8 *p, u16 v);
+static u8 *put32(u8 *p, u32 v);
+
+/* Comment added to dropped frames, indexed by -NET_DROP_x */
+static const char * const pcap_reason[NET_DROP_COUNT + 1] =
+{
+	"", "drop: runt", "drop: mac", "drop: type", "drop: addr", "drop: proto",
+	"drop: cksum"
+};
+
+/**
+ * @brief Initialize the capture streaming service
+ *
+ * @param srv     Pointer to the TCP service to configure
+ * @param session Pointer to the session structure
+ */
+void pcap_init(tcp_service *srv, pcap_session *session)
+{
+	/* Configure the service */
+	if (srv != 0)
+	{
+		srv->port    = CFG_PCAP_PORT;
+		srv->name    = "cowstick-pcap";
+		srv->accept  = pcap_accept;
+		srv->closed  = pcap_closed;
+		srv->process = pcap_recv;
+		srv->priv    = session;
+	}
+	/* Initialize the default session */
+	if (session)
+	{
+		session->conn     = 0;
+		session->header   = 0;
+		session->wait_ack = 0;
+	}
+}
+
+/**
+ * @brief Called by TCP/IP module when a new client is connected
+ *
+ * @param conn Pointer to the new TCP connection
+ * @return Return 0 to accept connection, any other value to reject
+ */
+int pcap_accept(tcp_conn *conn)
+{
+	pcap_session *session;
+
+	if ((conn->service == 0) || (conn->service->priv == 0))
+		return(1);
+	session = (pcap_session *)conn->service->priv;
+
+	/* Only one client at a time */
+	if (session->conn != 0)
+		return(1);
+
+	session->conn     = conn;
+	session->header   = 0;
+	session->wait_ack = 0;
+
+	conn->priv    = (void *)session;
+	conn->tx_more = pcap_tx_more;
+	return(0);
+}
+
+/**
+ * @brief Called by TCP/IP module when the connection is closed
+ *
+ * @param conn Pointer to the associated TCP connection
+ * @return Return value not used (reserved for future use)
+ */
+int pcap_closed(tcp_conn *conn)
+{
+	pcap_session *session = (pcap_session *)conn->priv;
+
+	session->conn = 0;
+	return(0);
+}
+
+/**
+ * @brief Called by TCP/IP module when datas are received (ignored)
+ *
+ * @param conn Pointer to the associated TCP connection
+ * @param data Pointer to the received data buffer
+ * @param len  Length (in bytes) of the received packet
+ * @return Return value not used (reserved for future use)
+ */
+int pcap_recv(tcp_conn *conn, u8 *data, int len)
+{
+	(void)conn;
+	(void)data;
+	(void)len;
+	return(0);
+}
+
+/**
+ * @brief Called by TCP/IP module when an ACK is received
+ *
+ * @param conn Pointer to the associated TCP connection
+ * @return Return value not used (reserved for future use)
+ */
+int pcap_tx_more(tcp_conn *conn)
+{
+	pcap_session *session = (pcap_session *)conn->priv;
+
+	session->wait_ack = 0;
+	pcap_send(session);
+	return(0);
+}
+
+/**
+ * @brief Send captured frames to the client (if any)
+ *
+ * This function must be called periodically (from main loop) to restart
+ * the stream when new frames are captured.
+ *
+ * @param session Pointer to the session structure
+ */
+void pcap_periodic(pcap_session *session)
+{
+	network *netif;
+
+	if ((session->conn == 0) || session->wait_ack)
+		return;
+	netif = session->conn->netif;
+	/* Network stack has priority, wait for an idle interface */
+	if (netif->tx_more || netif->rx_length)
+		return;
+	pcap_send(session);
+}
+
+/**
+ * @brief Send one TCP segment with file header and/or captured frames
+ *
+ * @param session Pointer to the session structure
+ * @return integer Number of bytes sent
+ */
+static int pcap_send(pcap_session *session)
+{
+	tcp_conn *conn = session->conn;
+	volatile eth_frame *eth;
+	net_cap rec;
+	u32 lost = 0;
+	u8 *start, *p;
+	int len;
+
+	if ((conn == 0) || (conn->state != TCP_CONN_ESTABLISHED))
+		return(0);
+	/* TX buffer must be free (proto is cleared when frame sent) */
+	eth = (eth_frame *)conn->netif->tx_buffer;
+	if (eth->proto != 0x0000)
+		return(0);
+
+	/* Nothing to send if the header is sent and the ring is empty */
+	if ( ! net_cap_read(&rec, &lost))
+	{
+		if (session->header)
+			return(0);
+		rec.length = 0;
+	}
+
+	start = tcp4_tx_buffer(conn);
+	p = start;
+	if ( ! session->header)
+	{
+		p = pcap_head(p);
+		session->header = 1;
+	}
+	if (rec.length)
+		p = pcap_epb(p, &rec, lost);
+	/* Add more frames while the segment has room for them */
+	while (((p - start) + PCAP_EPB_MAX) <= PCAP_CHUNK)
+	{
+		if ( ! net_cap_read(&rec, &lost))
+			break;
+		p = pcap_epb(p, &rec, lost);
+	}
+
+	len = (p - start);
+	tcp4_send(conn, len);
+	session->wait_ack = 1;
+	return(len);
+}
+
+/**
+ * @brief Write the file header : Section Header and Interface Description
+ *
+ * @param p Pointer to the output buffer
+ * @return Pointer to the next byte after the header
+ */
+static u8 *pcap_head(u8 *p)
+{
+	/* Section Header Block */
+	p = put32(p, 0x0A0D0D0A);
+	p = put32(p, 28);
+	p = put32(p, 0x1A2B3C4D); /* Byte-order magic        */
+	p = put16(p, 1);          /* Version 1.0             */
+	p = put16(p, 0);
+	p = put32(p, 0xFFFFFFFF); /* Section length unknown  */
+	p = put32(p, 0xFFFFFFFF);
+	p = put32(p, 28);
+	/* Interface Description Block */
+	p = put32(p, 0x00000001);
+	p = put32(p, 32);
+	p = put16(p, 1);          /* Link type : ethernet    */
+	p = put16(p, 0);
+	p = put32(p, NET_CAP_SNAPLEN);
+	p = put16(p, 9);          /* if_tsresol : 10^-3 (ms) */
+	p = put16(p, 1);
+	p = put32(p, 3);
+	p = put32(p, 0);          /* opt_endofopt            */
+	p = put32(p, 32);
+	return(p);
+}
+
+/**
+ * @brief Write an Enhanced Packet Block for a captured frame
+ *
+ * @param p    Pointer to the output buffer
+ * @param rec  Pointer to the captured frame
+ * @param lost Number of frames lost (ring overflow) before this one
+ * @return Pointer to the next byte after the block
+ */
+static u8 *pcap_epb(u8 *p, net_cap *rec, u32 lost)
+{
+	const char *comment = "";
+	u8 *start = p;
+	int caplen;
+	int clen;
+	int i;
+
+	caplen = rec->length;
+	if (caplen > NET_CAP_SNAPLEN)
+		caplen = NET_CAP_SNAPLEN;
+	if ((rec->flow < 0) && (rec->flow >= -NET_DROP_COUNT))
+		comment = pcap_reason[-rec->flow];
+	for (clen = 0; comment[clen]; clen++)
+		;
+
+	p = put32(p, 0x00000006);
+	p = put32(p, 0);          /* Total length, set below */
+	p = put32(p, 0);          /* Interface ID            */
+	p = put32(p, 0);          /* Timestamp (high)        */
+	p = put32(p, rec->time);  /* Timestamp (low)         */
+	p = put32(p, caplen);
+	p = put32(p, rec->length);
+	memcpy(p, rec->data, caplen);
+	p += caplen;
+	for ( ; caplen & 3; caplen++)
+		*p++ = 0;
+	/* epb_flags : direction */
+	p = put16(p, 2);
+	p = put16(p, 4);
+	p = put32(p, rec->dir);
+	/* epb_dropcount : frames lost before this one */
+	if (lost)
+	{
+		p = put16(p, 4);
+		p = put16(p, 8);
+		p = put32(p, lost);
+		p = put32(p, 0);
+	}
+	/* opt_comment : drop reason */
+	if (clen)
+	{
+		p = put16(p, 1);
+		p = put16(p, clen);
+		for (i = 0; i < clen; i++)
+			*p++ = comment[i];
+		for ( ; i & 3; i++)
+			*p++ = 0;
+	}
+	p = put32(p, 0);          /* opt_endofopt            */
+	p = put32(p, (p - start) + 4);
+	/* Update block length into the header */
+	put32(start + 4, p - start);
+	return(p);
+}
+
+/**
+ * @brief Write a 16bits word in little-endian (unaligned buffer)
+ *
+ * @param p Pointer to the destination buffer
+ * @param v Value to write
+ * @return Pointer to the next byte after the word
+ */
+static u8 *put16(u8 *p, u16 v)
+{
+	p[0] = (v >> 0) & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	return(p + 2);
+}
+
+/**
+ * @brief Write a 32bits word in little-endian (unaligned buffer)
+ *
+ * @param p Pointer to the destination buffer
+ * @param v Value to write
+ * @return Pointer to the next byte after the word
+ */
+static u8 *put32(u8 *p, u32 v)
+{
+	p[0] = (v >>  0) & 0xFF;
+	p[1] = (v >>  8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+	return(p + 4);
+}
+#endif
+/* EOF */
@@ -0,0 +1,41 @@
+/**
+ * @file  net_pcap.h
+ * @brief Definitions and prototypes for the capture streaming service
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef NET_PCAP_H
+#define NET_PCAP_H
+#include "net.h"
+#include "net_ipv4.h"
+
+/* Maximum number of bytes sent into one TCP segment */
+#ifndef PCAP_CHUNK
+#define PCAP_CHUNK 400
+#endif
+
+typedef struct _pcap_session
+{
+	tcp_conn *conn;     /* Connection of the client (or 0)      */
+	int       header;   /* True when file header has been sent   */
+	int       wait_ack; /* True when last segment is not acked   */
+} pcap_session;
+
+void pcap_init(tcp_service *srv, pcap_session *session);
+void pcap_periodic(pcap_session *session);
+
+int  pcap_accept (tcp_conn *conn);
+int  pcap_closed (tcp_conn *conn);
+int  pcap_recv   (tcp_conn *conn, u8 *data, int len);
+int  pcap_tx_more(tcp_conn *conn);
+#endif
+/* EOF */
@@ -0,0 +1,109 @@
+/**
+ * @file  net_prof.c
+ * @brief Implement a tiny UDP service to query the profiler counters
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "net.h"
+#include "net_ipv4.h"
+#include "net_prof.h"
+#include "prof.h"
+#include "timer.h"
+
+#ifdef USE_PROF
+static u8 *put32(u8 *p, u32 v);
+
+static udp_socket prof_sock;
+#endif
+
+/**
+ * @brief Initialize the profiler query service (bind its UDP port)
+ *
+ * @param netif Pointer to the network interface structure
+ */
+void netprof_init(network *netif)
+{
+#ifdef USE_PROF
+	prof_sock.recv  = prof_recv;
+	prof_sock.queue = 0;
+	prof_sock.netif = 0;
+	udp4_bind(netif, &prof_sock, CFG_PROF_PORT);
+#else
+	(void)netif;
+#endif
+}
+
+#ifdef USE_PROF
+
+/**
+ * @brief Called by UDP layer when a packet is received on profiler port
+ *
+ * Any datagram is answered with the table of counters. The response
+ * contains (in network byte order) the CPU frequency (32 bits), the number
+ * of counters (32 bits) then for each counter the number of calls, the sum
+ * of cycles and the max cycles (3 x 32 bits). If the request starts with
+ * 'C' all counters are cleared after the response.
+ *
+ * @param sock Pointer to the socket of the service
+ * @param udp  Pointer to the UDP packet structure
+ * @param ip   Pointer to the received IPv4 datagram (0 for IPv6)
+ * @param len  Size of the datas (checked by UDP layer)
+ */
+void prof_recv(udp_socket *sock, udp_packet *udp, ip_dgram *ip, int len)
+{
+	network *netif = sock->netif;
+	prof_counter *cnt;
+	udp_conn conn;
+	u8 *req, *data;
+	int clear;
+	int i;
+	(void)ip;
+
+	req = ((u8 *)udp) + 8;
+	clear = (len > 0) && (req[0] == 'C');
+
+	/* Initialize a temporary UDP connection to reply */
+	udp4_reply_init(netif, &conn, udp);
+	data = udp4_tx_buffer(netif, &conn);
+
+	data = put32(data, TIMER_CPU_FREQ);
+	data = put32(data, PROF_COUNT);
+	cnt  = prof_table();
+	for (i = 0; i < PROF_COUNT; i++)
+	{
+		data = put32(data, cnt[i].count);
+		data = put32(data, cnt[i].total);
+		data = put32(data, cnt[i].max);
+	}
+	udp4_send(netif, &conn, 8 + (PROF_COUNT * 12));
+
+	if (clear)
+		prof_init();
+}
+
+/**
+ * @brief Write a 32bits word in network byte order (unaligned buffer)
+ *
+ * @param p Pointer to the destination buffer
+ * @param v Value to write
+ * @return Pointer to the next byte after the word
+ */
+static u8 *put32(u8 *p, u32 v)
+{
+	p[0] = (v >> 24) & 0xFF;
+	p[1] = (v >> 16) & 0xFF;
+	p[2] = (v >>  8) & 0xFF;
+	p[3] = (v >>  0) & 0xFF;
+	return(p + 4);
+}
+#endif
+/* EOF */
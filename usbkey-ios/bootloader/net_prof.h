@@ -0,0 +1,30 @@
+/**
+ * @file  net_prof.h
+ * @brief Definitions and prototypes for the profiler query service
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef NET_PROF_H
+#define NET_PROF_H
+#include "net.h"
+#include "net_ipv4.h"
+
+/* UDP port of the counters query service */
+#ifndef CFG_PROF_PORT
+#define CFG_PROF_PORT 5150
+#endif
+
+void netprof_init(network *netif);
+void prof_recv(udp_socket *sock, udp_packet *udp, ip_dgram *ip, int len);
+
+#endif
+/* EOF */
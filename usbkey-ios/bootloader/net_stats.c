@@ -0,0 +1,102 @@
+/**
+ * @file  net_stats.c
+ * @brief Implement a tiny UDP service to query network and USB counters
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "net.h"
+#include "net_ipv4.h"
+#include "net_stats.h"
+#include "usb.h"
+
+static u8 *put_block(u8 *p, const u32 *block, int count);
+
+static udp_socket stats_sock;
+
+/**
+ * @brief Initialize the statistics service (bind its UDP port)
+ *
+ * @param netif Pointer to the network interface structure
+ */
+void stats_init(network *netif)
+{
+	stats_sock.recv  = stats_recv;
+	stats_sock.queue = 0;
+	stats_sock.netif = 0;
+	udp4_bind(netif, &stats_sock, CFG_STATS_PORT);
+}
+
+/**
+ * @brief Called by UDP layer when a packet is received on statistics port
+ *
+ * Any datagram is answered with the counters, in network byte order : a
+ * version word (1), the number of network counters then the counters (see
+ * net_stats into net.h), the number of USB counters then the counters (see
+ * usb_stats into usb.h).
+ *
+ * @param sock Pointer to the socket of the service
+ * @param udp  Pointer to the UDP packet structure
+ * @param ip   Pointer to the received IPv4 datagram (0 for IPv6)
+ * @param len  Size of the datas (checked by UDP layer)
+ */
+void stats_recv(udp_socket *sock, udp_packet *udp, ip_dgram *ip, int len)
+{
+	network    *netif = sock->netif;
+	usb_module *usb = (usb_module *)netif->driver;
+	udp_conn conn;
+	u8 *start, *p;
+	u32 n;
+	(void)ip;
+	(void)len;
+
+	/* Initialize a temporary UDP connection to reply */
+	udp4_reply_init(netif, &conn, udp);
+	start = udp4_tx_buffer(netif, &conn);
+
+	/* Version of the response format */
+	n = 1;
+	p = put_block(start, (u32 *)&n, 1);
+	/* Network counters */
+	n = sizeof(net_stats) / 4;
+	p = put_block(p, (u32 *)&n, 1);
+	p = put_block(p, (u32 *)&netif->stats, n);
+	/* USB counters */
+	n = sizeof(usb_stats) / 4;
+	p = put_block(p, (u32 *)&n, 1);
+	p = put_block(p, (u32 *)&usb->stats, n);
+
+	udp4_send(netif, &conn, p - start);
+}
+
+/**
+ * @brief Copy an array of 32bits words in network byte order
+ *
+ * @param p     Pointer to the destination buffer (may be unaligned)
+ * @param block Pointer to the words to copy
+ * @param count Number of words
+ * @return Pointer to the next byte after the copied words
+ */
+static u8 *put_block(u8 *p, const u32 *block, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		u32 v = block[i];
+		*p++ = (v >> 24) & 0xFF;
+		*p++ = (v >> 16) & 0xFF;
+		*p++ = (v >>  8) & 0xFF;
+		*p++ = (v >>  0) & 0xFF;
+	}
+	return(p);
+}
+/* EOF */
@@ -0,0 +1,30 @@
+/**
+ * @file  net_stats.h
+ * @brief Definitions and prototypes for the statistics query service
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef NET_STATS_H
+#define NET_STATS_H
+#include "net.h"
+#include "net_ipv4.h"
+
+/* UDP port of the statistics query service */
+#ifndef CFG_STATS_PORT
+#define CFG_STATS_PORT 5151
+#endif
+
+void stats_init(network *netif);
+void stats_recv(udp_socket *sock, udp_packet *udp, ip_dgram *ip, int len);
+
+#endif
+/* EOF */
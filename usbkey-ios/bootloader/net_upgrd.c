@@ -17,6 +17,7 @@
 #include "hardware.h"
 #include "libc.h"
 #include "net_upgrd.h"
+#include "prof.h"
 #include "uart.h"
 
 static void upgrd_write(u32 addr, u8 *data);
@@ -33,6 +34,7 @@ void upgrd_init(tcp_service *srv, upgrd *session)
 	if (srv != 0)
 	{
 		srv->port    = 1234;
+		srv->name    = "cowstick-upgrd";
 		srv->accept  = upgrd_accept;
 		srv->closed  = upgrd_closed;
 		srv->process = upgrd_recv;
@@ -58,7 +60,7 @@ int upgrd_accept(tcp_conn *conn)
 	tcp_service *srv;
 	upgrd *session;
 
-	uart_puts(" * Upgrade: start\r\n");
+	LOG0(" * Upgrade: start\r\n");
 
 	srv = conn->service;
 	if ( (srv == 0) || (srv->priv == 0) )
@@ -92,7 +94,7 @@ int upgrd_closed(tcp_conn *conn)
 {
 	upgrd *session;
 
-	uart_puts(" * Upgrade: finished\r\n");
+	LOG0(" * Upgrade: finished\r\n");
 
 	session = (upgrd *)conn->priv;
 	if (session->cache_len > 0)
@@ -134,6 +136,7 @@ int upgrd_recv(tcp_conn *conn, u8 *data, int len)
 	u8 *psrc;
 	int plen;
 	u32 dst;
+	PROF_START(PROF_UPGRD_RECV);
 
 	session = (upgrd *)conn->priv;
 	psrc = data;
@@ -191,6 +194,7 @@ int upgrd_recv(tcp_conn *conn, u8 *data, int len)
 		session->cache_len = plen;
 	}
 
+	PROF_END(PROF_UPGRD_RECV);
 	return(0);
 }
 
@@ -206,18 +210,14 @@ static void upgrd_write(u32 addr, u8 *data)
 	if ((addr & 0xFF) == 0)
 	{
 #ifdef DEBUG_UPGRD
-		uart_puts("Flash: erase row  ");
-		uart_puthex(addr);
-		uart_crlf();
+		LOG1("Flash: erase row  %08X\r\n", addr);
 #endif
 		flash_erase(addr);
 	}
 
 	/* Write one page to flash */
 #ifdef DEBUG_UPGRD
-	uart_puts("NVM: write page ");
-	uart_puthex(addr);
-	uart_crlf();
+	LOG1("NVM: write page %08X\r\n", addr);
 #endif
 	flash_write(addr, data);
 }
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+#
+# netstats.py - Read the network and USB counters of the bootloader
+#
+# Copyright (c) 2017 Cowlab
+# Author: Saint-Genest Gwenael <gwen@cowlab.fr>
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 3 as
+# published by the Free Software Foundation. This program is distributed
+# WITHOUT ANY WARRANTY, see LICENSE.md file for more details.
+#
+# Usage: netstats.py [ip]
+import socket
+import struct
+import sys
+
+# Same order as net_stats (net.h) and usb_stats (usb.h)
+NET = ['rx_frames', 'rx_bytes', 'drop_runt', 'drop_mac', 'drop_type',
+       'drop_addr', 'drop_proto', 'drop_cksum', 'tx_frames', 'tx_bytes',
+       'tx_err', 'arp_rx', 'arp_tx', 'ip_rx', 'ip_tx', 'ip_noproto',
+       'udp_rx', 'udp_tx', 'udp_noport', 'tcp_rx', 'tcp_tx', 'tcp_dupack',
+       'tcp_rst_rx', 'tcp_rst_tx', 'tcp_noconn', 'icmp_rx', 'icmp_tx',
+       'icmp_limit', 'arp_req', 'arp_drop', 'ip6_rx', 'ip6_tx', 'ip6_drop',
+       'tcp_rto', 'tcp_fastrtx', 'tcp_nortx', 'udp_err']
+USB = ['setup', 'trfail_in', 'trfail_out', 'stall', 'reset']
+
+def show(title, names, values):
+    print(title)
+    for i, v in enumerate(values):
+        name = names[i] if i < len(names) else 'counter %d' % i
+        print('  %-12s %10d' % (name, v))
+
+def main():
+    addr = sys.argv[1] if len(sys.argv) > 1 else '10.10.10.254'
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1.0)
+    sock.sendto(b'S', (addr, 5151))
+    data = sock.recv(2048)
+
+    words = struct.unpack('>%dI' % (len(data) // 4), data)
+    nnet = words[1]
+    nusb = words[2 + nnet]
+    show('Network', NET, words[2:2 + nnet])
+    show('USB', USB, words[3 + nnet:3 + nnet + nusb])
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,68 @@
+/**
+ * @file  prof.c
+ * @brief Hot-path profiler (call count and CPU cycles per function)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "hardware.h"
+#include "libc.h"
+#include "prof.h"
+
+#ifdef USE_PROF
+static prof_counter prof_counters[PROF_COUNT];
+
+/**
+ * @brief Initialize (clear) all profiler counters
+ *
+ */
+void prof_init(void)
+{
+	memset(prof_counters, 0, sizeof(prof_counters));
+}
+
+/**
+ * @brief Update counters at the end of an instrumented function
+ *
+ * This function is called by PROF_END(), it can be used from interrupts.
+ * Cycles are inclusive : the time spent into instrumented sub-functions
+ * (or into interrupts) is counted into the caller too.
+ *
+ * @param id    Identifier of the function (PROF_x)
+ * @param start Value of timer_cycles() when the function started
+ */
+void prof_record(int id, u32 start)
+{
+	prof_counter *cnt = &prof_counters[id];
+	u32 delta;
+	u32 irq;
+
+	delta = timer_cycles() - start;
+
+	irq = irq_save();
+	cnt->count++;
+	cnt->total += delta;
+	if (delta > cnt->max)
+		cnt->max = delta;
+	irq_restore(irq);
+}
+
+/**
+ * @brief Get a pointer to the table of counters
+ *
+ * @return Pointer to the first counter (PROF_COUNT entries)
+ */
+prof_counter *prof_table(void)
+{
+	return(prof_counters);
+}
+#endif
+/* EOF */
@@ -0,0 +1,58 @@
+/**
+ * @file  prof.h
+ * @brief Definitions and macros for the hot-path profiler
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef PROF_H
+#define PROF_H
+#include "types.h"
+
+/* Identifiers of the instrumented functions */
+#define PROF_NET_PERIODIC  0
+#define PROF_IPV4_RECEIVE  1
+#define PROF_TCP4_RECEIVE  2
+#define PROF_TCP4_SEND     3
+#define PROF_IP_CKSUM      4
+#define PROF_USB_IRQ       5
+#define PROF_EP_IN         6
+#define PROF_EP_OUT        7
+#define PROF_FLASH_ERASE   8
+#define PROF_FLASH_WRITE   9
+#define PROF_UPGRD_RECV   10
+#define PROF_COUNT        11
+
+#ifdef USE_PROF
+#include "timer.h"
+
+typedef struct
+{
+	u32 count;  /* Number of calls             */
+	u32 total;  /* Sum of cycles for all calls */
+	u32 max;    /* Cycles of the longest call  */
+} prof_counter;
+
+/* PROF_START() must be used once per id into a function (it declares a */
+/* variable) and PROF_END() before each return of the instrumented code */
+#define PROF_START(id) u32 prof_t_##id = timer_cycles()
+#define PROF_END(id)   prof_record(id, prof_t_##id)
+
+void prof_init  (void);
+void prof_record(int id, u32 start);
+prof_counter *prof_table(void);
+#else
+#define PROF_START(id)
+#define PROF_END(id)
+#endif
+
+#endif
+/* EOF */
@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+#
+# profquery.py - Read the profiler counters of the bootloader (USE_PROF)
+#
+# Copyright (c) 2017 Cowlab
+# Author: Saint-Genest Gwenael <gwen@cowlab.fr>
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 3 as
+# published by the Free Software Foundation. This program is distributed
+# WITHOUT ANY WARRANTY, see LICENSE.md file for more details.
+#
+# Usage: profquery.py [ip] [--clear]
+import socket
+import struct
+import sys
+
+# Same order as PROF_x identifiers into prof.h
+NAMES = ['net_periodic', 'ipv4_receive', 'tcp4_receive', 'tcp4_send',
+         'ip_cksum', 'usb_irq', 'ep_transfer_in', 'ep_transfer_out',
+         'flash_erase', 'flash_write', 'upgrd_recv']
+
+def main():
+    args = [a for a in sys.argv[1:] if not a.startswith('--')]
+    addr = args[0] if args else '10.10.10.254'
+    req = b'C' if '--clear' in sys.argv else b'R'
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1.0)
+    sock.sendto(req, (addr, 5150))
+    data = sock.recv(2048)
+
+    (freq, count) = struct.unpack_from('>II', data, 0)
+    print('%-16s %10s %12s %10s %10s' % ('function', 'calls', 'cycles',
+                                         'avg', 'max (us)'))
+    for i in range(count):
+        (calls, total, cmax) = struct.unpack_from('>III', data, 8 + 12 * i)
+        name = NAMES[i] if i < len(NAMES) else 'id %d' % i
+        avg = (total // calls) if calls else 0
+        print('%-16s %10d %12d %10d %10.1f' % (name, calls, total, avg,
+                                               cmax * 1e6 / freq))
+
+if __name__ == '__main__':
+    main()
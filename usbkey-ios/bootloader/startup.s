@@ -82,8 +82,20 @@ __vectors:
     .globl    Reset_Handler
     .type    Reset_Handler, %function
 Reset_Handler:
+    /* Copy RAM functions from flash to SRAM */
+    ldr    r1, =__ramfunc_load__
+    ldr    r2, =__ramfunc_start__
+    ldr    r3, =__ramfunc_end__
+    subs    r3, r2
+    ble    .ramfunc_end
+.ramfunc_loop:
+    subs    r3, #4
+    ldr    r0, [r1, r3]
+    str    r0, [r2, r3]
+    bgt    .ramfunc_loop
+.ramfunc_end:
     /* Copy datas from flash to SRAM */
-    ldr    r1, =_etext
+    ldr    r1, =__data_load__
     ldr    r2, =__data_start__
     ldr    r3, =__data_end__
     subs    r3, r2
@@ -0,0 +1,37 @@
+/**
+ * @file  host.h
+ * @brief Definitions forced into all sources of the host test build
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef TEST_HOST_H
+#define TEST_HOST_H
+
+/* Functions of libc.c are renamed, so the host C library is not replaced */
+#define memcmp  bl_memcmp
+#define memcpy  bl_memcpy
+#define memmove bl_memmove
+#define memset  bl_memset
+#define strcpy  bl_strcpy
+#define strlen  bl_strlen
+#define strncpy bl_strncpy
+
+/* Headers of the host C library can not be mixed with types.h */
+int  printf(const char *format, ...);
+
+/* Report a failed check (file, line, expression) and count it */
+extern int test_failed;
+#define CHECK(x) do { if ( ! (x)) { test_failed++; \
+	printf("%s:%d: FAIL %s\n", __FILE__, __LINE__, #x); } } while (0)
+
+#endif
+/* EOF */
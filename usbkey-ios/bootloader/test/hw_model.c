@@ -0,0 +1,190 @@
+/**
+ * @file  hw_model.c
+ * @brief Host model of the peripherals registers (HW_EMUL)
+ *
+ * Registers are kept into byte arrays, one per modeled peripheral. Writes
+ * to interrupt flags registers clear the written bits (like the hardware),
+ * the test sets them with hw_set8() / hw_set16() to simulate events.
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "hardware.h"
+#include "hw_model.h"
+#include "libc.h"
+
+typedef struct
+{
+	u32 base;
+	u32 size;
+	u8 *mem;
+} hw_window;
+
+static u8 hw_usb [0x200];
+static u8 hw_dmac[0x80];
+static u8 hw_nvm [0x40];
+static u8 hw_nvic[0x400];
+
+static const hw_window hw_windows[] =
+{
+	{ USB_ADDR,   sizeof(hw_usb),  hw_usb  },
+	{ DMAC_ADDR,  sizeof(hw_dmac), hw_dmac },
+	{ NVM_ADDR,   sizeof(hw_nvm),  hw_nvm  },
+	{ 0xE000E000, sizeof(hw_nvic), hw_nvic },
+};
+
+void (*hw_write_hook)(u32 reg, u32 value, int size);
+u32 hw_primask;
+u32 hw_access;
+
+/**
+ * @brief Get the storage of a register (or NULL if not modeled)
+ *
+ * @param reg Address of the register
+ * @return Pointer to the first byte of the register
+ */
+static u8 *hw_ptr(u32 reg)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(hw_windows) / sizeof(hw_window); i++)
+	{
+		if ((reg >= hw_windows[i].base) &&
+		    (reg <  hw_windows[i].base + hw_windows[i].size))
+			return(hw_windows[i].mem + (reg - hw_windows[i].base));
+	}
+	return(0);
+}
+
+/**
+ * @brief Test if a register clears the bits written to 1 (flags)
+ *
+ * @param reg Address of the register
+ * @return boolean True for USB INTFLAG, EPINTFLAGn and DMAC CHINTFLAG
+ */
+static int hw_w1c(u32 reg)
+{
+	if (reg == USB_ADDR + 0x1C)
+		return(1);
+	if ((reg >= USB_ADDR + 0x100) && ((reg & 0x1F) == 0x07))
+		return(1);
+	if (reg == DMAC_ADDR + 0x4E)
+		return(1);
+	return(0);
+}
+
+/**
+ * @brief Write bytes of a register, with flags clear behavior
+ */
+static void hw_write(u32 reg, u32 value, int size)
+{
+	u8 *p = hw_ptr(reg);
+	int i;
+
+	hw_access++;
+	if (p)
+	{
+		for (i = 0; i < size; i++)
+		{
+			u8 v = (value >> (i * 8)) & 0xFF;
+			if (hw_w1c(reg))
+				p[i] &= ~v;
+			else
+				p[i] = v;
+		}
+	}
+	if (hw_write_hook)
+		hw_write_hook(reg, value, size);
+}
+
+/**
+ * @brief Read bytes of a register
+ */
+static u32 hw_read(u32 reg, int size)
+{
+	u8 *p = hw_ptr(reg);
+	u32 value = 0;
+	int i;
+
+	hw_access++;
+	if (p == 0)
+		return(0);
+	for (i = 0; i < size; i++)
+		value |= (p[i] << (i * 8));
+	return(value);
+}
+
+/**
+ * @brief Clear all registers and hooks of the model
+ */
+void hw_reset(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(hw_windows) / sizeof(hw_window); i++)
+		memset(hw_windows[i].mem, 0, hw_windows[i].size);
+	hw_write_hook = 0;
+	hw_primask = 0;
+	hw_access  = 0;
+}
+
+/**
+ * @brief Set a 8 bits register (event from the peripheral side)
+ */
+void hw_set8(u32 reg, u8 value)
+{
+	u8 *p = hw_ptr(reg);
+	if (p)
+		p[0] = value;
+}
+
+/**
+ * @brief Set a 16 bits register (event from the peripheral side)
+ */
+void hw_set16(u32 reg, u16 value)
+{
+	u8 *p = hw_ptr(reg);
+	if (p)
+	{
+		p[0] = value & 0xFF;
+		p[1] = value >> 8;
+	}
+}
+
+/* Register accessors used by the sources when built with HW_EMUL */
+u32  reg_rd  (u32 reg)  { return(hw_read(reg, 4)); }
+u16  reg16_rd(u32 reg)  { return(hw_read(reg, 2)); }
+u8   reg8_rd (u32 reg)  { return(hw_read(reg, 1)); }
+void reg_wr  (u32 reg, u32 value) { hw_write(reg, value, 4); }
+void reg16_wr(u32 reg, u16 value) { hw_write(reg, value, 2); }
+void reg8_wr (u32 reg, u8  value) { hw_write(reg, value, 1); }
+void reg_set (u32 reg, u32 value) { hw_write(reg, hw_read(reg, 4) | value, 4); }
+
+/**
+ * @brief Disable interrupts (model of PRIMASK)
+ */
+u32 irq_save(void)
+{
+	u32 state = hw_primask;
+	hw_primask = 1;
+	return(state);
+}
+
+/**
+ * @brief Restore interrupts state
+ */
+void irq_restore(u32 state)
+{
+	hw_primask = state;
+}
+
+int test_failed;
+/* EOF */
@@ -0,0 +1,32 @@
+/**
+ * @file  hw_model.h
+ * @brief Host model of the peripherals registers (HW_EMUL)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef HW_MODEL_H
+#define HW_MODEL_H
+#include "types.h"
+
+/* Called after each register write (size is 1, 2 or 4 bytes) */
+extern void (*hw_write_hook)(u32 reg, u32 value, int size);
+/* PRIMASK of the modeled CPU (1 when interrupts are masked) */
+extern u32 hw_primask;
+/* Number of register reads and writes done by the sources */
+extern u32 hw_access;
+
+void hw_reset(void);
+void hw_set8 (u32 reg, u8  value);
+void hw_set16(u32 reg, u16 value);
+
+#endif
+/* EOF */
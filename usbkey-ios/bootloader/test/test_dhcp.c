@@ -0,0 +1,345 @@
+/**
+ * @file  test_dhcp.c
+ * @brief Host tests of the DHCP server (client exchanges, option parser)
+ *
+ * The server source is included, so static functions can be tested. UDP
+ * layer and timers are replaced by stubs : replies are decoded from the TX
+ * buffer and timers are expired by the test.
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "../net_dhcp.c"
+
+#define SERVER_IP 0x0A000001
+#define POOL_IP   0x0A000002
+
+int test_failed;
+
+static network net;
+/* Request received by the server : IPv4 + UDP + DHCP */
+static u8 rx[20 + 8 + 300];
+/* Reply sent by the server (DHCP packet) and its size, 0 if none */
+static u8 tx[300];
+static int tx_len;
+static udp_conn tx_conn;
+
+/* -- Stubs of network layers and timers ---------------------------------- */
+
+u16 htons(u16 v)
+{
+	return((u16)((v >> 8) | (v << 8)));
+}
+
+u32 htonl(u32 v)
+{
+	return((v >> 24) | ((v >> 8) & 0xFF00) |
+	       ((v << 8) & 0xFF0000) | (v << 24));
+}
+
+int udp4_bind(network *mod, udp_socket *sock, u16 port)
+{
+	sock->netif = mod;
+	sock->port  = port;
+	return(0);
+}
+
+u8 *udp4_tx_buffer(network *mod, udp_conn *conn)
+{
+	(void)mod;
+	(void)conn;
+	return(tx);
+}
+
+void udp4_send(network *mod, udp_conn *conn, int len)
+{
+	(void)mod;
+	tx_conn = *conn;
+	tx_len  = len;
+}
+
+void timer_arm(timer *tmr, u32 delay)
+{
+	tmr->expire = delay;
+	tmr->armed  = 1;
+}
+
+void timer_cancel(timer *tmr)
+{
+	tmr->armed = 0;
+}
+
+/* -- Client side ---------------------------------------------------------- */
+
+/**
+ * @brief Send a DHCP message to the server
+ *
+ * @param mac    Last byte of the client hardware address
+ * @param type   DHCP message type (0 for a BOOTP request)
+ * @param addr   Requested address (option 50), or 0
+ * @param server Server identifier (option 54), or 0
+ * @return DHCP message type of the reply, 0 if the server did not answer
+ */
+static int client(u8 mac, u8 type, u32 addr, u32 server)
+{
+	ip_dgram    *ip  = (ip_dgram *)rx;
+	udp_packet  *udp = (udp_packet *)(rx + 20);
+	dhcp_packet *pkt = (dhcp_packet *)(rx + 28);
+	u8 *opt = rx + 28 + sizeof(dhcp_packet);
+	int len;
+	u8 *p;
+
+	memset(rx, 0, sizeof(rx));
+	pkt->op    = DHCP_DISCOVER;
+	pkt->htype = 1;
+	pkt->hlen  = 6;
+	pkt->xid   = 0x12345678;
+	pkt->chaddr[0] = 0x02;
+	pkt->chaddr[5] = mac;
+	if (type != 0)
+	{
+		opt[0] = 0x63; opt[1] = 0x82; opt[2] = 0x53; opt[3] = 0x63;
+		opt += 4;
+		opt[0] = 53; opt[1] = 1; opt[2] = type;
+		opt += 3;
+		if (addr)
+		{
+			opt[0] = 50; opt[1] = 4;
+			opt[2] = addr >> 24; opt[3] = addr >> 16;
+			opt[4] = addr >> 8;  opt[5] = addr;
+			opt += 6;
+		}
+		if (server)
+		{
+			opt[0] = 54; opt[1] = 4;
+			opt[2] = server >> 24; opt[3] = server >> 16;
+			opt[4] = server >> 8;  opt[5] = server;
+			opt += 6;
+		}
+		*opt++ = 0xFF;
+		/* Minimum size of a BOOTP packet */
+		opt += 20;
+	}
+	len = opt - (u8 *)pkt;
+	udp->src_port = htons(68);
+	udp->dst_port = htons(67);
+	udp->length   = htons(8 + len);
+	ip->length    = htons(20 + 8 + len);
+
+	tx_len = 0;
+	memset(tx, 0, sizeof(tx));
+	dhcp_recv(&net, udp, ip);
+	if (tx_len == 0)
+		return(0);
+	if (tx_len == (int)sizeof(dhcp_packet))
+		return(-1);
+	p = find_option((dhcp_packet *)tx, tx_len - sizeof(dhcp_packet) - 4, 53);
+	CHECK(p != 0);
+	return(p ? p[2] : 0);
+}
+
+/**
+ * @brief Address given to the client into the last reply (host order)
+ */
+static u32 yiaddr(void)
+{
+	return(htonl(((dhcp_packet *)tx)->yiaddr));
+}
+
+static void setup(void)
+{
+	memset(&net, 0, sizeof(network));
+	net.ip_local  = SERVER_IP;
+	net.ip_remote = POOL_IP;
+	dhcp_init(&net);
+}
+
+/* -- Tests ---------------------------------------------------------------- */
+
+/**
+ * @brief Nominal exchange : DISCOVER, OFFER, REQUEST, ACK then RELEASE
+ */
+static void test_exchange(void)
+{
+	setup();
+	CHECK(client(1, DHCP_MSG_DISCOVER, 0, 0) == DHCP_MSG_OFFER);
+	CHECK(yiaddr() == POOL_IP);
+	CHECK(tx_conn.ip_remote == 0xFFFFFFFF);
+	CHECK(dhcp_leases[0].state == DHCP_LEASE_OFFERED);
+	CHECK(dhcp_leases[0].tmr.expire == DHCP_OFFER_TIME);
+
+	CHECK(client(1, DHCP_MSG_REQUEST, POOL_IP, SERVER_IP) == DHCP_MSG_ACK);
+	CHECK(yiaddr() == POOL_IP);
+	CHECK(dhcp_leases[0].state == DHCP_LEASE_BOUND);
+	CHECK(dhcp_leases[0].tmr.expire == DHCP_LEASE_TIME * 1000);
+
+	/* Another client gets the next address */
+	CHECK(client(2, DHCP_MSG_DISCOVER, 0, 0) == DHCP_MSG_OFFER);
+	CHECK(yiaddr() == POOL_IP + 1);
+	/* ... and a NAK for an address of the other client */
+	CHECK(client(2, DHCP_MSG_REQUEST, POOL_IP, SERVER_IP) == DHCP_MSG_NAK);
+
+	CHECK(client(1, DHCP_MSG_RELEASE, 0, 0) == 0);
+	CHECK(dhcp_leases[0].state == DHCP_LEASE_FREE);
+	CHECK( ! dhcp_leases[0].tmr.armed);
+
+	/* Client selected another server : offer is released */
+	CHECK(client(2, DHCP_MSG_REQUEST, POOL_IP + 1, 0x0A0000FE) == 0);
+	CHECK(dhcp_leases[1].state == DHCP_LEASE_FREE);
+
+	/* BOOTP client : address immediately bound */
+	CHECK(client(3, 0, 0, 0) == -1);
+	CHECK(yiaddr() == POOL_IP);
+	CHECK(dhcp_leases[0].state == DHCP_LEASE_BOUND);
+}
+
+/**
+ * @brief A declined address is not offered again until the delay expires
+ */
+static void test_decline(void)
+{
+	int i;
+
+	setup();
+	CHECK(client(1, DHCP_MSG_DISCOVER, 0, 0) == DHCP_MSG_OFFER);
+	CHECK(client(1, DHCP_MSG_REQUEST, POOL_IP, SERVER_IP) == DHCP_MSG_ACK);
+	CHECK(client(1, DHCP_MSG_DECLINE, POOL_IP, SERVER_IP) == 0);
+	CHECK(dhcp_leases[0].state == DHCP_LEASE_DECLINED);
+	CHECK(dhcp_leases[0].tmr.expire == DHCP_DECLINE_TIME);
+
+	/* Same client restarts : another address is offered */
+	CHECK(client(1, DHCP_MSG_DISCOVER, 0, 0) == DHCP_MSG_OFFER);
+	CHECK(yiaddr() == POOL_IP + 1);
+	/* Even if it asks for the declined one */
+	CHECK(client(1, DHCP_MSG_RELEASE, 0, 0) == 0);
+	CHECK(client(1, DHCP_MSG_DISCOVER, POOL_IP, 0) == DHCP_MSG_OFFER);
+	CHECK(yiaddr() == POOL_IP + 1);
+	CHECK(client(1, DHCP_MSG_REQUEST, POOL_IP, SERVER_IP) == DHCP_MSG_NAK);
+
+	/* Delay expired : address is back into the pool */
+	lease_expire(&dhcp_leases[0].tmr);
+	CHECK(dhcp_leases[0].state == DHCP_LEASE_FREE);
+	CHECK(client(4, DHCP_MSG_DISCOVER, POOL_IP, 0) == DHCP_MSG_OFFER);
+	CHECK(yiaddr() == POOL_IP);
+
+	/* Pool full of declined addresses : no offer */
+	setup();
+	for (i = 0; i < DHCP_POOL_SIZE; i++)
+	{
+		CHECK(client(1, DHCP_MSG_DISCOVER, 0, 0) == DHCP_MSG_OFFER);
+		CHECK(client(1, DHCP_MSG_DECLINE, yiaddr(), SERVER_IP) == 0);
+	}
+	CHECK(client(1, DHCP_MSG_DISCOVER, 0, 0) == 0);
+}
+
+/**
+ * @brief Client rebooting with an address unknown by the server
+ */
+static void test_reboot(void)
+{
+	static const u8 zero[6] = {0, 0, 0, 0, 0, 0};
+
+	setup();
+	CHECK(client(1, DHCP_MSG_DISCOVER, 0, 0) == DHCP_MSG_OFFER);
+	CHECK(client(1, DHCP_MSG_REQUEST, POOL_IP, SERVER_IP) == DHCP_MSG_ACK);
+
+	/* Address of another client : NAK, table not modified */
+	CHECK(client(2, DHCP_MSG_REQUEST, POOL_IP, 0) == DHCP_MSG_NAK);
+	CHECK(dhcp_leases[0].state == DHCP_LEASE_BOUND);
+	CHECK(dhcp_leases[0].mac[5] == 1);
+	CHECK(dhcp_leases[1].state == DHCP_LEASE_FREE);
+	CHECK(memcmp(dhcp_leases[1].mac, zero, 6) == 0);
+	/* Address out of the pool */
+	CHECK(client(2, DHCP_MSG_REQUEST, POOL_IP + DHCP_POOL_SIZE, 0) ==
+	      DHCP_MSG_NAK);
+	CHECK(client(2, DHCP_MSG_REQUEST, SERVER_IP, 0) == DHCP_MSG_NAK);
+	CHECK(dhcp_leases[1].state == DHCP_LEASE_FREE);
+	CHECK(memcmp(dhcp_leases[1].mac, zero, 6) == 0);
+	CHECK(lease_find(dhcp_leases[0].mac) == &dhcp_leases[0]);
+
+	/* Free address of the pool : the client keeps it */
+	CHECK(client(2, DHCP_MSG_REQUEST, POOL_IP + 2, 0) == DHCP_MSG_ACK);
+	CHECK(yiaddr() == POOL_IP + 2);
+	CHECK(dhcp_leases[2].state == DHCP_LEASE_BOUND);
+	CHECK(dhcp_leases[2].mac[5] == 2);
+	CHECK(dhcp_leases[1].state == DHCP_LEASE_FREE);
+}
+
+/**
+ * @brief Options parser never returns an option that exceeds the packet
+ */
+static void test_find_option(void)
+{
+	static u8 buf[sizeof(dhcp_packet) + 4 + 16];
+	dhcp_packet *pkt = (dhcp_packet *)buf;
+	u8 *opt = buf + sizeof(dhcp_packet) + 4;
+
+	/* Padding, then option 50 */
+	memset(buf, 0, sizeof(buf));
+	opt[0] = 0; opt[1] = 0;
+	opt[2] = 50; opt[3] = 4; opt[4] = 10; opt[5] = 0; opt[6] = 0; opt[7] = 2;
+	opt[8] = 0xFF;
+	CHECK(find_option(pkt, 9, 50) == opt + 2);
+	/* Option content truncated by the length of the packet */
+	CHECK(find_option(pkt, 7, 50) == 0);
+	/* Only the option header is into the packet */
+	CHECK(find_option(pkt, 4, 50) == 0);
+	/* Only the option ID is into the packet */
+	CHECK(find_option(pkt, 3, 50) == 0);
+	/* Empty options */
+	CHECK(find_option(pkt, 0, 50) == 0);
+	/* Option after the End-Of-Options is ignored */
+	opt[0] = 0xFF;
+	CHECK(find_option(pkt, 9, 50) == 0);
+	/* Option length goes past the end, no End-Of-Options */
+	memset(opt, 0, 16);
+	opt[0] = 12; opt[1] = 200;
+	opt[2] = 50; opt[3] = 4;
+	CHECK(find_option(pkt, 16, 50) == 0);
+	/* Zero length option, no End-Of-Options : following one is found */
+	opt[0] = 12; opt[1] = 0;
+	opt[2] = 50; opt[3] = 4;
+	CHECK(find_option(pkt, 8, 50) == opt + 2);
+	CHECK(find_option(pkt, 7, 50) == 0);
+	CHECK(find_option(pkt, 16, 51) == 0);
+
+	setup();
+	CHECK(client(1, DHCP_MSG_DISCOVER, 0, 0) == DHCP_MSG_OFFER);
+	/* Datagram shorter than the BOOTP fields : no reply */
+	((ip_dgram *)rx)->length = htons(20 + 8 + 100);
+	tx_len = 0;
+	dhcp_recv(&net, (udp_packet *)(rx + 20), (ip_dgram *)rx);
+	CHECK(tx_len == 0);
+	/* UDP length shorter than its header */
+	((ip_dgram *)rx)->length = htons(20 + 8 + 300);
+	((udp_packet *)(rx + 20))->length = htons(4);
+	dhcp_recv(&net, (udp_packet *)(rx + 20), (ip_dgram *)rx);
+	CHECK(tx_len == 0);
+	/* From the socket : length checked by UDP layer is used */
+	dhcp_sock.recv(&dhcp_sock, (udp_packet *)(rx + 20), (ip_dgram *)rx, 100);
+	CHECK(tx_len == 0);
+	dhcp_sock.recv(&dhcp_sock, (udp_packet *)(rx + 20), 0, 300);
+	CHECK(tx_len == 0);
+	dhcp_sock.recv(&dhcp_sock, (udp_packet *)(rx + 20), (ip_dgram *)rx, 300);
+	CHECK(tx_len != 0);
+}
+
+int main(void)
+{
+	test_exchange();
+	test_decline();
+	test_reboot();
+	test_find_option();
+
+	printf("test_dhcp: %s\n", test_failed ? "FAILED" : "OK");
+	return(test_failed != 0);
+}
+/* EOF */
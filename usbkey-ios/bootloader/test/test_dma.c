@@ -0,0 +1,252 @@
+/**
+ * @file  test_dma.c
+ * @brief Host tests of the copy engine (chains, callbacks, CPU fallback)
+ *
+ * Built twice : without USE_DMA (software backend only) and with USE_DMA,
+ * where the DMAC is the register model (events are simulated, the model
+ * does not copy datas). The source is included to read the descriptors
+ * written into the DMAC RAM.
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "../dma.c"
+#include "hw_model.h"
+
+static u8 src[256] __attribute__((aligned(4)));
+static u8 dst[256] __attribute__((aligned(4)));
+static dma_xfer *order[8];
+static int order_count;
+static int triggers;
+
+static void complete(dma_xfer *xfer)
+{
+	if (order_count < 8)
+		order[order_count] = xfer;
+	order_count++;
+}
+
+/**
+ * @brief Count the software triggers of DMAC channel 0 (SWTRIGCTRL)
+ *
+ * Resets of the DMAC (CTRL.SWRST) and of the channel (CHCTRLA.SWRST) end
+ * immediately.
+ */
+static void hook(u32 reg, u32 value, int size)
+{
+	(void)size;
+	if ((reg == DMAC_ADDR + 0x10) && (value & 1))
+		triggers++;
+	if ((reg == DMAC_ADDR + 0x00) && (value & 1))
+		hw_set16(DMAC_ADDR + 0x00, 0);
+	if ((reg == DMAC_ADDR + 0x40) && (value & 1))
+		hw_set8(DMAC_ADDR + 0x40, 0);
+}
+
+/**
+ * @brief Prepare a chain of 3 copies : word, halfword and byte aligned
+ *
+ * The middle item has no callback, the last one has a length of 0.
+ */
+static void chain(dma_xfer *x, int count)
+{
+	static const int off[4] = { 0, 2, 1, 0 };
+	static const int len[4] = { 64, 30, 17, 0 };
+	int i;
+
+	for (i = 0; i < 256; i++)
+	{
+		src[i] = i ^ 0x5A;
+		dst[i] = 0;
+	}
+	for (i = 0; i < count; i++)
+	{
+		x[i].dst = dst + (i * 64) + off[i & 3];
+		x[i].src = src + (i * 64) + off[i & 3];
+		x[i].len = len[i & 3];
+		x[i].complete = (i == 1) ? 0 : complete;
+		x[i].priv = 0;
+		x[i].next = (i + 1 < count) ? &x[i + 1] : 0;
+	}
+	hw_reset();
+	hw_write_hook = hook;
+#ifdef USE_DMA
+	dma_init();
+#endif
+	order_count = 0;
+	triggers = 0;
+}
+
+/**
+ * @brief Test that the datas of a chain have been copied (and only them)
+ */
+static int copied(dma_xfer *x, int count)
+{
+	int i, j;
+
+	for (i = 0; i < count; i++)
+	{
+		u8 *d = (u8 *)x[i].dst;
+		const u8 *s = (const u8 *)x[i].src;
+		for (j = 0; j < x[i].len; j++)
+			if (d[j] != s[j])
+				return(0);
+		/* Byte after the copy must not be modified */
+		if (d[x[i].len] != 0)
+			return(0);
+	}
+	return(1);
+}
+
+/**
+ * @brief A copy made by CPU is complete when dma_copy() returns
+ */
+static void test_cpu(dma_xfer *x, int count)
+{
+	CHECK(dma_copy(x) == 1);
+	CHECK(copied(x, count));
+	/* Callbacks called in chain order (item 1 has no callback) */
+	CHECK(order_count == count - 1);
+	CHECK(order[0] == &x[0]);
+	CHECK(order[1] == &x[2]);
+	CHECK(triggers == 0);
+}
+
+#ifdef USE_DMA
+/**
+ * @brief Get a descriptor from its address into the DMAC RAM (or NULL)
+ */
+static dma_desc *desc_at(u32 addr)
+{
+	int i;
+
+	if (addr == (u32)dma_base)
+		return(dma_base);
+	for (i = 0; i < DMA_DESC_MAX - 1; i++)
+		if (addr == (u32)&dma_chain[i])
+			return(&dma_chain[i]);
+	return(0);
+}
+
+/**
+ * @brief Test the descriptors fetched by the DMAC for a chain of copies
+ *
+ * The first descriptor is at BASEADDR, the next ones are linked by DESCADDR.
+ * Source and destination addresses are the end of each block.
+ *
+ * @param x     Pointer to the first copy of the chain
+ * @param count Number of copies into the chain
+ * @param beat  Expected beat size of each block (0:byte 1:half 2:word)
+ */
+static void test_desc(dma_xfer *x, int count, const u32 *beat)
+{
+	dma_desc *d;
+	u32 addr;
+	int i;
+
+	CHECK(reg_rd(DMAC_ADDR + 0x38) == (u32)dma_wrb);
+	addr = reg_rd(DMAC_ADDR + 0x34);
+	for (i = 0; i < count; i++)
+	{
+		d = desc_at(addr);
+		CHECK(d != 0);
+		if (d == 0)
+			return;
+		/* VALID, BEATSIZE, SRCINC and DSTINC, STEPSIZE x1 */
+		CHECK(d->btctrl & 0x0001);
+		CHECK(((d->btctrl >> 8) & 3) == beat[i]);
+		CHECK((d->btctrl & 0x0C00) == 0x0C00);
+		CHECK((d->btctrl & 0xF000) == 0);
+		/* BLOCKACT : interrupt on the last block only */
+		CHECK(((d->btctrl >> 3) & 3) == ((i == count - 1) ? 1 : 0));
+		CHECK(d->btcnt == (x[i].len >> beat[i]));
+		CHECK(d->srcaddr == (u32)x[i].src + x[i].len);
+		CHECK(d->dstaddr == (u32)x[i].dst + x[i].len);
+		addr = d->descaddr;
+	}
+	CHECK(addr == 0);
+}
+#endif
+
+int main(void)
+{
+	dma_xfer x[DMA_DESC_MAX + 1];
+
+	/* Software backend, or chain too long for DMAC descriptors */
+	chain(x, 4);
+	x[3].next = &x[4];
+	x[4].dst = dst + 250; x[4].src = src + 250; x[4].len = 4;
+	x[4].complete = complete; x[4].next = 0;
+	test_cpu(x, 5);
+	CHECK( ! dma_busy());
+	CHECK(order[3] == &x[4]);
+
+	chain(x, 3);
+#ifdef USE_DMA
+	/* Chain started on DMAC, callbacks called from interrupt */
+	CHECK(dma_copy(x) == 0);
+	CHECK(dma_busy());
+	CHECK(triggers == 1);
+	CHECK(order_count == 0);
+	{
+		static const u32 beat[3] = { 2, 1, 0 };
+		test_desc(x, 3, beat);
+	}
+	{
+		dma_xfer y[2];
+		/* DMAC is busy : second job is copied by CPU immediately */
+		y[0].dst = dst + 200; y[0].src = src + 200; y[0].len = 8;
+		y[0].complete = complete; y[0].next = &y[1];
+		y[1].dst = dst + 220; y[1].src = src + 221; y[1].len = 5;
+		y[1].complete = complete; y[1].next = 0;
+		CHECK(dma_copy(y) == 1);
+		CHECK(dma_busy());
+		CHECK(order_count == 2 && order[0] == &y[0] && order[1] == &y[1]);
+		CHECK(dst[207] == src[207] && dst[208] == 0);
+		CHECK(dst[224] == src[225] && dst[225] == 0);
+		CHECK(triggers == 1);
+		order_count = 0;
+	}
+	/* Transfer complete (TCMPL) */
+	hw_set8(DMAC_ADDR + 0x4E, 0x02);
+	dma_irq();
+	CHECK( ! dma_busy());
+	CHECK(order_count == 2);
+	CHECK(order[0] == &x[0]);
+	CHECK(order[1] == &x[2]);
+	CHECK(reg8_rd(DMAC_ADDR + 0x4E) == 0);
+
+	/* Transfer error (TERR) : copy is made by CPU from interrupt */
+	chain(x, 3);
+	CHECK(dma_copy(x) == 0);
+	CHECK( ! copied(x, 3));
+	hw_set8(DMAC_ADDR + 0x4E, 0x01);
+	dma_irq();
+	CHECK( ! dma_busy());
+	CHECK(copied(x, 3));
+	CHECK(order_count == 2);
+
+	/* Spurious interrupt, nothing pending */
+	order_count = 0;
+	dma_irq();
+	CHECK(order_count == 0);
+#else
+	test_cpu(x, 3);
+	CHECK( ! dma_busy());
+#endif
+#ifdef USE_DMA
+	printf("test_dma_hw: %s\n", test_failed ? "FAILED" : "OK");
+#else
+	printf("test_dma: %s\n", test_failed ? "FAILED" : "OK");
+#endif
+	return(test_failed != 0);
+}
+/* EOF */
@@ -0,0 +1,114 @@
+/**
+ * @file  test_ecm.c
+ * @brief Host tests of the USB ECM driver (TX of both network buffers)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "hardware.h"
+#include "hw_model.h"
+#include "libc.h"
+#include "net.h"
+#include "usb.h"
+#include "usb_ecm.h"
+
+static usb_module mod;
+static usb_class  cls;
+static network    net;
+static u8 rx_buffer[512];
+static u8 tx_buffer[512];
+
+/**
+ * @brief Stub of the network classifier : accept all frames
+ */
+int net_rx_classify(network *m, int *len)
+{
+	(void)m;
+	(void)len;
+	return(0);
+}
+
+/**
+ * @brief Simulate the host reading the pending IN packet (TRCPT1)
+ */
+static void host_in(u8 ep)
+{
+	hw_set8(USB_ADDR + 0x100 + (ep << 5) + 0x07, (1 << 1));
+	hw_set16(USB_ADDR + 0x20, (1 << ep));
+	usb_irq(&mod);
+	hw_set16(USB_ADDR + 0x20, 0);
+}
+
+static void setup(void)
+{
+	hw_reset();
+	memset(&mod, 0, sizeof(usb_module));
+	memset(&net, 0, sizeof(network));
+	net.rx_buffer = rx_buffer;
+	net.tx_buffer = tx_buffer;
+	net.driver    = &mod;
+	ecm_init(&mod, &cls);
+	cls.priv = &net;
+	mod.class->enable(&mod);
+}
+
+/**
+ * @brief A frame sent from TX buffer, then an echo from RX buffer
+ *
+ * The echo is refused while the TX request is queued and it did not modify
+ * it. Each buffer is released by its own completion.
+ */
+static void test_echo_during_tx(void)
+{
+	setup();
+	tx_buffer[12] = 0x08;
+	CHECK(ecm_tx(&mod, tx_buffer, 60) == 0);
+	CHECK(ecm_tx_busy(&mod));
+
+	/* A second frame from TX buffer is refused */
+	CHECK(ecm_tx(&mod, tx_buffer, 42) == -1);
+	CHECK(net.stats.tx_err == 1);
+	CHECK(mod.ep_status[2].queue->size == 60);
+
+	/* Echo from RX buffer uses its own request, queued after TX */
+	net.rx_state = NET_RX_TX;
+	CHECK(ecm_tx(&mod, rx_buffer, 98) == 0);
+	CHECK(mod.ep_status[2].queue->size == 60);
+	CHECK(mod.ep_status[2].queue->next->size == 98);
+	/* ... and can not be queued twice */
+	CHECK(ecm_tx(&mod, rx_buffer, 98) == -1);
+	CHECK(net.stats.tx_err == 2);
+
+	/* End of TX : ethernet header cleared, RX buffer still in flight */
+	host_in(2);
+	CHECK(tx_buffer[12] == 0);
+	CHECK(net.rx_state == NET_RX_TX);
+	CHECK(ecm_tx_busy(&mod));
+
+	/* End of echo (2 packets) : RX buffer re-armed for reception */
+	net.rx_length = 98;
+	host_in(2);
+	CHECK(net.rx_state == NET_RX_TX);
+	host_in(2);
+	CHECK(net.rx_state == NET_RX_READY);
+	CHECK(net.rx_length == 0);
+	CHECK( ! ecm_tx_busy(&mod));
+	CHECK(mod.ep_status[1].queue != 0);
+}
+
+int main(void)
+{
+	test_echo_during_tx();
+
+	printf("test_ecm: %s\n", test_failed ? "FAILED" : "OK");
+	return(test_failed != 0);
+}
+/* EOF */
@@ -0,0 +1,260 @@
+/**
+ * @file  test_libc.c
+ * @brief Host tests of memory functions (compared with reference loops)
+ *
+ * Every alignment of source and destination (0 to 7) and every length from
+ * 0 to 64 bytes are checked, with guard bytes around the destination. When
+ * started with the "bench" argument, the time of each function is printed
+ * per size class, compared with a byte loop.
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "libc.h"
+#include "types.h"
+
+/* Headers of the host C library can not be mixed with types.h */
+long clock(void);
+#define TEST_CLOCKS_PER_SEC 1000000
+
+#define GUARD 0xA5
+#define BUF_SIZE 96
+
+int test_failed;
+
+static u8 buf_a[BUF_SIZE + 2048] __attribute__((aligned(8)));
+static u8 buf_b[BUF_SIZE + 2048] __attribute__((aligned(8)));
+static u8 ref[BUF_SIZE] __attribute__((aligned(8)));
+
+/**
+ * @brief Reference copy (byte per byte, forward or backward)
+ */
+static void ref_move(u8 *d, const u8 *s, int n)
+{
+	int i;
+
+	if (d <= s)
+		for (i = 0; i < n; i++)
+			d[i] = s[i];
+	else
+		for (i = n - 1; i >= 0; i--)
+			d[i] = s[i];
+}
+
+/**
+ * @brief Fill a buffer with a pattern that depends on a seed
+ */
+static void fill(u8 *buf, int len, int seed)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (u8)((i * 7) + (seed * 13) + 1);
+}
+
+static int equal(const u8 *a, const u8 *b, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		if (a[i] != b[i])
+			return(0);
+	return(1);
+}
+
+/**
+ * @brief Test memcpy and memset : only the requested bytes are written
+ */
+static void test_copy(void)
+{
+	int da, sa, n;
+
+	for (da = 0; da < 8; da++)
+	for (sa = 0; sa < 8; sa++)
+	for (n = 0; n <= 64; n++)
+	{
+		fill(buf_a, BUF_SIZE, n);
+		bl_memset(buf_b, GUARD, BUF_SIZE);
+		bl_memset(ref,   GUARD, BUF_SIZE);
+		ref_move(ref + 8 + da, buf_a + sa, n);
+
+		CHECK(bl_memcpy(buf_b + 8 + da, buf_a + sa, n) == buf_b + 8 + da);
+		if ( ! equal(buf_b, ref, BUF_SIZE))
+		{
+			printf("  memcpy dst+%d src+%d len %d\n", da, sa, n);
+			CHECK(0);
+			return;
+		}
+	}
+
+	for (da = 0; da < 8; da++)
+	for (n = 0; n <= 64; n++)
+	{
+		int i;
+
+		for (i = 0; i < BUF_SIZE; i++)
+			buf_b[i] = ref[i] = GUARD;
+		for (i = 0; i < n; i++)
+			ref[8 + da + i] = 0x3C;
+		/* Only the low byte of the value is used */
+		CHECK(bl_memset(buf_b + 8 + da, 0x123C, n) == buf_b + 8 + da);
+		if ( ! equal(buf_b, ref, BUF_SIZE))
+		{
+			printf("  memset dst+%d len %d\n", da, n);
+			CHECK(0);
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Test memmove with overlapping buffers, in both directions
+ */
+static void test_move(void)
+{
+	int da, sa, n;
+
+	for (da = 0; da < 8; da++)
+	for (sa = 0; sa < 8; sa++)
+	for (n = 0; n <= 64; n++)
+	{
+		/* Source and destination in the same buffer, may overlap */
+		fill(buf_b, BUF_SIZE, n);
+		fill(ref,   BUF_SIZE, n);
+		ref_move(ref + 12 + da, ref + 12 + sa, n);
+		bl_memmove(buf_b + 12 + da, buf_b + 12 + sa, n);
+		if ( ! equal(buf_b, ref, BUF_SIZE))
+		{
+			printf("  memmove dst+%d src+%d len %d\n", da, sa, n);
+			CHECK(0);
+			return;
+		}
+	}
+	/* Overlap of more than one block, both directions */
+	fill(buf_b, BUF_SIZE, 1);
+	fill(ref,   BUF_SIZE, 1);
+	ref_move(ref + 4, ref + 24, 64);
+	bl_memmove(buf_b + 4, buf_b + 24, 64);
+	CHECK(equal(buf_b, ref, BUF_SIZE));
+	ref_move(ref + 24, ref + 4, 64);
+	bl_memmove(buf_b + 24, buf_b + 4, 64);
+	CHECK(equal(buf_b, ref, BUF_SIZE));
+}
+
+/**
+ * @brief Test memcmp result (sign) for a difference at each position
+ */
+static void test_cmp(void)
+{
+	int da, sa, n, pos;
+
+	for (da = 0; da < 8; da++)
+	for (sa = 0; sa < 8; sa++)
+	for (n = 0; n <= 64; n++)
+	{
+		fill(buf_a + sa, n, 3);
+		fill(buf_b + da, n, 3);
+		CHECK(bl_memcmp(buf_a + sa, buf_b + da, n) == 0);
+		for (pos = 0; pos < n; pos++)
+		{
+			int r1, r2;
+
+			buf_b[da + pos] = buf_a[sa + pos] + 1;
+			r1 = bl_memcmp(buf_a + sa, buf_b + da, n);
+			r2 = bl_memcmp(buf_b + da, buf_a + sa, n);
+			buf_b[da + pos] = buf_a[sa + pos];
+			/* The 0xFF -> 0x00 case makes the difference positive */
+			if (buf_a[sa + pos] == 0xFF)
+			{
+				r1 = -r1;
+				r2 = -r2;
+			}
+			if ((r1 >= 0) || (r2 <= 0))
+			{
+				printf("  memcmp s1+%d s2+%d len %d diff at %d\n",
+				       sa, da, n, pos);
+				CHECK(0);
+				return;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Reference byte loop, used as base line for the benchmark
+ */
+static void __attribute__((noinline)) byte_copy(u8 *d, const u8 *s, int n)
+{
+	while (n--)
+		*d++ = *s++;
+}
+
+/**
+ * @brief Print the time of memory functions per size class
+ */
+static void bench(void)
+{
+	static const int size[] = { 4, 14, 64, 512, 1514 };
+	int i, j, loops;
+	long t;
+
+	printf("  size   byte-loop      memcpy  memcpy(+2)      memset     memcmp\n");
+	for (i = 0; i < (int)(sizeof(size) / sizeof(size[0])); i++)
+	{
+		int n = size[i];
+		long r[5];
+
+		loops = 20000000 / (n + 16);
+
+		t = clock();
+		for (j = 0; j < loops; j++)
+			byte_copy(buf_b, buf_a, n);
+		r[0] = clock() - t;
+		t = clock();
+		for (j = 0; j < loops; j++)
+			bl_memcpy(buf_b, buf_a, n);
+		r[1] = clock() - t;
+		/* Halfword aligned (ethernet payload) */
+		t = clock();
+		for (j = 0; j < loops; j++)
+			bl_memcpy(buf_b + 2, buf_a + 4, n);
+		r[2] = clock() - t;
+		t = clock();
+		for (j = 0; j < loops; j++)
+			bl_memset(buf_b, j, n);
+		r[3] = clock() - t;
+		bl_memcpy(buf_b, buf_a, n);
+		t = clock();
+		for (j = 0; j < loops; j++)
+			r[4] = bl_memcmp(buf_b, buf_a, n);
+		r[4] = clock() - t;
+
+		printf("  %4d", n);
+		for (j = 0; j < 5; j++)
+			printf("  %7ld ns", (r[j] * (1000000000 / TEST_CLOCKS_PER_SEC))
+			                    / loops);
+		printf("\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	test_copy();
+	test_move();
+	test_cmp();
+
+	if ((argc > 1) && (argv[1][0] == 'b'))
+		bench();
+
+	printf("test_libc: %s\n", test_failed ? "FAILED" : "OK");
+	return(test_failed != 0);
+}
+/* EOF */
@@ -0,0 +1,391 @@
+/**
+ * @file  test_mdns.c
+ * @brief Host tests of the mDNS responder (records, query matching)
+ *
+ * The mDNS source is included (built with USE_MDNS and USE_IPV6), so the
+ * precomputed response can be decoded. The UDP layer is replaced by stubs :
+ * queries are given to mdns_recv and the response is read back.
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "../net_mdns.c"
+
+#define LOCAL_IP 0x0A000001
+#define HOST     "cowstick-70b3d54ce801"
+
+int test_failed;
+
+static network net;
+static tcp_service services[3];
+static u8 rx_buffer[512];
+/* Response sent by the responder, its size (0 if none) and destination */
+static u8 tx[MDNS_TPL_SIZE];
+static int tx_len;
+static udp_conn tx_conn;
+static int reply_count;
+
+/* -- Stubs of UDP layer --------------------------------------------------- */
+
+u16 htons(u16 v)
+{
+	return((u16)((v >> 8) | (v << 8)));
+}
+
+u32 htonl(u32 v)
+{
+	return((v >> 24) | ((v >> 8) & 0xFF00) |
+	       ((v << 8) & 0xFF0000) | (v << 24));
+}
+
+int udp4_bind(network *mod, udp_socket *sock, u16 port)
+{
+	sock->netif = mod;
+	sock->port  = port;
+	return(0);
+}
+
+void udp4_reply_init(network *mod, udp_conn *conn, udp_packet *req)
+{
+	(void)mod;
+	conn->family      = NET_AF_INET;
+	conn->ip_remote   = 0x0A000002;
+	conn->port_local  = req->dst_port;
+	conn->port_remote = req->src_port;
+	conn->rsp = 0;
+	reply_count++;
+}
+
+u8 *udp4_tx_buffer(network *mod, udp_conn *conn)
+{
+	(void)mod;
+	(void)conn;
+	return(tx);
+}
+
+void udp4_send(network *mod, udp_conn *conn, int len)
+{
+	(void)mod;
+	tx_conn = *conn;
+	tx_len  = len;
+}
+
+/* -- Helpers -------------------------------------------------------------- */
+
+static void setup(void)
+{
+	static const u8 mac[6] = {0x70, 0xB3, 0xD5, 0x4C, 0xE8, 0x01};
+	int i;
+
+	memset(&net, 0, sizeof(network));
+	memset(services, 0, sizeof(services));
+	memcpy(net.mac, mac, 6);
+	net.ip_local = LOCAL_IP;
+	for (i = 0; i < 16; i++)
+		net.ip6_local[i] = (i == 0) ? 0xFE : (i == 1) ? 0x80 : i;
+	net.rx_buffer = rx_buffer;
+	/* Two services announced, one hidden */
+	services[0].port = 80;
+	services[0].name = "http";
+	services[1].port = 22;
+	services[2].port = 8023;
+	services[2].name = "telnet";
+	net.tcp.services = services;
+	net.tcp.service_count = 3;
+	mdns_init(&net);
+}
+
+static u16 get16(const u8 *p)
+{
+	return((p[0] << 8) | p[1]);
+}
+
+/**
+ * @brief Compare a name of the response with a dotted string
+ *
+ * @param m   Pointer to the message
+ * @param off Offset of the name (may use compression)
+ * @param s   Expected name (ex: "host.local")
+ * @return integer Offset after the name (at its place), or -1 if different
+ */
+static int name_is(const u8 *m, int off, const char *s)
+{
+	int end = -1;
+	int i;
+
+	while (1)
+	{
+		if ((m[off] & 0xC0) == 0xC0)
+		{
+			if (end < 0)
+				end = off + 2;
+			off = get16(m + off) & 0x3FFF;
+			continue;
+		}
+		if (m[off] == 0)
+			break;
+		for (i = 0; i < m[off]; i++)
+			if (s[i] != (char)m[off + 1 + i])
+				return(-1);
+		s += m[off];
+		off += m[off] + 1;
+		if (*s == '.')
+			s++;
+		else if (*s != 0)
+			return(-1);
+		else if (m[off] != 0)
+			return(-1);
+	}
+	if (*s != 0)
+		return(-1);
+	return((end < 0) ? off + 1 : end);
+}
+
+/**
+ * @brief Check the next record of the response
+ *
+ * @param off   Offset of the record, updated to the next one
+ * @param name  Expected name
+ * @param type  Expected type
+ * @param class Expected class
+ * @return Pointer to the datas of the record, or 0 if different
+ */
+static const u8 *record(int *off, const char *name, u16 type, u16 class)
+{
+	const u8 *m = mdns_tpl;
+	int p;
+
+	p = name_is(m, *off, name);
+	if ((p < 0) || (get16(m + p) != type) || (get16(m + p + 2) != class) ||
+	    (get16(m + p + 4) != 0) || (get16(m + p + 6) != MDNS_TTL))
+		return(0);
+	*off = p + 10 + get16(m + p + 8);
+	return(m + p + 10);
+}
+
+/**
+ * @brief Give a query to the responder
+ *
+ * @param port Source port of the query
+ * @param msg  Pointer to the DNS message
+ * @param len  Size of the message (checked by UDP layer)
+ * @return integer Size of the response, 0 if none
+ */
+static int query(u16 port, const u8 *msg, int len)
+{
+	udp_packet *udp = (udp_packet *)(rx_buffer + 14 + 20);
+
+	memset(rx_buffer, 0, sizeof(rx_buffer));
+	rx_buffer[14] = 0x45;
+	udp->src_port = htons(port);
+	udp->dst_port = htons(MDNS_PORT);
+	udp->length   = htons(8 + len);
+	memcpy(rx_buffer + 14 + 20 + 8, msg, len);
+	tx_len = 0;
+	reply_count = 0;
+	mdns_sock.recv(&mdns_sock, udp, (ip_dgram *)(rx_buffer + 14), len);
+	return(tx_len);
+}
+
+/**
+ * @brief Write a question (name from a dotted string, type A, class IN)
+ *
+ * @param p Pointer to the output buffer
+ * @param s Name (ex: "host.local")
+ * @return Pointer to the next byte after the question
+ */
+static u8 *question(u8 *p, const char *s)
+{
+	u8 *label = p++;
+
+	for ( ; *s; s++)
+	{
+		if (*s == '.')
+		{
+			*label = (p - label - 1);
+			label = p++;
+		}
+		else
+			*p++ = *s;
+	}
+	*label = (p - label - 1);
+	*p++ = 0;
+	p = put16(p, MDNS_TYPE_A);
+	return(put16(p, MDNS_CLASS_IN));
+}
+
+/* -- Tests ---------------------------------------------------------------- */
+
+/**
+ * @brief Records of the precomputed response
+ */
+static void test_records(void)
+{
+	const u8 *d;
+	int off;
+
+	setup();
+	CHECK(mdns_tpl[2] == 0x84);
+	CHECK(get16(mdns_tpl + 4) == 0);
+	CHECK(get16(mdns_tpl + 6) == 2 + (2 * 4));
+	CHECK(mdns_name_count == 1 + (2 * 2) + 1);
+
+	off = 12;
+	d = record(&off, HOST ".local", MDNS_TYPE_A, MDNS_CLASS_FLUSH);
+	CHECK(d && (get16(d - 2) == 4) && (get16(d) == 0x0A00) &&
+	      (get16(d + 2) == 0x0001));
+	d = record(&off, HOST ".local", MDNS_TYPE_AAAA, MDNS_CLASS_FLUSH);
+	CHECK(d && (get16(d - 2) == 16) && (memcmp(d, net.ip6_local, 16) == 0));
+
+	/* First service, types enumeration then PTR, SRV and TXT */
+	d = record(&off, "_services._dns-sd._udp.local", MDNS_TYPE_PTR,
+	           MDNS_CLASS_IN);
+	CHECK(d && (name_is(mdns_tpl, d - mdns_tpl, "_http._tcp.local") > 0));
+	d = record(&off, "_http._tcp.local", MDNS_TYPE_PTR, MDNS_CLASS_IN);
+	CHECK(d && (name_is(mdns_tpl, d - mdns_tpl,
+	                    HOST "._http._tcp.local") > 0));
+	d = record(&off, HOST "._http._tcp.local", MDNS_TYPE_SRV,
+	           MDNS_CLASS_FLUSH);
+	CHECK(d && (get16(d) == 0) && (get16(d + 2) == 0) &&
+	      (get16(d + 4) == 80));
+	CHECK(d && (name_is(mdns_tpl, d + 6 - mdns_tpl, HOST ".local") > 0));
+	d = record(&off, HOST "._http._tcp.local", MDNS_TYPE_TXT,
+	           MDNS_CLASS_FLUSH);
+	CHECK(d && (get16(d - 2) == 1) && (d[0] == 0));
+
+	/* Second service (the hidden one is not announced) */
+	d = record(&off, "_services._dns-sd._udp.local", MDNS_TYPE_PTR,
+	           MDNS_CLASS_IN);
+	CHECK(d && (name_is(mdns_tpl, d - mdns_tpl, "_telnet._tcp.local") > 0));
+	d = record(&off, "_telnet._tcp.local", MDNS_TYPE_PTR, MDNS_CLASS_IN);
+	CHECK(d != 0);
+	d = record(&off, HOST "._telnet._tcp.local", MDNS_TYPE_SRV,
+	           MDNS_CLASS_FLUSH);
+	CHECK(d && (get16(d + 4) == 8023));
+	d = record(&off, HOST "._telnet._tcp.local", MDNS_TYPE_TXT,
+	           MDNS_CLASS_FLUSH);
+	CHECK(d != 0);
+	CHECK(off == mdns_tpl_len);
+}
+
+/**
+ * @brief Queries for our names, multicast and legacy responses
+ */
+static void test_query(void)
+{
+	u8 msg[128];
+	u8 *p;
+
+	setup();
+	memset(msg, 0, sizeof(msg));
+	msg[0] = 0x12; msg[1] = 0x34;
+	msg[5] = 1;
+	p = question(msg + 12, HOST ".local");
+	CHECK(query(MDNS_PORT, msg, p - msg) == mdns_tpl_len);
+	CHECK(reply_count == 0);
+	CHECK(tx_conn.ip_remote == MDNS_IP4);
+	CHECK(tx_conn.port_remote == htons(MDNS_PORT));
+	CHECK(memcmp(tx, mdns_tpl, mdns_tpl_len) == 0);
+
+	/* Legacy query : response to the sender, with the ID */
+	CHECK(query(40000, msg, p - msg) == mdns_tpl_len);
+	CHECK(reply_count == 1);
+	CHECK(tx_conn.port_remote == htons(40000));
+	CHECK((tx[0] == 0x12) && (tx[1] == 0x34));
+	CHECK(memcmp(tx + 2, mdns_tpl + 2, mdns_tpl_len - 2) == 0);
+
+	/* Case is ignored, services names are matched */
+	p = question(msg + 12, "COWSTICK-70B3D54CE801.Local");
+	CHECK(query(MDNS_PORT, msg, p - msg) != 0);
+	p = question(msg + 12, "_telnet._tcp.local");
+	CHECK(query(MDNS_PORT, msg, p - msg) != 0);
+	p = question(msg + 12, "_services._dns-sd._udp.local");
+	CHECK(query(MDNS_PORT, msg, p - msg) != 0);
+
+	/* Other names */
+	p = question(msg + 12, "cowstick-70b3d54ce802.local");
+	CHECK(query(MDNS_PORT, msg, p - msg) == 0);
+	p = question(msg + 12, "_ssh._tcp.local");
+	CHECK(query(MDNS_PORT, msg, p - msg) == 0);
+	p = question(msg + 12, HOST);
+	CHECK(query(MDNS_PORT, msg, p - msg) == 0);
+
+	/* Responses and other opcodes are ignored */
+	p = question(msg + 12, HOST ".local");
+	msg[2] = 0x84;
+	CHECK(query(MDNS_PORT, msg, p - msg) == 0);
+	msg[2] = 0x08;
+	CHECK(query(MDNS_PORT, msg, p - msg) == 0);
+}
+
+/**
+ * @brief Compressed names, second question, malformed messages
+ */
+static void test_compressed(void)
+{
+	u8 msg[128];
+	u8 *p, *q;
+	int len;
+
+	setup();
+	/* Question for another name, then our name pointing to ".local" */
+	memset(msg, 0, sizeof(msg));
+	msg[5] = 2;
+	p = question(msg + 12, "printer.local");
+	q = p;
+	*p++ = 21;
+	memcpy(p, HOST, 21);
+	p += 21;
+	p = put16(p, 0xC000 | (12 + 8));
+	p = put16(p, MDNS_TYPE_A);
+	p = put16(p, MDNS_CLASS_IN);
+	len = p - msg;
+	CHECK(query(MDNS_PORT, msg, len) == mdns_tpl_len);
+	/* Only one question counted */
+	msg[5] = 1;
+	CHECK(query(MDNS_PORT, msg, len) == 0);
+	msg[5] = 2;
+
+	/* Message shorter than the datagram : second question is ignored */
+	CHECK(query(MDNS_PORT, msg, q - msg) == 0);
+	CHECK(query(MDNS_PORT, msg, len - 5) == 0);
+	CHECK(query(MDNS_PORT, msg, 11) == 0);
+
+	/* Pointer loop into the first question */
+	put16(msg + 12 + 8, 0xC000 | (12 + 8));
+	msg[5] = 1;
+	CHECK(query(MDNS_PORT, msg, len) == 0);
+	msg[5] = 2;
+	CHECK(query(MDNS_PORT, msg, len) == 0);
+
+	/* Reserved label types (0x40, 0x80) into the first question */
+	question(msg + 12, "printer.local");
+	msg[12] = 0x47;
+	CHECK(mdns_name_end(msg, len, 12) == -1);
+	CHECK(query(MDNS_PORT, msg, len) == 0);
+	msg[12] = 0x87;
+	CHECK(mdns_name_end(msg, len, 12) == -1);
+	CHECK(query(MDNS_PORT, msg, len) == 0);
+	msg[12] = 7;
+	CHECK(mdns_name_end(msg, len, 12) == 12 + 15);
+	CHECK(query(MDNS_PORT, msg, len) == mdns_tpl_len);
+}
+
+int main(void)
+{
+	test_records();
+	test_query();
+	test_compressed();
+
+	printf("test_mdns: %s\n", test_failed ? "FAILED" : "OK");
+	return(test_failed != 0);
+}
+/* EOF */
@@ -0,0 +1,218 @@
+/**
+ * @file  test_net.c
+ * @brief Host tests of the frame classifier and IP lengths checks
+ *
+ * The network source is included, so the static classifier can be tested.
+ * Lower (ECM) and upper (ARP, IPv4) layers are replaced by stubs, IPv6 is
+ * linked (built with USE_IPV6).
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "../net.c"
+
+int test_failed;
+
+static network net;
+static u8 rx_buffer[512];
+static u8 tx_buffer[512];
+/* Length given to the upper layer (TCP or UDP), -1 if not called */
+static int tcp_len;
+static int ecm_result;
+
+/* -- Stubs of other layers ------------------------------------------------ */
+
+void arp_init(network *mod)                      { (void)mod; }
+void arp_learn(network *mod, u32 ip, const u8 *mac)   { (void)mod; (void)ip; (void)mac; }
+int  arp_periodic(network *mod)                  { (void)mod; return(0); }
+void arp_receive(network *mod, u8 *b, int len)   { (void)mod; (void)b; (void)len; }
+void ipv4_init(network *mod)                     { (void)mod; }
+void ipv4_receive(network *mod, u8 *b, int len)  { (void)mod; (void)b; (void)len; }
+void ecm_rx_prepare(usb_module *mod)             { (void)mod; }
+int  ecm_tx_busy(usb_module *mod)                { (void)mod; return(0); }
+int  icmp_allow(network *mod)                    { (void)mod; return(1); }
+void udp4_receive(network *mod, udp_packet *pkt, ip_dgram *ip, int len)
+{
+	(void)mod; (void)pkt; (void)ip;
+	tcp_len = len;
+}
+
+int ecm_tx(usb_module *mod, u8 *buffer, u32 size)
+{
+	(void)mod; (void)buffer; (void)size;
+	return(ecm_result);
+}
+
+void tcp4_receive(network *mod, tcp_packet *pkt, int len)
+{
+	(void)mod; (void)pkt;
+	tcp_len = len;
+}
+
+u16 ip_cksum(u32 sum, const u8 *data, u16 len)
+{
+	int i;
+
+	for (i = 0; (i + 1) < len; i += 2)
+		sum += (data[i] << 8) | data[i + 1];
+	if (len & 1)
+		sum += data[len - 1] << 8;
+	while (sum >> 16)
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	return((u16)sum);
+}
+
+u16 ip_cksum_adjust(u16 cksum, u16 old, u16 new)
+{
+	(void)old; (void)new;
+	return(cksum);
+}
+
+/* -- Helpers -------------------------------------------------------------- */
+
+static void setup(void)
+{
+	memset(&net, 0, sizeof(network));
+	memset(rx_buffer, 0, sizeof(rx_buffer));
+	net.rx_buffer = rx_buffer;
+	net.tx_buffer = tx_buffer;
+	memcpy(net.mac, cfg_mac, 6);
+	net.ip_local  = 0x0A000001;
+	ipv6_init(&net);
+}
+
+/**
+ * @brief Build an IPv4/UDP frame for our address into RX buffer
+ *
+ * @param iplen Value of the IP length field
+ */
+static void ipv4_frame(int iplen)
+{
+	eth_frame *eth = (eth_frame *)rx_buffer;
+	ip_dgram  *ip  = (ip_dgram *)(rx_buffer + 14);
+
+	memcpy(eth->dst, net.mac, 6);
+	eth->proto = htons(0x0800);
+	ip->vihl   = 0x45;
+	ip->length = htons(iplen);
+	ip->ttl    = 64;
+	ip->proto  = IP_PROTO_UDP;
+	ip->src    = htonl(0x0A000002);
+	ip->dst    = htonl(net.ip_local);
+	ip->cksum  = 0;
+	ip->cksum  = htons(~ip_cksum(0, (u8 *)ip, 20));
+}
+
+/* -- Tests ---------------------------------------------------------------- */
+
+/**
+ * @brief IPv4 length must cover the header and fit into the frame
+ */
+static void test_ipv4_length(void)
+{
+	int len;
+
+	setup();
+	/* Valid datagram, ethernet padding removed */
+	ipv4_frame(20 + 8 + 10);
+	len = 14 + 60;
+	CHECK(net_rx_classify(&net, &len) == NET_FLOW_IPV4_UDP);
+	CHECK(len == 14 + 38);
+	/* Datagram as long as the frame */
+	len = 14 + 38;
+	CHECK(net_rx_classify(&net, &len) == NET_FLOW_IPV4_UDP);
+
+	/* Length larger than the received bytes (valid checksum) */
+	ipv4_frame(400);
+	len = 14 + 60;
+	CHECK(net_rx_classify(&net, &len) == NET_DROP_RUNT);
+	CHECK(len == 14 + 60);
+	ipv4_frame(20 + 8 + 11);
+	len = 14 + 38;
+	CHECK(net_rx_classify(&net, &len) == NET_DROP_RUNT);
+	/* Length smaller than the header */
+	ipv4_frame(19);
+	len = 14 + 60;
+	CHECK(net_rx_classify(&net, &len) == NET_DROP_RUNT);
+	ipv4_frame(0);
+	CHECK(net_rx_classify(&net, &len) == NET_DROP_RUNT);
+	CHECK(net.stats.rx_drop[-NET_DROP_RUNT - 1] == 4);
+}
+
+/**
+ * @brief IPv6 payload length is checked before upper layers
+ */
+static void test_ipv6_length(void)
+{
+	eth_frame *eth = (eth_frame *)rx_buffer;
+	ip6_dgram *ip  = (ip6_dgram *)(rx_buffer + 14);
+	int len;
+
+	setup();
+	memcpy(eth->dst, net.mac, 6);
+	eth->proto = htons(0x86DD);
+	rx_buffer[14] = 0x60;
+	ip->next = IP_PROTO_TCP;
+	memcpy(ip->dst, net.ip6_local, 16);
+	ip->length = htons(20);
+	len = 14 + 40 + 20;
+	CHECK(net_rx_classify(&net, &len) == NET_FLOW_IPV6);
+	ip->length = htons(21);
+	CHECK(net_rx_classify(&net, &len) == NET_DROP_RUNT);
+
+	/* Receive function checks the length it is given */
+	tcp_len = -1;
+	ip->length = htons(20);
+	ipv6_receive(&net, rx_buffer + 14, 40 + 20);
+	CHECK(tcp_len == 20);
+	tcp_len = -1;
+	ip->length = htons(400);
+	ipv6_receive(&net, rx_buffer + 14, 40 + 20);
+	CHECK(tcp_len == -1);
+	ipv6_receive(&net, rx_buffer + 14, 30);
+	CHECK(tcp_len == -1);
+	CHECK(net.stats.ip6_drop == 2);
+	ip->next   = IP_PROTO_UDP;
+	ip->length = htons(12);
+	ipv6_receive(&net, rx_buffer + 14, 40 + 20);
+	CHECK(tcp_len == 12);
+}
+
+/**
+ * @brief A frame refused by the driver releases the TX buffer
+ */
+static void test_send_refused(void)
+{
+	eth_frame *eth = (eth_frame *)tx_buffer;
+
+	setup();
+	net_tx_buffer(&net, 0x0800);
+	ecm_result = -1;
+	net_send(&net, 40);
+	CHECK(eth->proto == 0);
+	CHECK(net.stats.tx_frames == 0 && net.stats.tx_bytes == 0);
+	net_tx_buffer(&net, 0x0800);
+	ecm_result = 0;
+	net_send(&net, 40);
+	CHECK(eth->proto == htons(0x0800));
+	CHECK(net.stats.tx_frames == 1 && net.stats.tx_bytes == 54);
+}
+
+int main(void)
+{
+	test_ipv4_length();
+	test_ipv6_length();
+	test_send_refused();
+
+	printf("test_net: %s\n", test_failed ? "FAILED" : "OK");
+	return(test_failed != 0);
+}
+/* EOF */
@@ -0,0 +1,774 @@
+/**
+ * @file  test_tcp.c
+ * @brief Host tests of TCP retransmission (RTO, backoff, dup ACK, SYN, FIN)
+ *
+ * The IPv4 source is included, so static functions can be tested. The
+ * network layer and the timers are replaced by stubs : sent segments are
+ * decoded from the TX buffer, the peer segments are written into the RX
+ * buffer and the clock is moved by the test (no real time, no TAP).
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "../net_ipv4.c"
+
+#define LOCAL_IP 0x0A000001
+#define PEER_IP  0x0A000002
+#define PEER_ISN 0x40000000
+
+int test_failed;
+
+static network    net;
+static tcp_conn   conns[2];
+static tcp_service svc;
+static u8 rx_buffer[512];
+static u8 tx_buffer[512];
+
+/* Segments sent by the stack (flags, sequence, length of datas) */
+typedef struct
+{
+	u8  flags;
+	u32 seq;
+	u32 ack;
+	int len;
+	u8  data[4];
+} segment;
+static segment sent[32];
+static int sent_count;
+/* When set, TX buffer stays used after a send (frame not sent by USB) */
+static int tx_hold;
+/* Clock of the stub timers (ms), moved on each read when clock_run is set */
+static u32 now;
+static int clock_run;
+static int closed_count;
+
+/* -- Stubs of network layer and timers ------------------------------------ */
+
+u16 htons(u16 v)
+{
+	return((u16)((v >> 8) | (v << 8)));
+}
+
+u32 htonl(u32 v)
+{
+	return((v >> 24) | ((v >> 8) & 0xFF00) |
+	       ((v << 8) & 0xFF0000) | (v << 24));
+}
+
+u8 *net_tx_buffer(network *mod, u16 proto)
+{
+	if (proto != 0)
+		((eth_frame *)mod->tx_buffer)->proto = htons(proto);
+	return(mod->tx_buffer + 14);
+}
+
+void net_send(network *mod, u32 size)
+{
+	tcp_packet *pkt = (tcp_packet *)(mod->tx_buffer + 14 + 20);
+	segment *s = &sent[sent_count & 31];
+
+	s->flags = pkt->flags;
+	s->seq   = htonl(pkt->seq);
+	s->ack   = htonl(pkt->ack);
+	s->len   = size - 20 - ((pkt->offset >> 2) & 0x3C);
+	memcpy(s->data, (u8 *)pkt + 20, 4);
+	sent_count++;
+	/* Frame sent immediately by the driver */
+	if ( ! tx_hold)
+		((eth_frame *)mod->tx_buffer)->proto = 0;
+}
+
+void net_send_rx(network *mod, u32 size)
+{
+	(void)mod;
+	(void)size;
+}
+
+int net_tx_busy(network *mod)
+{
+	(void)mod;
+	return(0);
+}
+
+int arp_resolve(network *mod, u32 ip, u8 *frame)
+{
+	(void)mod;
+	(void)ip;
+	(void)frame;
+	return(0);
+}
+
+void arp_hold(network *mod, u32 ip, int len)
+{
+	(void)mod;
+	(void)ip;
+	(void)len;
+}
+
+void dhcp_init(network *netif)
+{
+	(void)netif;
+}
+
+u32 timer_now(void)
+{
+	if (clock_run)
+		now++;
+	return(now);
+}
+
+u32 timer_cycles(void)
+{
+	return(now * 48000);
+}
+
+void timer_arm(timer *tmr, u32 delay)
+{
+	tmr->expire = now + delay;
+	tmr->armed  = 1;
+}
+
+void timer_cancel(timer *tmr)
+{
+	tmr->armed = 0;
+}
+
+/**
+ * @brief Move the clock (1 ms steps), and call handlers of expired timers
+ */
+static void advance(u32 ms)
+{
+	int i;
+
+	while (ms--)
+	{
+		now++;
+		for (i = 0; i < 2; i++)
+		{
+			timer *tmr = &conns[i].rtx_tmr;
+			if (tmr->armed && ((int)(now - tmr->expire) >= 0))
+			{
+				tmr->armed = 0;
+				tmr->handler(tmr);
+			}
+		}
+	}
+}
+
+/* -- Peer side ------------------------------------------------------------ */
+
+static int svc_process(tcp_conn *conn, u8 *data, int len)
+{
+	(void)conn;
+	(void)data;
+	(void)len;
+	return(0);
+}
+
+static int svc_closed(tcp_conn *conn)
+{
+	(void)conn;
+	closed_count++;
+	return(0);
+}
+
+/**
+ * @brief Receive a segment from the peer
+ *
+ * @param flags TCP flags
+ * @param seq   Sequence number of the peer
+ * @param ack   Acknowledged sequence number
+ * @param dlen  Number of datas into the segment
+ */
+static void peer(u8 flags, u32 seq, u32 ack, int dlen)
+{
+	ip_dgram   *ip  = (ip_dgram *)(rx_buffer + 14);
+	tcp_packet *pkt = (tcp_packet *)(rx_buffer + 14 + 20);
+
+	memset(rx_buffer, 0, sizeof(rx_buffer));
+	ip->vihl   = 0x45;
+	ip->proto  = IP_PROTO_TCP;
+	ip->length = htons(20 + 20 + dlen);
+	ip->src    = htonl(PEER_IP);
+	ip->dst    = htonl(LOCAL_IP);
+	pkt->src_port = htons(80);
+	pkt->dst_port = htons(conns[0].port_local);
+	pkt->seq    = htonl(seq);
+	pkt->ack    = htonl(ack);
+	pkt->offset = 0x50;
+	pkt->flags  = flags;
+	tcp4_receive(&net, pkt, 20 + dlen);
+}
+
+static void setup(void)
+{
+	memset(&net,  0, sizeof(network));
+	memset(conns, 0, sizeof(conns));
+	memset(&svc,  0, sizeof(tcp_service));
+	net.rx_buffer = rx_buffer;
+	net.tx_buffer = tx_buffer;
+	net.ip_local  = LOCAL_IP;
+	net.ip_remote = PEER_IP;
+	net.tcp.conns = conns;
+	net.tcp.conn_count = 2;
+	net.tcp.services = &svc;
+	net.tcp.service_count = 1;
+	svc.port    = 80;
+	svc.process = svc_process;
+	svc.closed  = svc_closed;
+	memset(tx_buffer, 0, sizeof(tx_buffer));
+	now = 1000;
+	ipv4_init(&net);
+	sent_count   = 0;
+	closed_count = 0;
+	tx_hold      = 0;
+	clock_run    = 0;
+}
+
+/**
+ * @brief Open a connection to the peer (SYN, SYN-ACK, ACK)
+ */
+static tcp_conn *connect(void)
+{
+	u32 addr = PEER_IP;
+	tcp_conn *conn;
+
+	conn = tcp4_connect(&net, NET_AF_INET, &addr, &svc);
+	CHECK(conn == &conns[0]);
+	now += 50;
+	peer(TCP_SYN | TCP_ACK, PEER_ISN, conn->seq_local, 0);
+	CHECK(conn->state == TCP_CONN_ESTABLISHED);
+	sent_count = 0;
+	return(conn);
+}
+
+/**
+ * @brief Send datas on a connection (bytes 0, 1, 2 ...)
+ */
+static void send_data(tcp_conn *conn, int len)
+{
+	u8 *data = tcp4_tx_buffer(conn);
+	int i;
+
+	for (i = 0; i < len; i++)
+		data[i] = (u8)i;
+	tcp4_send(conn, len);
+}
+
+/* -- Tests ---------------------------------------------------------------- */
+
+/**
+ * @brief RTT estimator : first sample, smoothing and limits
+ */
+static void test_rtt(void)
+{
+	tcp_conn *conn = &conns[0];
+	int i;
+
+	setup();
+	CHECK(conn->rto == TCP_RTO_INIT);
+	tcp4_rtt(conn, 100);
+	CHECK(conn->srtt == 800 && conn->rttvar == 200);
+	CHECK(conn->rto == 300);
+	tcp4_rtt(conn, 100);
+	CHECK(conn->srtt == 800 && conn->rttvar == 150);
+	CHECK(conn->rto == 250);
+	tcp4_rtt(conn, 180);
+	CHECK(conn->srtt == 880 && conn->rttvar == 193);
+	CHECK(conn->rto == 303);
+	/* Limits */
+	for (i = 0; i < 50; i++)
+		tcp4_rtt(conn, 0);
+	CHECK(conn->rto == TCP_RTO_MIN);
+	tcp4_rtx_reset(conn);
+	tcp4_rtt(conn, 60000);
+	CHECK(conn->rto == TCP_RTO_MAX);
+}
+
+/**
+ * @brief SYN of an active open : timed, retransmitted, Karn
+ */
+static void test_syn(void)
+{
+	u32 addr = PEER_IP;
+	tcp_conn *conn;
+
+	setup();
+	conn = tcp4_connect(&net, NET_AF_INET, &addr, &svc);
+	CHECK(sent_count == 1 && sent[0].flags == TCP_SYN);
+	CHECK(conn->rtx_tmr.armed && conn->rtx_tmr.expire == now + 1000);
+
+	/* SYN-ACK received after 120 ms : first RTT sample */
+	now += 120;
+	peer(TCP_SYN | TCP_ACK, PEER_ISN, conn->seq_local, 0);
+	CHECK(conn->state == TCP_CONN_ESTABLISHED);
+	CHECK(conn->srtt == 120 * 8);
+	CHECK( ! conn->rtx_tmr.armed);
+
+	/* SYN lost once : sent again, timeout doubled, no RTT sample */
+	setup();
+	conn = tcp4_connect(&net, NET_AF_INET, &addr, &svc);
+	advance(999);
+	CHECK(sent_count == 1);
+	advance(1);
+	CHECK(sent_count == 2 && sent[1].flags == TCP_SYN);
+	CHECK(sent[1].seq == sent[0].seq);
+	CHECK(conn->rto == 2000 && conn->rtx_count == 1);
+	CHECK(net.stats.tcp_rto == 1);
+	now += 30;
+	peer(TCP_SYN | TCP_ACK, PEER_ISN, conn->seq_local, 0);
+	CHECK(conn->state == TCP_CONN_ESTABLISHED);
+	CHECK(conn->srtt == 0);
+	CHECK(conn->rtx_count == 0);
+
+	/* No answer : connection dropped after TCP_RTX_RETRIES timeouts */
+	setup();
+	conn = tcp4_connect(&net, NET_AF_INET, &addr, &svc);
+	advance(1000 + 2000 + 4000 + 8000 + 8000 + 8000);
+	CHECK(conn->rtx_count == TCP_RTX_RETRIES && sent_count == 7);
+	CHECK(conn->ip_remote != 0);
+	advance(8000);
+	CHECK(conn->ip_remote == 0 && conn->state == TCP_CONN_CLOSED);
+	CHECK(sent_count == 7);
+	CHECK(closed_count == 1);
+}
+
+/**
+ * @brief Datas : timeout, backoff, buffer trimmed by a partial ACK
+ */
+static void test_data(void)
+{
+	tcp_conn *conn;
+	u32 seq;
+
+	setup();
+	conn = connect();
+	seq = conn->seq_local;
+	/* Known estimator state : one sample of 100 ms */
+	tcp4_rtx_reset(conn);
+	tcp4_rtt(conn, 100);
+	CHECK(conn->rto == 300);
+
+	send_data(conn, 100);
+	CHECK(sent_count == 1 && sent[0].len == 100 && sent[0].seq == seq);
+	CHECK(conn->rtx_len == 100 && conn->rtt_timing);
+	CHECK(conn->rtx_tmr.armed && conn->rtx_tmr.expire == now + 300);
+
+	/* Timeout : oldest datas sent again, RTO doubled, timing cancelled */
+	advance(300);
+	CHECK(sent_count == 2 && sent[1].seq == seq && sent[1].len == 100);
+	CHECK(conn->rto == 600 && ! conn->rtt_timing);
+	advance(600);
+	CHECK(sent_count == 3 && conn->rto == 1200 && conn->rtx_count == 2);
+
+	/* Partial ACK : buffer trimmed, no RTT sample (Karn), timer restarted */
+	now += 10;
+	peer(TCP_ACK, PEER_ISN + 1, seq + 40, 0);
+	CHECK(conn->seq_acked == seq + 40 && conn->rtx_len == 60);
+	CHECK(conn->rtx_buf[0] == 40 && conn->rtx_buf[59] == 99);
+	CHECK(conn->rtx_count == 0 && conn->srtt == 800);
+	CHECK(conn->rtx_tmr.armed && conn->rtx_tmr.expire == now + 1200);
+	advance(1200);
+	CHECK(sent_count == 4 && sent[3].seq == seq + 40 && sent[3].len == 60);
+	CHECK(sent[3].data[0] == 40);
+
+	/* Old ACK is ignored, full ACK stops the timer */
+	peer(TCP_ACK, PEER_ISN + 1, seq + 20, 0);
+	CHECK(conn->rtx_len == 60);
+	peer(TCP_ACK, PEER_ISN + 1, seq + 100, 0);
+	CHECK(conn->rtx_len == 0 && ! conn->rtx_tmr.armed);
+
+	/* New segment is timed : RTT sample on its ACK */
+	send_data(conn, 10);
+	now += 200;
+	peer(TCP_ACK, PEER_ISN + 1, seq + 110, 0);
+	CHECK(conn->srtt == 800 + (200 - 100));
+}
+
+/**
+ * @brief Third duplicate ACK triggers one fast retransmit
+ */
+static void test_dupack(void)
+{
+	tcp_conn *conn;
+	u32 seq;
+
+	setup();
+	conn = connect();
+	seq = conn->seq_local;
+	send_data(conn, 100);
+	send_data(conn, 100);
+	CHECK(conn->rtx_len == 200 && sent_count == 2);
+
+	/* First segment lost : peer acks the previous datas */
+	peer(TCP_ACK, PEER_ISN + 1, seq, 0);
+	peer(TCP_ACK, PEER_ISN + 1, seq, 0);
+	CHECK(sent_count == 2 && conn->dupacks == 2);
+	peer(TCP_ACK, PEER_ISN + 1, seq, 0);
+	CHECK(sent_count == 3 && sent[2].seq == seq && sent[2].len == 200);
+	CHECK(net.stats.tcp_fastrtx == 1 && net.stats.tcp_dupack == 3);
+	CHECK(conn->rtx_count == 0);
+	peer(TCP_ACK, PEER_ISN + 1, seq, 0);
+	CHECK(sent_count == 3);
+
+	/* Duplicate ACK with datas (or nothing in flight) is not counted */
+	peer(TCP_ACK, PEER_ISN + 1, seq + 200, 0);
+	CHECK(conn->dupacks == 0);
+	peer(TCP_ACK, PEER_ISN + 1, seq + 200, 0);
+	CHECK(conn->dupacks == 0);
+}
+
+/**
+ * @brief Timeout while TX buffer is used : no wait, tried again later
+ */
+static void test_tx_busy(void)
+{
+	tcp_conn *conn;
+	int rto;
+
+	setup();
+	conn = connect();
+	send_data(conn, 50);
+	rto = conn->rto;
+
+	/* Another frame is into the TX buffer, not sent yet */
+	((eth_frame *)tx_buffer)->proto = htons(0x0800);
+	advance(rto);
+	CHECK(sent_count == 1);
+	CHECK(conn->rto == rto && conn->rtx_count == 0);
+	CHECK(conn->rtx_tmr.armed && conn->rtx_tmr.expire == now + TCP_RTX_DEFER);
+	advance(TCP_RTX_DEFER);
+	CHECK(sent_count == 1);
+
+	/* Buffer released : retransmission on next try */
+	((eth_frame *)tx_buffer)->proto = 0;
+	advance(TCP_RTX_DEFER);
+	CHECK(sent_count == 2 && sent[1].len == 50);
+	CHECK(conn->rto == rto * 2 && conn->rtx_count == 1);
+}
+
+/**
+ * @brief Wait for the TX buffer is limited (frame never sent by driver)
+ */
+static void test_tx_wait(void)
+{
+	tcp_conn *conn;
+
+	setup();
+	conn = connect();
+	tx_hold = 1;
+	send_data(conn, 20);
+	CHECK(sent_count == 1);
+	/* Next segment waits TCP_TX_TIMEOUT, previous frame is lost */
+	clock_run = 1;
+	send_data(conn, 20);
+	clock_run = 0;
+	CHECK(sent_count == 2 && sent[1].len == 20);
+	CHECK(net.stats.tx_err == 1);
+	CHECK(now >= 1050 + TCP_TX_TIMEOUT);
+}
+
+/**
+ * @brief FIN of a local close is retransmitted until acknowledged
+ */
+static void test_fin(void)
+{
+	tcp_conn *conn;
+	u32 seq;
+
+	/* FIN lost once */
+	setup();
+	conn = connect();
+	seq = conn->seq_local;
+	tcp4_close(conn);
+	CHECK(sent_count == 1 && (sent[0].flags & TCP_FIN) && sent[0].seq == seq);
+	CHECK(conn->state == TCP_CONN_FIN_WAIT_1 && conn->seq_local == seq + 1);
+	CHECK(conn->rtx_fin && conn->rtx_tmr.armed);
+	advance(conn->rto);
+	CHECK(sent_count == 2 && (sent[1].flags & TCP_FIN) && sent[1].seq == seq);
+	CHECK(sent[1].len == 0);
+	/* FIN acknowledged, then FIN of the peer */
+	peer(TCP_ACK, PEER_ISN + 1, seq + 1, 0);
+	CHECK( ! conn->rtx_fin && ! conn->rtx_tmr.armed);
+	CHECK(conn->state == TCP_CONN_FIN_WAIT_1);
+	peer(TCP_ACK | TCP_FIN, PEER_ISN + 1, seq + 1, 0);
+	CHECK(sent_count == 3 && sent[2].seq == seq + 1);
+	CHECK(sent[2].ack == PEER_ISN + 2);
+	CHECK(conn->ip_remote == 0 && closed_count == 1);
+
+	/* FIN sent after datas : both retransmitted into one segment */
+	setup();
+	conn = connect();
+	seq = conn->seq_local;
+	send_data(conn, 30);
+	tcp4_close(conn);
+	CHECK(sent_count == 2 && sent[1].seq == seq + 30);
+	advance(conn->rto);
+	CHECK(sent_count == 3 && sent[2].seq == seq && sent[2].len == 30);
+	CHECK(sent[2].flags & TCP_FIN);
+	/* Datas acknowledged, FIN not : FIN alone */
+	peer(TCP_ACK, PEER_ISN + 1, seq + 30, 0);
+	CHECK(conn->rtx_len == 0 && conn->rtx_fin && conn->rtx_tmr.armed);
+	advance(conn->rto);
+	CHECK(sent_count == 4 && sent[3].seq == seq + 30 && sent[3].len == 0);
+	CHECK(sent[3].flags & TCP_FIN);
+
+	/* FIN never acknowledged : slot released after TCP_RTX_RETRIES */
+	setup();
+	conn = connect();
+	tcp4_close(conn);
+	advance(60000);
+	CHECK(conn->ip_remote == 0);
+	CHECK(closed_count == 1);
+	CHECK(sent[sent_count - 1].flags & TCP_RST);
+
+	/* FIN of a passive close (CLOSE_WAIT) is retransmitted too */
+	setup();
+	conn = connect();
+	seq = conn->seq_local;
+	peer(TCP_ACK | TCP_FIN, PEER_ISN + 1, seq, 0);
+	CHECK(conn->state == TCP_CONN_CLOSE_WAIT);
+	CHECK(sent_count == 1 && (sent[0].flags & TCP_FIN));
+	advance(conn->rto);
+	CHECK(sent_count == 2 && (sent[1].flags & TCP_FIN) && sent[1].seq == seq);
+	peer(TCP_ACK, PEER_ISN + 2, seq + 1, 0);
+	CHECK(conn->ip_remote == 0 && ! conn->rtx_tmr.armed);
+}
+
+/**
+ * @brief SYN-ACK of a passive open is retransmitted until the ACK
+ */
+static void test_syn_ack(void)
+{
+	tcp_conn *conn = &conns[0];
+
+	setup();
+	/* Peer SYN to the local service port */
+	conns[0].port_local = 80;
+	peer(TCP_SYN, PEER_ISN, 0, 0);
+	CHECK(conn->state == TCP_CONN_SYN);
+	CHECK(sent_count == 1 && sent[0].flags == (TCP_SYN | TCP_ACK));
+	CHECK(conn->rtx_tmr.armed);
+	advance(conn->rto);
+	CHECK(sent_count == 2 && sent[1].flags == (TCP_SYN | TCP_ACK));
+	CHECK(sent[1].seq == sent[0].seq && sent[1].ack == PEER_ISN + 1);
+	/* SYN of the peer sent again */
+	peer(TCP_SYN, PEER_ISN, 0, 0);
+	CHECK(sent_count == 3 && sent[2].flags == (TCP_SYN | TCP_ACK));
+	/* ACK : connection established, timer stopped */
+	peer(TCP_ACK, PEER_ISN + 1, sent[0].seq + 1, 0);
+	CHECK(conn->state == TCP_CONN_ESTABLISHED && ! conn->rtx_tmr.armed);
+	CHECK(conn->rtx_count == 0);
+}
+
+/* -- Lossy link ----------------------------------------------------------- */
+
+/* One-way delay of the link (ms) and size of the segments of the sender */
+#define LINK_DELAY 5
+#define BULK_SEG   128
+#define BULK_SIZE  (64 * 1024)
+
+/* Segment or ACK in flight on the link */
+typedef struct
+{
+	u32 due;
+	u32 seq;
+	int len;
+	u8  first;
+} in_flight;
+
+static in_flight link_data[64];
+static in_flight link_ack[64];
+static int link_data_count;
+static int link_ack_count;
+static int link_seen;     /* Sent segments already put on the link    */
+static u32 link_rand;     /* State of the pseudo-random generator     */
+static int link_loss;     /* Loss rate (per thousand)                 */
+static u32 bulk_seq;      /* First sequence number of the transfer    */
+static u32 bulk_next;     /* Next sequence number expected by the peer */
+
+/**
+ * @brief Value of a byte of the transfer
+ */
+static u8 bulk_byte(u32 offset)
+{
+	return((u8)((offset * 7) + (offset >> 8)));
+}
+
+/**
+ * @brief Pseudo-random loss decision (LCG, same sequence for a seed)
+ */
+static int link_lost(void)
+{
+	link_rand = (link_rand * 1103515245) + 12345;
+	return(((link_rand >> 16) % 1000) < (u32)link_loss);
+}
+
+/**
+ * @brief Put the segments sent by the stack on the link (or lose them)
+ */
+static void link_collect(void)
+{
+	segment *s;
+
+	while (link_seen != sent_count)
+	{
+		s = &sent[link_seen++ & 31];
+		if ((s->len == 0) || link_lost())
+			continue;
+		CHECK(link_data_count < 64);
+		link_data[link_data_count].due   = now + LINK_DELAY;
+		link_data[link_data_count].seq   = s->seq;
+		link_data[link_data_count].len   = s->len;
+		link_data[link_data_count].first = s->data[0];
+		link_data_count++;
+	}
+}
+
+/**
+ * @brief Deliver the segments and ACKs that reached the end of the link
+ *
+ * The peer keeps in-order datas only and answers each segment with a
+ * cumulative ACK, which may be lost too.
+ */
+static void link_deliver(void)
+{
+	in_flight *f;
+	int i;
+
+	for (i = 0; i < link_data_count; )
+	{
+		f = &link_data[i];
+		if ((int)(now - f->due) < 0)
+		{
+			i++;
+			continue;
+		}
+		CHECK(f->first == bulk_byte(f->seq - bulk_seq));
+		/* New datas (maybe after a part already received) */
+		if (((int)(f->seq - bulk_next) <= 0) &&
+		    ((int)(f->seq + f->len - bulk_next) > 0))
+			bulk_next = f->seq + f->len;
+		if ( ! link_lost())
+		{
+			CHECK(link_ack_count < 64);
+			link_ack[link_ack_count].due = now + LINK_DELAY;
+			link_ack[link_ack_count].seq = bulk_next;
+			link_ack_count++;
+		}
+		link_data_count--;
+		memmove(f, f + 1, (link_data_count - i) * sizeof(in_flight));
+	}
+	for (i = 0; i < link_ack_count; )
+	{
+		f = &link_ack[i];
+		if ((int)(now - f->due) < 0)
+		{
+			i++;
+			continue;
+		}
+		peer(TCP_ACK, PEER_ISN + 1, f->seq, 0);
+		link_collect();
+		link_ack_count--;
+		memmove(f, f + 1, (link_ack_count - i) * sizeof(in_flight));
+	}
+}
+
+/**
+ * @brief Bulk transfer over a lossy link, in both directions
+ *
+ * @param loss Loss rate of segments and ACKs (per thousand)
+ * @param seed Seed of the pseudo-random generator
+ */
+static void bulk(int loss, u32 seed)
+{
+	tcp_conn *conn;
+	u32 queued = 0;
+	u32 start;
+	u8 *data;
+	int len, i;
+
+	setup();
+	conn = connect();
+	link_data_count = 0;
+	link_ack_count  = 0;
+	link_seen = 0;
+	link_rand = seed;
+	link_loss = loss;
+	bulk_seq  = conn->seq_local;
+	bulk_next = conn->seq_local;
+	start = now;
+
+	while ((bulk_next - bulk_seq) < BULK_SIZE)
+	{
+		/* Sender : new datas while the retransmit buffer has room */
+		while ((queued < BULK_SIZE) &&
+		       ((conn->rtx_len + BULK_SEG) <= TCP_RTX_SIZE))
+		{
+			len = BULK_SIZE - queued;
+			if (len > BULK_SEG)
+				len = BULK_SEG;
+			data = tcp4_tx_buffer(conn);
+			for (i = 0; i < len; i++)
+				data[i] = bulk_byte(queued + i);
+			tcp4_send(conn, len);
+			queued += len;
+			link_collect();
+		}
+		link_deliver();
+		advance(1);
+		link_collect();
+		if ((conn->ip_remote == 0) || ((now - start) > 600000))
+			break;
+	}
+	CHECK(conn->state == TCP_CONN_ESTABLISHED);
+	CHECK((bulk_next - bulk_seq) == BULK_SIZE);
+	CHECK(net.stats.tcp_nortx == 0);
+	/* Last ACKs reach the sender */
+	advance(LINK_DELAY);
+	link_deliver();
+	if (loss == 0)
+		CHECK(conn->rtx_len == 0 && net.stats.tcp_rto == 0);
+
+	printf("  loss %d.%d%% : %d bytes in %d ms, goodput %d B/s, "
+	       "rto %d, fast rtx %d\n", loss / 10, loss % 10, BULK_SIZE,
+	       (int)(now - start), (int)((BULK_SIZE * 1000ULL) / (now - start)),
+	       (int)net.stats.tcp_rto, (int)net.stats.tcp_fastrtx);
+}
+
+/**
+ * @brief Transfers complete with 0, 1, 2 and 5% loss (seeded, repeatable)
+ */
+static void test_loss(void)
+{
+	bulk(0, 1);
+	bulk(10, 0x1234);
+	bulk(20, 0x5678);
+	bulk(50, 0x9ABC);
+	CHECK(net.stats.tcp_rto + net.stats.tcp_fastrtx > 0);
+}
+
+int main(void)
+{
+	test_rtt();
+	test_syn();
+	test_data();
+	test_dupack();
+	test_tx_busy();
+	test_tx_wait();
+	test_fin();
+	test_syn_ack();
+	test_loss();
+
+	printf("test_tcp: %s\n", test_failed ? "FAILED" : "OK");
+	return(test_failed != 0);
+}
+/* EOF */
@@ -0,0 +1,381 @@
+/**
+ * @file  test_udp.c
+ * @brief Host tests of UDP sockets (bind, dispatch, queue, length checks)
+ *
+ * The IPv4 source is included, so static functions can be tested. The
+ * network layer and the timers are replaced by stubs : datagrams are written
+ * into the RX buffer and sent frames are read back from the TX buffer.
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "../net_ipv4.c"
+
+#define LOCAL_IP 0x0A000001
+#define PEER_IP  0x0A000002
+
+int test_failed;
+
+static network net;
+static u8 rx_buffer[512];
+static u8 tx_buffer[512];
+/* Size of the last frame sent (IP datagram), 0 if none */
+static int sent_len;
+/* Last call of the recv callback */
+static int recv_count;
+static int recv_len;
+
+/* -- Stubs of network layer and timers ------------------------------------ */
+
+u16 htons(u16 v)
+{
+	return((u16)((v >> 8) | (v << 8)));
+}
+
+u32 htonl(u32 v)
+{
+	return((v >> 24) | ((v >> 8) & 0xFF00) |
+	       ((v << 8) & 0xFF0000) | (v << 24));
+}
+
+u8 *net_tx_buffer(network *mod, u16 proto)
+{
+	if (proto != 0)
+		((eth_frame *)mod->tx_buffer)->proto = htons(proto);
+	return(mod->tx_buffer + 14);
+}
+
+void net_send(network *mod, u32 size)
+{
+	(void)mod;
+	/* Frame stays into the TX buffer until the test releases it */
+	sent_len = size;
+}
+
+void net_send_rx(network *mod, u32 size)
+{
+	(void)mod;
+	(void)size;
+}
+
+int net_tx_busy(network *mod)
+{
+	(void)mod;
+	return(0);
+}
+
+int arp_resolve(network *mod, u32 ip, u8 *frame)
+{
+	(void)mod;
+	(void)ip;
+	(void)frame;
+	return(0);
+}
+
+void arp_hold(network *mod, u32 ip, int len)
+{
+	(void)mod;
+	(void)ip;
+	(void)len;
+}
+
+void dhcp_init(network *netif)
+{
+	(void)netif;
+}
+
+u32 timer_now(void)
+{
+	return(1000);
+}
+
+u32 timer_cycles(void)
+{
+	return(0);
+}
+
+void timer_arm(timer *tmr, u32 delay)
+{
+	(void)tmr;
+	(void)delay;
+}
+
+void timer_cancel(timer *tmr)
+{
+	(void)tmr;
+}
+
+/* -- Helpers -------------------------------------------------------------- */
+
+static void sock_recv(udp_socket *sock, udp_packet *pkt, ip_dgram *ip,
+                      int len)
+{
+	(void)sock;
+	(void)pkt;
+	(void)ip;
+	recv_count++;
+	recv_len = len;
+}
+
+static void setup(void)
+{
+	memset(&net, 0, sizeof(network));
+	memset(rx_buffer, 0, sizeof(rx_buffer));
+	memset(tx_buffer, 0, sizeof(tx_buffer));
+	net.rx_buffer = rx_buffer;
+	net.tx_buffer = tx_buffer;
+	net.ip_local  = LOCAL_IP;
+	net.ip_remote = PEER_IP;
+	ipv4_init(&net);
+	sent_len   = 0;
+	recv_count = 0;
+	recv_len   = -1;
+}
+
+/**
+ * @brief Receive a datagram from the peer
+ *
+ * @param port  Destination port
+ * @param ulen  Value of the UDP length field
+ * @param plen  Size of the IP payload (UDP header and datas)
+ * @param first Value of the first data byte
+ */
+static void peer(u16 port, int ulen, int plen, u8 first)
+{
+	ip_dgram   *ip  = (ip_dgram *)(rx_buffer + 14);
+	udp_packet *pkt = (udp_packet *)(rx_buffer + 14 + 20);
+	int i;
+
+	ip->vihl   = 0x45;
+	ip->proto  = IP_PROTO_UDP;
+	ip->length = htons(20 + plen);
+	ip->src    = htonl(PEER_IP);
+	ip->dst    = htonl(LOCAL_IP);
+	pkt->src_port = htons(40000);
+	pkt->dst_port = htons(port);
+	pkt->length   = htons(ulen);
+	for (i = 0; i < (plen - 8); i++)
+		((u8 *)pkt)[8 + i] = first + i;
+	ipv4_receive(&net, (u8 *)ip, 20 + plen);
+}
+
+/* -- Tests ---------------------------------------------------------------- */
+
+/**
+ * @brief Ports are bound once, the table has NET_UDP_SOCKETS entries
+ */
+static void test_bind(void)
+{
+	udp_socket socks[NET_UDP_SOCKETS + 1];
+	int i;
+
+	setup();
+	memset(socks, 0, sizeof(socks));
+	CHECK(udp4_bind(&net, &socks[0], 0) == -1);
+	CHECK(udp4_bind(&net, &socks[0], 1000) == 0);
+	CHECK(socks[0].netif == &net);
+	/* Same port, from another socket */
+	CHECK(udp4_bind(&net, &socks[1], 1000) == -1);
+	/* Fill the table */
+	for (i = 1; i < NET_UDP_SOCKETS; i++)
+		CHECK(udp4_bind(&net, &socks[i], 1000 + i) == 0);
+	CHECK(udp4_bind(&net, &socks[NET_UDP_SOCKETS], 2000) == -1);
+	/* A released slot can be used again, port is free */
+	udp4_unbind(&socks[2]);
+	CHECK(socks[2].netif == 0);
+	CHECK(udp4_bind(&net, &socks[NET_UDP_SOCKETS], 1002) == 0);
+	CHECK(udp4_bind(&net, &socks[2], 2000) == -1);
+	udp4_unbind(&socks[2]);
+}
+
+/**
+ * @brief Dispatch to the callback, with the checked length of datas
+ */
+static void test_dispatch(void)
+{
+	udp_socket sock;
+
+	setup();
+	memset(&sock, 0, sizeof(sock));
+	sock.recv = sock_recv;
+	CHECK(udp4_bind(&net, &sock, 1000) == 0);
+	peer(1000, 8 + 10, 8 + 10, 0);
+	CHECK(recv_count == 1 && recv_len == 10);
+	/* Padding after the UDP datagram is not given */
+	peer(1000, 8 + 4, 8 + 10, 0);
+	CHECK(recv_count == 2 && recv_len == 4);
+	peer(1000, 8, 8, 0);
+	CHECK(recv_count == 3 && recv_len == 0);
+	/* Closed port, and port 0 (free slots of the table) */
+	peer(1001, 8 + 4, 8 + 4, 0);
+	peer(0, 8 + 4, 8 + 4, 0);
+	CHECK(recv_count == 3);
+	CHECK(net.stats.udp_noport == 2);
+	CHECK(net.stats.udp_err == 0);
+	CHECK(net.stats.udp_rx == 5);
+}
+
+/**
+ * @brief Truncated datagrams and forged lengths are dropped
+ */
+static void test_length(void)
+{
+	udp_socket sock;
+	u8 queue[2 * (sizeof(udp_qhdr) + 32)];
+
+	setup();
+	memset(&sock, 0, sizeof(sock));
+	sock.recv = sock_recv;
+	CHECK(udp4_bind(&net, &sock, 1000) == 0);
+	/* Length larger than the IP payload */
+	peer(1000, 8 + 11, 8 + 10, 0);
+	peer(1000, 0xFFFF, 8 + 10, 0);
+	/* Length smaller than the header */
+	peer(1000, 7, 8 + 10, 0);
+	peer(1000, 0, 8 + 10, 0);
+	/* IP payload smaller than the header */
+	peer(1000, 8, 4, 0);
+	CHECK(recv_count == 0);
+	CHECK(net.stats.udp_err == 5);
+
+	/* Same checks before the queue */
+	udp4_unbind(&sock);
+	memset(&sock, 0, sizeof(sock));
+	sock.queue       = queue;
+	sock.queue_slot  = sizeof(udp_qhdr) + 32;
+	sock.queue_count = 2;
+	CHECK(udp4_bind(&net, &sock, 1000) == 0);
+	peer(1000, 8 + 11, 8 + 10, 0);
+	peer(1000, 2, 8 + 10, 0);
+	CHECK(sock.queue_used == 0);
+	CHECK(sock.drops == 0);
+	CHECK(net.stats.udp_err == 7);
+}
+
+/**
+ * @brief Receive queue : order, wrap, full queue and oversized datagram
+ */
+static void test_queue(void)
+{
+	udp_socket sock;
+	u8 queue[3 * (sizeof(udp_qhdr) + 16)];
+	udp_conn from;
+	u8 buffer[32];
+	int i;
+
+	setup();
+	memset(&sock, 0, sizeof(sock));
+	sock.queue       = queue;
+	sock.queue_slot  = sizeof(udp_qhdr) + 16;
+	sock.queue_count = 3;
+	CHECK(udp4_bind(&net, &sock, 1000) == 0);
+	CHECK(udp4_recvfrom(&sock, &from, buffer, sizeof(buffer)) == -1);
+
+	/* Several turns of the ring, one slot always used */
+	peer(1000, 8 + 16, 8 + 16, 0);
+	for (i = 1; i < 8; i++)
+	{
+		peer(1000, 8 + 5, 8 + 5, i * 10);
+		CHECK(sock.queue_used == 2);
+		memset(buffer, 0, sizeof(buffer));
+		CHECK(udp4_recvfrom(&sock, &from, buffer, sizeof(buffer)) ==
+		      (i == 1 ? 16 : 5));
+		CHECK(buffer[0] == (i - 1) * 10);
+		CHECK(sock.queue_used == 1);
+	}
+	CHECK(sock.queue_head == (8 % 3));
+	CHECK(from.ip_remote == PEER_IP);
+	CHECK(from.port_remote == htons(40000));
+	CHECK(from.port_local  == htons(1000));
+
+	/* Full queue */
+	peer(1000, 8 + 1, 8 + 1, 100);
+	peer(1000, 8 + 1, 8 + 1, 101);
+	CHECK(sock.queue_used == 3);
+	peer(1000, 8 + 1, 8 + 1, 102);
+	CHECK(sock.drops == 1);
+	/* Oldest first, datas truncated to the buffer */
+	CHECK(udp4_recvfrom(&sock, 0, buffer, 2) == 2);
+	CHECK(buffer[0] == 70 && buffer[1] == 71);
+	CHECK(udp4_recvfrom(&sock, 0, buffer, sizeof(buffer)) == 1);
+	CHECK(buffer[0] == 100);
+	CHECK(udp4_recvfrom(&sock, 0, buffer, sizeof(buffer)) == 1);
+	CHECK(buffer[0] == 101);
+	CHECK(udp4_recvfrom(&sock, 0, buffer, sizeof(buffer)) == -1);
+
+	/* Datagram larger than a slot */
+	peer(1000, 8 + 17, 8 + 17, 0);
+	CHECK(sock.drops == 2);
+	CHECK(sock.queue_used == 0);
+	/* Socket without queue */
+	sock.queue = 0;
+	peer(1000, 8 + 1, 8 + 1, 0);
+	CHECK(sock.drops == 3);
+}
+
+/**
+ * @brief Send a datagram from a bound port
+ */
+static void test_sendto(void)
+{
+	ip_dgram   *ip  = (ip_dgram *)(tx_buffer + 14);
+	udp_packet *pkt = (udp_packet *)(tx_buffer + 14 + 20);
+	udp_socket sock;
+	udp_conn   to;
+	u8 data[UDP_DATA_MAX + 1];
+	int i;
+
+	setup();
+	memset(&sock, 0, sizeof(sock));
+	memset(&to, 0, sizeof(to));
+	for (i = 0; i < (int)sizeof(data); i++)
+		data[i] = i;
+	/* Socket not bound */
+	CHECK(udp4_sendto(&sock, &to, data, 4) == -1);
+	CHECK(udp4_bind(&net, &sock, 1000) == 0);
+
+	to.family      = NET_AF_INET;
+	to.ip_remote   = PEER_IP;
+	to.port_remote = htons(5000);
+	CHECK(udp4_sendto(&sock, &to, data, 10) == 10);
+	CHECK(sent_len == 20 + 8 + 10);
+	CHECK(htonl(ip->dst) == PEER_IP);
+	CHECK(ip->proto == IP_PROTO_UDP);
+	CHECK(htons(ip->length) == 20 + 8 + 10);
+	CHECK(htons(pkt->src_port) == 1000);
+	CHECK(htons(pkt->dst_port) == 5000);
+	CHECK(htons(pkt->length) == 8 + 10);
+	CHECK(((u8 *)pkt)[8 + 9] == 9);
+	CHECK(net.stats.udp_tx == 1);
+
+	/* TX buffer still used by the previous frame */
+	sent_len = 0;
+	CHECK(udp4_sendto(&sock, &to, data, 10) == -1);
+	CHECK(sent_len == 0);
+	((eth_frame *)tx_buffer)->proto = 0;
+	/* Too large for the TX buffer */
+	CHECK(udp4_sendto(&sock, &to, data, UDP_DATA_MAX + 1) == -1);
+	CHECK(udp4_sendto(&sock, &to, data, UDP_DATA_MAX) == UDP_DATA_MAX);
+	CHECK(sent_len == 20 + 8 + UDP_DATA_MAX);
+}
+
+int main(void)
+{
+	test_bind();
+	test_dispatch();
+	test_length();
+	test_queue();
+	test_sendto();
+
+	printf("test_udp: %s\n", test_failed ? "FAILED" : "OK");
+	return(test_failed != 0);
+}
+/* EOF */
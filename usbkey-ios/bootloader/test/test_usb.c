@@ -0,0 +1,417 @@
+/**
+ * @file  test_usb.c
+ * @brief Host tests of the USB device stack (enumeration, bulk IN, ZLP, busy)
+ *
+ * When started with the "bench" argument, the number of interrupts and the
+ * modelled cycles of bulk transfers are printed per size. The model counts
+ * BENCH_IRQ_CYCLES per interrupt (exception entry and return) and
+ * BENCH_REG_CYCLES per register access (bridge wait states), the code of
+ * the stack is not counted : numbers are for comparison between versions,
+ * not a measure of the target.
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "hardware.h"
+#include "hw_model.h"
+#include "libc.h"
+#include "net.h"
+#include "usb.h"
+#include "usb_desc.h"
+#include "usb_ecm.h"
+
+#define BENCH_IRQ_CYCLES 30
+#define BENCH_REG_CYCLES  4
+
+static usb_module mod;
+static usb_class  cls;
+static network    net;
+static u8 desc[sizeof(usb_ecm_desc)];
+static u8 rx_buffer[512];
+/* Datas sent on EP0 (IN packets of control transfers) */
+static u8  ctrl_reply[256];
+static int ctrl_len;
+/* Number of calls of usb_irq */
+static int irq_count;
+/* Length of each packet given to the peripheral (BK1RDY set on EP1) */
+static int pkt_len[16];
+static int pkt_count;
+/* Completed requests, in completion order */
+static usb_request *done[4];
+static int done_count;
+
+/**
+ * @brief Stub of the network classifier : accept all frames
+ */
+int net_rx_classify(network *m, int *len)
+{
+	(void)m;
+	(void)len;
+	return(0);
+}
+
+/**
+ * @brief Record the IN packets started by the stack
+ */
+static void hook(u32 reg, u32 value, int size)
+{
+	int len;
+
+	(void)size;
+	if ((reg == USB_ADDR + 0x100 + (1 << 5) + 0x05) && (value & 0x80))
+	{
+		if (pkt_count < 16)
+			pkt_len[pkt_count] = mod.ep_desc[1].b1_pcksize & 0x3FF;
+		pkt_count++;
+	}
+	/* Control IN packet, datas are into the EP0 buffer */
+	if ((reg == USB_ADDR + 0x100 + 0x05) && (value & 0x80))
+	{
+		len = mod.ep_desc[0].b1_pcksize & 0x3FF;
+		if ((ctrl_len + len) <= (int)sizeof(ctrl_reply))
+			memcpy(ctrl_reply + ctrl_len, mod.ctrl_in, len);
+		ctrl_len += len;
+	}
+}
+
+/**
+ * @brief Simulate the host reading the pending IN packet (TRCPT1)
+ */
+static void host_in(u8 ep)
+{
+	hw_set8(USB_ADDR + 0x100 + (ep << 5) + 0x07, (1 << 1));
+	hw_set16(USB_ADDR + 0x20, (1 << ep));
+	usb_irq(&mod);
+	irq_count++;
+	hw_set16(USB_ADDR + 0x20, 0);
+}
+
+/**
+ * @brief Simulate the end of an OUT transfer (TRCPT0)
+ *
+ * In multi-packet mode the peripheral receives all the packets into the
+ * buffer, the interrupt comes when the buffer is full or after a short
+ * packet, BYTE_COUNT holds the total.
+ *
+ * @param ep  Endpoint number
+ * @param len Number of bytes received
+ */
+static void host_out(u8 ep, int len)
+{
+	mod.ep_desc[ep].b0_pcksize = (mod.ep_desc[ep].b0_pcksize & ~0x3FFF) | len;
+	hw_set8(USB_ADDR + 0x100 + (ep << 5) + 0x07, (1 << 0));
+	hw_set16(USB_ADDR + 0x20, (1 << ep));
+	usb_irq(&mod);
+	irq_count++;
+	hw_set16(USB_ADDR + 0x20, 0);
+}
+
+/**
+ * @brief Simulate a SETUP packet received on EP0 (RXSTP)
+ *
+ * @param type    bmRequestType
+ * @param request bRequest
+ * @param value   wValue
+ * @param length  wLength
+ */
+static void setup_packet(u8 type, u8 request, u16 value, u16 length)
+{
+	mod.ctrl[0] = type;
+	mod.ctrl[1] = request;
+	mod.ctrl[2] = value & 0xFF;
+	mod.ctrl[3] = value >> 8;
+	mod.ctrl[4] = 0;
+	mod.ctrl[5] = 0;
+	mod.ctrl[6] = length & 0xFF;
+	mod.ctrl[7] = length >> 8;
+	mod.ep_desc[0].b0_pcksize = (mod.ep_desc[0].b0_pcksize & ~0x3FFF) | 8;
+	ctrl_len = 0;
+	hw_set8(USB_ADDR + 0x100 + 0x07, (1 << 4));
+	hw_set16(USB_ADDR + 0x20, 1);
+	usb_irq(&mod);
+	hw_set16(USB_ADDR + 0x20, 0);
+}
+
+/**
+ * @brief Control transfer : SETUP, then IN data phase (or status ZLP)
+ *
+ * @return integer Number of bytes of the IN data phase
+ */
+static int host_setup(u8 type, u8 request, u16 value, u16 length)
+{
+	int i;
+
+	setup_packet(type, request, value, length);
+	for (i = 0; (i < 8) && (mod.ep_status[0].flags & EP_BUSY); i++)
+		host_in(0);
+	CHECK((mod.ep_status[0].flags & EP_BUSY) == 0);
+	return(ctrl_len);
+}
+
+static void complete(usb_module *m, usb_request *req)
+{
+	(void)m;
+	if (done_count < 4)
+		done[done_count] = req;
+	done_count++;
+}
+
+static void setup(void)
+{
+	hw_reset();
+	memset(&mod, 0, sizeof(usb_module));
+	usb_ep_enable(&mod, 1, 0x30);
+	hw_write_hook = hook;
+	pkt_count  = 0;
+	done_count = 0;
+}
+
+/**
+ * @brief Enumeration : bus reset, descriptors, address and configuration
+ */
+static void test_enum(void)
+{
+	const u8 *cfg = usb_ecm_desc + 18 + 4 + 18 + 26;
+
+	CHECK(cfg[1] == 0x02);
+
+	hw_reset();
+	memset(&mod, 0, sizeof(usb_module));
+	memset(&net, 0, sizeof(network));
+	memcpy(desc, usb_ecm_desc, sizeof(usb_ecm_desc));
+	mod.desc = desc;
+	ecm_init(&mod, &cls);
+	net.rx_buffer = rx_buffer;
+	cls.priv = &net;
+	hw_write_hook = hook;
+
+	/* Bus reset (EORST) : EP0 configured for control */
+	hw_set16(USB_ADDR + 0x18, 0x008D);
+	hw_set16(USB_ADDR + 0x1C, (1 << 3));
+	usb_irq(&mod);
+	CHECK(mod.stats.reset == 1);
+	CHECK(reg8_rd(USB_ADDR + 0x100) == 0x11);
+	CHECK(mod.ep_desc[0].b0_addr == (u32)mod.ctrl);
+
+	/* Device descriptor, first 8 bytes then all of it */
+	CHECK(host_setup(0x80, 0x06, 0x0100, 8) == 8);
+	CHECK(memcmp(ctrl_reply, usb_ecm_desc, 8) == 0);
+	CHECK(ctrl_reply[7] == USB_EP_SIZE);
+	CHECK(host_setup(0x80, 0x06, 0x0100, 64) == 18);
+	CHECK(memcmp(ctrl_reply, usb_ecm_desc, 18) == 0);
+
+	/* Address is used after the status stage (ZLP read by the host) */
+	setup_packet(0x00, 0x05, 0x2A, 0);
+	CHECK(mod.addr == 0x2A);
+	CHECK(reg8_rd(USB_ADDR + 0x0A) == 0);
+	host_in(0);
+	CHECK(ctrl_len == 0);
+	CHECK((mod.ep_status[0].flags & EP_BUSY) == 0);
+	CHECK(reg8_rd(USB_ADDR + 0x0A) == (0x80 | 0x2A));
+
+	/* Configuration : header, then wTotalLength (71) for a larger wLength */
+	CHECK(host_setup(0x80, 0x06, 0x0200, 9) == 9);
+	CHECK(memcmp(ctrl_reply, cfg, 9) == 0);
+	CHECK(host_setup(0x80, 0x06, 0x0200, 255) == 71);
+	CHECK(memcmp(ctrl_reply, cfg, 71) == 0);
+	/* String descriptor (product) */
+	CHECK(host_setup(0x80, 0x06, 0x0301, 255) == 18);
+	CHECK(memcmp(ctrl_reply, usb_ecm_desc + 22, 18) == 0);
+	CHECK(host_setup(0x80, 0x06, 0x0301, 2) == 2);
+
+	/* SET_CONFIGURATION : endpoints of the class, first RX started */
+	CHECK(host_setup(0x00, 0x09, 1, 0) == 0);
+	CHECK(reg8_rd(USB_ADDR + 0x100 + (1 << 5)) == 0x03);
+	CHECK(reg8_rd(USB_ADDR + 0x100 + (2 << 5)) == 0x30);
+	CHECK(reg8_rd(USB_ADDR + 0x100 + (3 << 5)) == 0x40);
+	CHECK(mod.ep_status[1].queue != 0);
+	CHECK(mod.ep_status[1].flags & EP_BUSY);
+	CHECK(mod.ep_desc[1].b0_addr == (u32)rx_buffer);
+	CHECK(((mod.ep_desc[1].b0_pcksize >> 14) & 0x3FFF) == 512);
+	CHECK(mod.ep_status[2].queue == 0);
+	CHECK(mod.stats.setup == 8);
+	CHECK(reg8_rd(USB_ADDR + 0x0A) == (0x80 | 0x2A));
+}
+
+/**
+ * @brief A bulk IN transfer of a multiple of 64 bytes ends with a ZLP
+ */
+static void test_zlp(void)
+{
+	static u8 buffer[128];
+	int i;
+
+	setup();
+	CHECK(usb_transfer(&mod, EP_DIR_IN | 1, buffer, 128) == 0);
+	for (i = 0; (i < 8) && (mod.ep_status[1].flags & EP_BUSY); i++)
+		host_in(1);
+	CHECK(pkt_count == 3);
+	CHECK(pkt_len[0] == 64);
+	CHECK(pkt_len[1] == 64);
+	CHECK(pkt_len[2] == 0);
+	CHECK((mod.ep_status[1].flags & (EP_BUSY | EP_ZLP)) == 0);
+
+	/* A short last packet ends the transfer, no ZLP */
+	setup();
+	CHECK(usb_transfer(&mod, EP_DIR_IN | 1, buffer, 100) == 0);
+	for (i = 0; (i < 8) && (mod.ep_status[1].flags & EP_BUSY); i++)
+		host_in(1);
+	CHECK(pkt_count == 2);
+	CHECK(pkt_len[0] == 64);
+	CHECK(pkt_len[1] == 36);
+}
+
+/**
+ * @brief A transfer can not be started on a busy data endpoint
+ */
+static void test_busy(void)
+{
+	static u8 a[64], b[32];
+	int i;
+
+	setup();
+	CHECK(usb_transfer(&mod, EP_DIR_IN | 1, a, 10) == 0);
+	CHECK(usb_transfer(&mod, EP_DIR_IN | 1, b, 32) < 0);
+	/* The transfer in progress is not modified */
+	CHECK(mod.ep_status[1].data == a);
+	CHECK(mod.ep_status[1].size == 10);
+	for (i = 0; (i < 8) && (mod.ep_status[1].flags & EP_BUSY); i++)
+		host_in(1);
+	CHECK(pkt_count == 1);
+	CHECK(usb_transfer(&mod, EP_DIR_IN | 1, b, 32) == 0);
+	/* Invalid endpoint */
+	CHECK(usb_transfer(&mod, EP_DIR_IN | 9, b, 32) < 0);
+}
+
+/**
+ * @brief Queued requests are sent and completed in submit order
+ */
+static void test_queue(void)
+{
+	static u8 a[64], b[20];
+	usb_request ra, rb;
+	int i;
+
+	setup();
+	memset(&ra, 0, sizeof(ra));
+	memset(&rb, 0, sizeof(rb));
+	ra.data = a; ra.size = 64; ra.complete = complete;
+	rb.data = b; rb.size = 20; rb.complete = complete;
+	CHECK(usb_submit(&mod, EP_DIR_IN | 1, &ra) == 0);
+	CHECK(usb_submit(&mod, EP_DIR_IN | 1, &rb) == 0);
+	for (i = 0; (i < 8) && (mod.ep_status[1].flags & EP_BUSY); i++)
+		host_in(1);
+	CHECK(done_count == 2);
+	CHECK(done[0] == &ra);
+	CHECK(done[1] == &rb);
+	CHECK(ra.count == 64);
+	CHECK(rb.count == 20);
+	/* 64 bytes + ZLP, then 20 bytes */
+	CHECK(pkt_count == 3);
+	CHECK(mod.ep_status[1].queue == 0);
+}
+
+/**
+ * @brief Submit of a request already queued is rejected without side effect
+ */
+static void test_resubmit(void)
+{
+	static u8 a[64], b[20];
+	usb_request ra, rb;
+	int i;
+
+	setup();
+	memset(&ra, 0, sizeof(ra));
+	memset(&rb, 0, sizeof(rb));
+	ra.data = a; ra.size = 64; ra.complete = complete;
+	rb.data = b; rb.size = 20; rb.complete = complete;
+	CHECK(usb_submit(&mod, EP_DIR_IN | 1, &ra) == 0);
+	CHECK(usb_submit(&mod, EP_DIR_IN | 1, &rb) == 0);
+	host_in(1);
+	/* Head request is in flight (64 bytes counted), submit it again */
+	CHECK(usb_submit(&mod, EP_DIR_IN | 1, &ra) < 0);
+	CHECK(ra.next == &rb);
+	CHECK(mod.ep_status[1].queue == &ra);
+	CHECK(usb_submit(&mod, EP_DIR_IN | 1, &rb) < 0);
+	CHECK(hw_primask == 0);
+	for (i = 0; (i < 8) && (mod.ep_status[1].flags & EP_BUSY); i++)
+		host_in(1);
+	CHECK(done_count == 2);
+	CHECK(ra.count == 64);
+
+	/* Called with interrupts masked (ex: from a callback), they stay masked */
+	hw_primask = 1;
+	CHECK(usb_submit(&mod, EP_DIR_IN | 1, &ra) == 0);
+	CHECK(hw_primask == 1);
+	CHECK(usb_submit(&mod, EP_DIR_IN | 1, &ra) < 0);
+	CHECK(hw_primask == 1);
+	hw_primask = 0;
+}
+
+/**
+ * @brief Print interrupts and modelled cycles of bulk transfers per size
+ */
+static void bench(void)
+{
+	static const int size[] = { 1, 63, 64, 65, 512, 1514 };
+	static u8 buffer[1514];
+	u32 access[2];
+	int irq[2];
+	int i, n;
+
+	printf("  size   IN irq  IN cycles   OUT irq  OUT cycles\n");
+	for (i = 0; i < (int)(sizeof(size) / sizeof(size[0])); i++)
+	{
+		n = size[i];
+
+		/* Bulk IN on EP1 : one interrupt per packet (and ZLP) */
+		setup();
+		irq_count = 0;
+		hw_access = 0;
+		usb_transfer(&mod, EP_DIR_IN | 1, buffer, n);
+		while (mod.ep_status[1].flags & EP_BUSY)
+			host_in(1);
+		irq[0]    = irq_count;
+		access[0] = hw_access;
+
+		/* Bulk OUT on EP2 : multi-packet, one interrupt per transfer */
+		setup();
+		usb_ep_enable(&mod, 2, 0x03);
+		irq_count = 0;
+		hw_access = 0;
+		usb_transfer(&mod, EP_DIR_OUT | 2, buffer, n);
+		host_out(2, n);
+		CHECK(mod.ep_status[2].count == n);
+		CHECK((mod.ep_status[2].flags & EP_BUSY) == 0);
+		irq[1]    = irq_count;
+		access[1] = hw_access;
+
+		printf("  %4d  %7d  %9d  %8d  %10d\n", n,
+		       irq[0], irq[0] * BENCH_IRQ_CYCLES + access[0] * BENCH_REG_CYCLES,
+		       irq[1], irq[1] * BENCH_IRQ_CYCLES + access[1] * BENCH_REG_CYCLES);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	test_enum();
+	test_zlp();
+	test_busy();
+	test_queue();
+	test_resubmit();
+
+	if ((argc > 1) && (argv[1][0] == 'b'))
+		bench();
+
+	printf("test_usb: %s\n", test_failed ? "FAILED" : "OK");
+	return(test_failed != 0);
+}
+/* EOF */
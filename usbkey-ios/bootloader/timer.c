@@ -0,0 +1,182 @@
+/**
+ * @file  timer.c
+ * @brief Millisecond timebase (SysTick) and software timers (timer wheel)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#include "hardware.h"
+#include "timer.h"
+
+#define WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+
+static volatile u32 timer_ticks;
+static u32    timer_last;
+static timer *timer_wheel[TIMER_WHEEL_SIZE];
+
+/**
+ * @brief Initialize the timebase and the timer wheel
+ *
+ * The SysTick is used rather than USB SOF because it runs before enumeration
+ * and while the bus is suspended.
+ */
+void timer_init(void)
+{
+	int i;
+
+	timer_ticks = 0;
+	timer_last  = 0;
+	for (i = 0; i < TIMER_WHEEL_SIZE; i++)
+		timer_wheel[i] = 0;
+
+	/* Set SysTick reload value for a 1ms period */
+	reg_wr(0xE000E014, (TIMER_CPU_FREQ / 1000) - 1);
+	/* Clear current value */
+	reg_wr(0xE000E018, 0);
+	/* Enable SysTick : CPU clock, with interrupt */
+	reg_wr(0xE000E010, (1 << 2) | (1 << 1) | (1 << 0));
+}
+
+/**
+ * @brief SysTick interrupt handler, called every ms
+ *
+ */
+void timer_irq(void)
+{
+	timer_ticks++;
+}
+
+/**
+ * @brief Get the current time
+ *
+ * @return u32 Number of ms since timer_init()
+ */
+u32 timer_now(void)
+{
+	return(timer_ticks);
+}
+
+/**
+ * @brief Get a cycle counter (CPU clock) based on SysTick
+ *
+ * The counter wraps (about 89 seconds at 48MHz), so only differences of
+ * two values must be used. It can be called with interrupts disabled.
+ *
+ * @return u32 Number of CPU cycles since timer_init()
+ */
+u32 timer_cycles(void)
+{
+	u32 irq, ticks, val;
+
+	irq = irq_save();
+	ticks = timer_ticks;
+	val   = reg_rd(0xE000E018);
+	/* If SysTick has wrapped but its interrupt is not processed yet */
+	/* (PENDSTSET into ICSR), read again and count the missing tick  */
+	if (reg_rd(0xE000ED04) & (1 << 26))
+	{
+		val = reg_rd(0xE000E018);
+		ticks++;
+	}
+	irq_restore(irq);
+
+	return((ticks * (TIMER_CPU_FREQ / 1000)) +
+	       ((TIMER_CPU_FREQ / 1000) - 1 - val));
+}
+
+/**
+ * @brief Start (or restart) a software timer
+ *
+ * Timers are processed by timer_periodic(), so arm/cancel and the timer
+ * handler must be used from main loop context (not from interrupts). The
+ * timer structure must be cleared before first use.
+ *
+ * @param tmr   Pointer to the timer structure (with handler set)
+ * @param delay Number of ms before the handler is called
+ */
+void timer_arm(timer *tmr, u32 delay)
+{
+	timer **slot;
+
+	if (tmr->armed)
+		timer_cancel(tmr);
+
+	/* A timer can not expire into the current tick */
+	if (delay == 0)
+		delay = 1;
+	tmr->expire = timer_ticks + delay;
+
+	/* Insert timer at the head of its slot */
+	slot = &timer_wheel[tmr->expire & WHEEL_MASK];
+	tmr->prev = 0;
+	tmr->next = *slot;
+	if (*slot)
+		(*slot)->prev = tmr;
+	*slot = tmr;
+	tmr->armed = 1;
+}
+
+/**
+ * @brief Stop a software timer (if armed)
+ *
+ * @param tmr Pointer to the timer structure
+ */
+void timer_cancel(timer *tmr)
+{
+	if ( ! tmr->armed)
+		return;
+
+	if (tmr->prev)
+		tmr->prev->next = tmr->next;
+	else
+		timer_wheel[tmr->expire & WHEEL_MASK] = tmr->next;
+	if (tmr->next)
+		tmr->next->prev = tmr->prev;
+
+	tmr->next  = 0;
+	tmr->prev  = 0;
+	tmr->armed = 0;
+}
+
+/**
+ * @brief Process expired timers
+ *
+ * This function must be called periodically (from main loop). All ticks
+ * elapsed since last call are processed, and the handler of each expired
+ * timer is called.
+ */
+void timer_periodic(void)
+{
+	u32 now = timer_ticks;
+	timer *tmr;
+
+	while (timer_last != now)
+	{
+		timer_last++;
+
+		tmr = timer_wheel[timer_last & WHEEL_MASK];
+		while (tmr)
+		{
+			/* Timers for a next round of the wheel stay into slot */
+			if ((int)(tmr->expire - timer_last) > 0)
+			{
+				tmr = tmr->next;
+				continue;
+			}
+			timer_cancel(tmr);
+			if (tmr->handler)
+				tmr->handler(tmr);
+			/* Handler may have modified the slot, restart from head */
+			tmr = timer_wheel[timer_last & WHEEL_MASK];
+		}
+	}
+}
+/* EOF */
@@ -0,0 +1,48 @@
+/**
+ * @file  timer.h
+ * @brief Definitions and prototypes for timebase and software timers
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2017
+ *
+ * @page License
+ * CowStick-bootloader is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3 as published by the Free Software Foundation. You
+ * should have received a copy of the GNU Lesser General Public
+ * License along with this program, see LICENSE.md file for more details.
+ * This program is distributed WITHOUT ANY WARRANTY see README file.
+ */
+#ifndef TIMER_H
+#define TIMER_H
+#include "types.h"
+
+/* Frequency of the CPU clock (used as SysTick source) */
+#ifndef TIMER_CPU_FREQ
+#define TIMER_CPU_FREQ 48000000
+#endif
+/* Number of slots into the timer wheel (must be a power of two) */
+#ifndef TIMER_WHEEL_SIZE
+#define TIMER_WHEEL_SIZE 16
+#endif
+
+typedef struct _timer
+{
+	struct _timer *next;
+	struct _timer *prev;
+	u32   expire;  /* Tick (ms) when the timer expires */
+	int   armed;
+	void (*handler)(struct _timer *tmr);
+	void *priv;
+} timer;
+
+void timer_init(void);
+void timer_irq (void);
+u32  timer_now (void);
+u32  timer_cycles(void);
+void timer_arm   (timer *tmr, u32 delay);
+void timer_cancel(timer *tmr);
+void timer_periodic(void);
+
+#endif
+/* EOF */
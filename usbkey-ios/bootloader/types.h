@@ -17,10 +17,16 @@
 #define TYPES_H
 
 typedef unsigned int   uint;
+#ifdef __LP64__
+/* Host build (test/ directory) : long is 64 bits */
+typedef unsigned int   u32;
+typedef volatile unsigned int   vu32;
+#else
 typedef unsigned long  u32;
+typedef volatile unsigned long  vu32;
+#endif
 typedef unsigned short u16;
 typedef unsigned char  u8;
-typedef volatile unsigned long  vu32;
 typedef volatile unsigned short vu16;
 typedef volatile unsigned char  vu8;
 
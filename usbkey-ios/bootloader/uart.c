@@ -18,12 +18,31 @@
 
 #define UART_ADDR 0x42001400 /* SERCOM3 */
 
-#define UART_BAUD    9600
-#define UART_GCLK 8000000
-#define CONF_BAUD_RATE  (65536 - ((65536 * 16.0f * UART_BAUD) / UART_GCLK))
+/* Default baudrate, used by uart_init() */
+#ifndef UART_BAUD
+#define UART_BAUD 9600
+#endif
+/* SERCOM3 core clock : generic clock generator 7 (DFLL48M) */
+#define UART_GCLK_ID 7
+#define UART_GCLK    48000000
+
+/* Size of the TX ring buffer (must be a power of two) */
+#ifndef UART_TX_SIZE
+#define UART_TX_SIZE 256
+#endif
 
 static const u8 hex[16] = "0123456789ABCDEF";
 
+static u8  tx_buffer[UART_TX_SIZE];
+static volatile u16 tx_head; /* Next byte to write (producers)   */
+static volatile u16 tx_tail; /* Next byte to send  (ISR)         */
+static u32 tx_drops;         /* Number of bytes lost (ring full) */
+static u8  tx_active;        /* Set when at least one byte was sent */
+
+static void uart_disable(void);
+static void uart_enable (void);
+static u32  uart_udiv(u32 n, u32 d);
+
 /**
  * @brief Send end-of-line string CR-LF over UART
  *
@@ -43,8 +62,8 @@ void uart_init(void)
 
 	/* Enable SERCOM3 clock (APBCMASK) */
 	reg_set(PM_ADDR + 0x20, (1 << 5));
-	/* Set GCLK for SERCOM3 (generic clock generator 1) */
-	reg16_wr (GCLK_ADDR + 0x02, (1 << 14) | (1 << 8) | 23);
+	/* Set GCLK for SERCOM3 (generic clock generator 7, 48MHz) */
+	reg16_wr (GCLK_ADDR + 0x02, (1 << 14) | (UART_GCLK_ID << 8) | 23);
 
 	/* 2) Initialize UART block   */
 
@@ -57,25 +76,259 @@ void uart_init(void)
 	/* Configure UART */
 	reg_wr(UART_ADDR + 0x00, 0x40100004);
 	reg_wr(UART_ADDR + 0x04, 0x00030000);
-	/* Configure Baudrate */
-	reg_wr(UART_ADDR + 0x0C, CONF_BAUD_RATE);
 
-	/* Set ENABLE into CTRLA */
+	/* Initialize TX ring */
+	tx_head   = 0;
+	tx_tail   = 0;
+	tx_drops  = 0;
+	tx_active = 0;
+
+	/* Configure Baudrate (and set ENABLE into CTRLA) */
+	uart_set_baud(UART_BAUD);
+	/* Enable SERCOM3 interrupt into NVIC */
+	reg_wr(0xE000E100, (1 << 12));
+}
+
+/**
+ * @brief UART interrupt handler (send next byte of TX ring)
+ *
+ */
+void uart_irq(void)
+{
+	/* If the TX ring is empty, disable DRE interrupt */
+	if (tx_tail == tx_head)
+	{
+		reg8_wr(UART_ADDR + 0x14, 0x01);
+		return;
+	}
+	/* Write data */
+	reg_wr((UART_ADDR + 0x28), tx_buffer[tx_tail]);
+	tx_tail = (tx_tail + 1) & (UART_TX_SIZE - 1);
+	tx_active = 1;
+}
+
+/**
+ * @brief Send all pending bytes of the TX ring and wait end of transmission
+ *
+ * This function use polling, so it can be called with interrupts disabled.
+ */
+void uart_flush(void)
+{
+	u32 irq;
+
+	irq = irq_save();
+	while (tx_tail != tx_head)
+	{
+		/* Read INTFLAG and wait DRE (Data Register Empty) */
+		while ( (reg_rd(UART_ADDR + 0x18) & 0x01) == 0)
+			;
+		reg_wr((UART_ADDR + 0x28), tx_buffer[tx_tail]);
+		tx_tail = (tx_tail + 1) & (UART_TX_SIZE - 1);
+		tx_active = 1;
+	}
+	/* Wait TXC (Transmit Complete) for the last byte */
+	if (tx_active)
+	{
+		while ( (reg_rd(UART_ADDR + 0x18) & 0x02) == 0)
+			;
+	}
+	irq_restore(irq);
+}
+
+/**
+ * @brief Set the UART baudrate
+ *
+ * The baud generator use fractional mode (1/8 resolution) so the error is
+ * low even for high rates. Oversampling is 16x up to 3Mbaud, then 8x (up to
+ * 6Mbaud). Pending bytes are sent (with old rate) before the change.
+ *
+ * @param baud New baudrate (bits per second)
+ * @return integer Zero on success, -1 if the rate can not be generated
+ */
+int uart_set_baud(u32 baud)
+{
+	u32 sampr;
+	u32 val;
+
+	if (baud == 0)
+		return(-1);
+
+	/* BAUD + FP/8 = fref / (S * baud), computed in 1/8 units */
+	if (baud <= (UART_GCLK / 16))
+	{
+		sampr = 1; /* 16x, fractional */
+		val = uart_udiv((UART_GCLK / 2) + (baud / 2), baud);
+	}
+	else
+	{
+		sampr = 3; /*  8x, fractional */
+		val = uart_udiv(UART_GCLK + (baud / 2), baud);
+	}
+	/* Integer part must be in 1..8191 (13 bits) */
+	if ((val < 8) || (val > 0xFFFF))
+		return(-1);
+
+	uart_flush();
+	uart_disable();
+	/* Update SAMPR into CTRLA */
+	reg_wr(UART_ADDR + 0x00, (reg_rd(UART_ADDR + 0x00) & ~(7 << 13))
+	                         | (sampr << 13));
+	/* Set BAUD (bits 12:0) and FP (bits 15:13) */
+	reg16_wr(UART_ADDR + 0x0C, ((val & 7) << 13) | (val >> 3));
+	uart_enable();
+	return(0);
+}
+
+/**
+ * @brief Set the UART frame format
+ *
+ * @param bits   Number of data bits (5 to 9)
+ * @param parity Parity mode (UART_PARITY_NONE, UART_PARITY_EVEN or ODD)
+ * @param stop   Number of stop bits (1 or 2)
+ * @return integer Zero on success, -1 if the format is not supported
+ */
+int uart_set_format(int bits, int parity, int stop)
+{
+	u32 ctrla, ctrlb;
+
+	if ((bits < 5) || (bits > 9) || (stop < 1) || (stop > 2))
+		return(-1);
+	if ((parity < UART_PARITY_NONE) || (parity > UART_PARITY_ODD))
+		return(-1);
+
+	uart_flush();
+	uart_disable();
+
+	/* CTRLA: FORM (bits 27:24) is 1 for a frame with parity */
+	ctrla = reg_rd(UART_ADDR + 0x00) & ~(0x0F << 24);
+	if (parity != UART_PARITY_NONE)
+		ctrla |= (1 << 24);
+	reg_wr(UART_ADDR + 0x00, ctrla);
+
+	/* CTRLB: keep RXEN/TXEN, set CHSIZE (8 bits is 0, 9 bits is 1) */
+	ctrlb = reg_rd(UART_ADDR + 0x04) & ~((1 << 13) | (1 << 6) | 7);
+	ctrlb |= (bits & 7);
+	if (stop == 2)
+		ctrlb |= (1 << 6);  /* SBMODE */
+	if (parity == UART_PARITY_ODD)
+		ctrlb |= (1 << 13); /* PMODE  */
+	reg_wr(UART_ADDR + 0x04, ctrlb);
+	/* Wait CTRLB synchronization */
+	while (reg_rd(UART_ADDR + 0x1C) & (1 << 2))
+		;
+
+	uart_enable();
+	return(0);
+}
+
+/**
+ * @brief Disable UART (needed to modify enable-protected registers)
+ *
+ */
+static void uart_disable(void)
+{
+	/* Clear ENABLE into CTRLA, then wait synchronization */
+	reg_wr(UART_ADDR + 0x00, reg_rd(UART_ADDR + 0x00) & ~(1 << 1));
+	while (reg_rd(UART_ADDR + 0x1C) & (1 << 1))
+		;
+}
+
+/**
+ * @brief Enable UART
+ *
+ */
+static void uart_enable(void)
+{
+	/* Set ENABLE into CTRLA, then wait synchronization */
 	reg_set( (UART_ADDR + 0x00), (1 << 1) );
+	while (reg_rd(UART_ADDR + 0x1C) & (1 << 1))
+		;
+}
+
+/**
+ * @brief Unsigned integer division (no hardware divider on Cortex-M0+)
+ *
+ * @param n Dividend
+ * @param d Divisor (must not be zero)
+ * @return u32 Quotient of n / d
+ */
+static u32 uart_udiv(u32 n, u32 d)
+{
+	u32 q = 0;
+	u32 r = 0;
+	int i;
+
+	for (i = 31; i >= 0; i--)
+	{
+		r = (r << 1) | ((n >> i) & 1);
+		if (r >= d)
+		{
+			r -= d;
+			q |= (1UL << i);
+		}
+	}
+	return(q);
+}
+
+/**
+ * @brief Get the number of bytes dropped because TX ring was full
+ *
+ * @return u32 Number of dropped bytes since uart_init()
+ */
+u32 uart_drops(void)
+{
+	return(tx_drops);
+}
+
+/**
+ * @brief Get the number of bytes that can be queued without loss
+ *
+ * @return integer Free space into TX ring (in bytes)
+ */
+int uart_free(void)
+{
+	return((tx_tail - tx_head - 1) & (UART_TX_SIZE - 1));
 }
 
 /**
- * @brief Send a single byte over UART
+ * @brief Queue a single byte to send over UART
+ *
+ * The byte is sent by interrupt. When the TX ring is full, the byte is
+ * dropped (and counted) unless UART_TX_BLOCK is defined : in this case, the
+ * oldest byte is sent by polling to make room (usable from any context).
  *
  * @param c Character (or binary byte) to send
  */
 void uart_putc(unsigned char c)
 {
-	/* Read INTFLAG and wait DRE (Data Register Empty) */
-	while ( (reg_rd(UART_ADDR + 0x18) & 0x01) == 0)
-		;
-	/* Write data */
-	reg_wr((UART_ADDR + 0x28), c);
+	u32 irq;
+	u16 next;
+
+	irq = irq_save();
+
+	next = (tx_head + 1) & (UART_TX_SIZE - 1);
+	/* If the TX ring is full */
+	if (next == tx_tail)
+	{
+#ifdef UART_TX_BLOCK
+		/* Read INTFLAG and wait DRE (Data Register Empty) */
+		while ( (reg_rd(UART_ADDR + 0x18) & 0x01) == 0)
+			;
+		/* Send the oldest byte to make room */
+		reg_wr((UART_ADDR + 0x28), tx_buffer[tx_tail]);
+		tx_tail = (tx_tail + 1) & (UART_TX_SIZE - 1);
+#else
+		tx_drops++;
+		irq_restore(irq);
+		return;
+#endif
+	}
+	tx_buffer[tx_head] = c;
+	tx_head = next;
+	/* Enable DRE interrupt (INTENSET) */
+	reg8_wr(UART_ADDR + 0x16, 0x01);
+
+	irq_restore(irq);
 }
 
 /**
@@ -18,14 +18,24 @@
 
 #include "types.h"
 
+#define UART_PARITY_NONE 0
+#define UART_PARITY_EVEN 1
+#define UART_PARITY_ODD  2
+
 void uart_crlf(void);
 void uart_dump(u8 *d, int l);
+u32  uart_drops(void);
+void uart_flush(void);
+int  uart_free (void);
 void uart_init(void);
+void uart_irq (void);
 void uart_putc(unsigned char c);
 void uart_puts(char *s);
 void uart_puthex  (const u32 c);
 void uart_puthex8 (const u8  c);
 void uart_puthex16(const u16 c);
+int  uart_set_baud  (u32 baud);
+int  uart_set_format(int bits, int parity, int stop);
 
 #endif
 /* EOF */
@@ -15,6 +15,7 @@
  */
 #include "hardware.h"
 #include "libc.h"
+#include "prof.h"
 #include "types.h"
 #include "usb.h"
 
@@ -51,6 +52,7 @@ void usb_config(usb_module *mod)
 		mod->ep_status[i].size  = 0;
 		mod->ep_status[i].count = 0;
 		mod->ep_status[i].flags = 0;
+		mod->ep_status[i].queue = 0;
 	}
 
 	/* Wait end of a synchronization reset */
@@ -95,6 +97,17 @@ void usb_config(usb_module *mod)
 	reg16_wr(USB_ADDR + 0x08, reg16_rd(USB_ADDR + 0x08) & 0xFFFE);
 }
 
+/**
+ * @brief Get a pointer to the counters of the USB module
+ *
+ * @param mod Pointer to the USB module configuration
+ * @return Pointer to the statistics block
+ */
+usb_stats *usb_get_stats(usb_module *mod)
+{
+	return(&mod->stats);
+}
+
 /**
  * @brief Find a specific descriptor into the descriptors arrays
  *
@@ -188,10 +201,11 @@ void usb_init(void)
  *
  * @param mod Pointer to the USB module configuration
  */
-void usb_irq(usb_module *mod)
+RAMFUNC_USB void usb_irq(usb_module *mod)
 {
 	u32 status;
 	u16 epint = reg16_rd(USB_ADDR + 0x20);
+	PROF_START(PROF_USB_IRQ);
 
 	/* Read interrupt status flags */
 	status  = reg16_rd(USB_ADDR + 0x1C);
@@ -218,6 +232,7 @@ void usb_irq(usb_module *mod)
 			reg16_wr(USB_ADDR + 0x18, (1 << 0));
 
 			/* Bus has been reset, reset module and status */
+			mod->stats.reset++;
 			usb_reset(mod);
 		}
 		/* If the WAKEUP bit is set */
@@ -259,6 +274,7 @@ void usb_irq(usb_module *mod)
 			mask <<= 1;
 		}
 	}
+	PROF_END(PROF_USB_IRQ);
 }
 
 /**
@@ -286,14 +302,93 @@ void usb_reset(usb_module *mod)
 	usb_ep_enable(mod, 0, 0x11);
 }
 
-void usb_transfer(usb_module *mod, u8 ep, u8* data, int len)
+/**
+ * @brief Queue a transfer request on an endpoint
+ *
+ * The request is started immediately if the endpoint is idle, else it is
+ * started (from ISR) when all the previous requests are complete. The
+ * complete() callback of each request is called in submit order.
+ *
+ * @param mod Pointer to the USB module configuration
+ * @param ep  Endpoint number (with EP_DIR_IN flag for IN transfers)
+ * @param req Pointer to the request to submit
+ * @return integer Zero on success, negative value on error
+ */
+int usb_submit(usb_module *mod, u8 ep, usb_request *req)
+{
+	ep_status   *status;
+	usb_request *last;
+	int start = 0;
+	u32 irq;
+
+	/* Sanity check */
+	if (((ep & 0x7F) == 0) || ((ep & 0x7F) > 7) || (req == 0))
+		return(-1);
+
+	status = &mod->ep_status[ep & 0x7F];
+
+	/* Disable interrupts while the queue is updated (can be called from */
+	/* a completion callback, so previous state is restored at the end) */
+	irq = irq_save();
+	last = status->queue;
+	if (last != 0)
+	{
+		/* Search the end of the queue, reject an already queued request */
+		for ( ; last != req; last = last->next)
+		{
+			if (last->next == 0)
+				break;
+		}
+		if (last == req)
+		{
+			irq_restore(irq);
+			return(-1);
+		}
+	}
+	/* Request is not queued, it can be initialized */
+	req->count = 0;
+	req->next  = 0;
+	if (last == 0)
+	{
+		status->queue = req;
+		start = 1;
+	}
+	else
+		last->next = req;
+	/* If the endpoint was idle, start this request now */
+	if (start && usb_transfer(mod, ep, req->data, req->size))
+	{
+		/* Endpoint used by a transfer without request */
+		status->queue = 0;
+		start = -1;
+	}
+	irq_restore(irq);
+
+	return( (start < 0) ? -1 : 0 );
+}
+
+/**
+ * @brief Start a transfer on an endpoint
+ *
+ * @param mod  Pointer to the USB module configuration
+ * @param ep   Endpoint number (with EP_DIR_IN flag for IN transfers)
+ * @param data Pointer to the data buffer
+ * @param len  Number of bytes to transfer
+ * @return integer Zero on success, negative value if endpoint is busy
+ */
+int usb_transfer(usb_module *mod, u8 ep, u8* data, int len)
 {
 	int dir = (ep & EP_DIR_IN);
 
 	/* Clear the direction bit into endpoint id */
 	ep &= 0x7F;
 
-	// ToDo Test if endpoint ID is less or equal than max value
+	/* Sanity check : only 8 endpoints are available */
+	if (ep > 7)
+		return(-1);
+	/* A data endpoint must be idle to start a new transfer */
+	if ((ep > 0) && (mod->ep_status[ep].flags & EP_BUSY))
+		return(-1);
 
 	mod->ep_status[ep].count  = 0;
 	mod->ep_status[ep].size   = len;
@@ -302,6 +397,10 @@ void usb_transfer(usb_module *mod, u8 ep, u8* data, int len)
 
 	if (len == 0)
 		mod->ep_status[ep].flags |= EP_ZLP;
+	/* A bulk IN transfer that ends on a full packet must be terminated by
+	 * a ZLP, else the host waits for more datas (ECM frame never ends) */
+	else if (dir && (ep > 0) && ((len & (USB_EP_SIZE - 1)) == 0))
+		mod->ep_status[ep].flags |= EP_ZLP;
 
 	if (dir)
 	{
@@ -310,6 +409,8 @@ void usb_transfer(usb_module *mod, u8 ep, u8* data, int len)
 	}
 	else
 		ep_transfer_out(mod, ep, 0);
+
+	return(0);
 }
 
 /**
@@ -364,6 +465,8 @@ void usb_ep_enable(usb_module *mod, u8 ep, u8 mode)
 
 	mod->ep_status[ep].flags = 0;
 	mod->ep_status[ep].size = 0;
+	/* Pending requests are dropped when endpoint is (re)configured */
+	mod->ep_status[ep].queue = 0;
 
 	/* If the OUT channel is used */
 	if (mode & 0x0F)
@@ -416,7 +519,7 @@ void usb_ep_enable(usb_module *mod, u8 ep, u8 mode)
  * @param mod Pointer to the USB module configuration
  * @param ep  Endpoint number
  */
-static void ep_irq(usb_module *mod, u8 ep)
+RAMFUNC_USB static void ep_irq(usb_module *mod, u8 ep)
 {
 	u32 ep_addr = (USB_ADDR + 0x100 + (ep << 5));
 	u8 flags = reg8_rd(ep_addr + 0x07);
@@ -427,21 +530,31 @@ static void ep_irq(usb_module *mod, u8 ep)
 		/* ==== Setup transaction ==== */
 
 		if (flags & (1 << 4))
+		{
+			mod->stats.setup++;
 			ep_transfer_setup(mod, 0);
+		}
 		/* If STALL1 bit is set */
 		else if (flags & (1 << 6))
-			// ToDo : do something with this event ?
+		{
+			mod->stats.stall++;
 			reg8_wr(ep_addr + 0x07, (1 << 6));
+		}
 		/* If STALL0 bit is set */
 		else if (flags & (1 << 5))
-			// ToDo : do something with this event ?
+		{
+			mod->stats.stall++;
 			reg8_wr(ep_addr + 0x07, (1 << 5));
+		}
 		/* If Transfer Complete flag is set (TRCPT0) */
 		else if (flags & (1 << 0))
 			reg8_wr(ep_addr + 0x07, (1 << 0));
 		/* If Transfer Fail flag is set (TRFAIL0) */
 		else if (flags & (1 << 2))
+		{
+			mod->stats.trfail_out++;
 			reg8_wr(ep_addr + 0x07, (1 << 2));
+		}
 	}
 	/* If the DIR flag is set : IN */
 	else if (mod->ep_status[ep].flags & EP_DIR_IN)
@@ -449,12 +562,14 @@ static void ep_irq(usb_module *mod, u8 ep)
 		/* If Transfer Stall on bank 1 (TRSTALL1) */
 		if (flags & (1 << 6))
 		{
+			mod->stats.stall++;
 			/* Ack/clear event */
 			reg8_wr(ep_addr + 0x07, (1 << 6));
 		}
 		/* If Transfer Fail on bank 1 (TRFAIL1) */
 		else if (flags & (1 << 3))
 		{
+			mod->stats.trfail_in++;
 			/* Clear Bank1 status */
 			mod->ep_desc[ep].b1_status_bk = 0;
 			/* Ack/Clear the event into flags */
@@ -483,6 +598,7 @@ static void ep_irq(usb_module *mod, u8 ep)
 		/* In case of a STALL event (STALL0) */
 		if (flags & (1 << 5))
 		{
+			mod->stats.stall++;
 			/* Ack/clear the TRCPT interrupt */
 			reg8_wr(ep_addr + 0x07, (1 << 5));
 		}
@@ -497,6 +613,7 @@ static void ep_irq(usb_module *mod, u8 ep)
 		/* If a Tranfer Fail has been detected (TRFAIL0) */
 		else if (flags & (1 << 2))
 		{
+			mod->stats.trfail_out++;
 			/* Clear Bank0 status */
 			mod->ep_desc[ep].b0_status_bk = 0;
 			/* Disable this interrupt */
@@ -524,7 +641,21 @@ static void ep_transfer_complete(usb_module *mod, u8 ep)
 
 	if (ep > 0)
 	{
-		if (mod->class && mod->class->xfer)
+		usb_request *req = mod->ep_status[ep].queue;
+
+		/* If the transfer has been started by a queued request */
+		if (req)
+		{
+			req->count = mod->ep_status[ep].count;
+			/* Remove request from queue and start next one (if any) */
+			mod->ep_status[ep].queue = req->next;
+			if (req->next)
+				usb_transfer(mod, dir | ep, req->next->data, req->next->size);
+			/* Inform the owner of the request */
+			if (req->complete)
+				req->complete(mod, req);
+		}
+		else if (mod->class && mod->class->xfer)
 			mod->class->xfer(mod, ep);
 	}
 	/* Else, it is EP0, process end of control transfer */
@@ -557,11 +688,12 @@ static void ep_transfer_complete(usb_module *mod, u8 ep)
  * @param ep  Endpoint number
  * @param isr True when called by an interrupt
  */
-static void ep_transfer_in(usb_module *mod, u8 ep, int isr)
+RAMFUNC_USB static void ep_transfer_in(usb_module *mod, u8 ep, int isr)
 {
 	u32 ep_addr = (USB_ADDR + 0x100 + (ep << 5));
 	int len   = 0;
 	int count = 0;
+	PROF_START(PROF_EP_IN);
 
 	if (isr)
 		count = (mod->ep_desc[ep].b1_pcksize & 0x3FF);
@@ -573,8 +705,8 @@ static void ep_transfer_in(usb_module *mod, u8 ep, int isr)
 
 	/* Compute length of datas to send */
 	len = mod->ep_status[ep].size - mod->ep_status[ep].count;
-	if (len > 64)
-		len = 64; // ToDo: use en size instead of fixed value
+	if (len > USB_EP_SIZE)
+		len = USB_EP_SIZE;
 
 	if (mod->ep_status[ep].count < mod->ep_status[ep].size)
 	{
@@ -623,6 +755,7 @@ static void ep_transfer_in(usb_module *mod, u8 ep, int isr)
 
 		ep_transfer_complete(mod, ep);
 	}
+	PROF_END(PROF_EP_IN);
 }
 
 /**
@@ -632,15 +765,17 @@ static void ep_transfer_in(usb_module *mod, u8 ep, int isr)
  * @param ep  Endpoint number
  * @param isr True if the function is called by interrupt
  */
-static void ep_transfer_out(usb_module *mod, u8 ep, int isr)
+RAMFUNC_USB static void ep_transfer_out(usb_module *mod, u8 ep, int isr)
 {
 	u32 ep_addr = (USB_ADDR + 0x100 + (ep << 5));
 	int len   = mod->ep_status[ep].size;
 	int count = 0;
+	PROF_START(PROF_EP_OUT);
 
 	if (isr)
 	{
-		count = (mod->ep_desc[ep].b0_pcksize & 0x3FF);
+		/* BYTE_COUNT (14 bits), total of a multi-packet transfer */
+		count = (mod->ep_desc[ep].b0_pcksize & 0x3FFF);
 		mod->ep_desc[ep].b0_status_bk = 0;
 		/* Update the number of processed bytes */
 		mod->ep_status[ep].count += count;
@@ -684,6 +819,7 @@ static void ep_transfer_out(usb_module *mod, u8 ep, int isr)
 
 		ep_transfer_complete(mod, ep);
 	}
+	PROF_END(PROF_EP_OUT);
 }
 
 /**
@@ -773,33 +909,30 @@ static void ep_transfer_setup(usb_module *mod, u8 ep)
 
 static void std_get_descriptor(usb_module *mod)
 {
+	/* Data phase is limited to the length requested by the host */
+	u16 wLength = ((mod->ctrl[7] << 8) | mod->ctrl[6]);
+
 	/* Device Descriptor */
 	if (mod->ctrl[3] == 1)
 	{
+		int len = (wLength < 0x12) ? wLength : 0x12;
 		/* Send descriptor content (data phase) */
-		usb_transfer(mod, EP_DIR_IN | 0, mod->desc, 0x12);
+		usb_transfer(mod, EP_DIR_IN | 0, mod->desc, len);
 	}
 	/* Configuration descriptor */
 	else if (mod->ctrl[3] == 2)
 	{
 		u8 *data;
-		u16 wLength;
-		int clen;
-		int i;
+		int len;
 
 		/* Search the configuration into standard descriptors */
-		data = usb_find_desc(mod, 0x00, 0x02, 0, &i);
-		wLength = ((mod->ctrl[7] << 8) | mod->ctrl[6]);
-
-		if (wLength <= 64)
-			clen = wLength;
-		else
-			clen = 64;
-
-		/* Copy descriptor into ep buffer */
-		memcpy(mod->ctrl_in, data, clen);
+		data = usb_find_desc(mod, 0x00, 0x02, 0, 0);
+		/* Send the whole configuration (wTotalLength), or less */
+		len = (data[3] << 8) | data[2];
+		if (len > wLength)
+			len = wLength;
 		/* Send descriptor content (data phase) */
-		usb_transfer(mod, EP_DIR_IN | 0, data, wLength);
+		usb_transfer(mod, EP_DIR_IN | 0, data, len);
 	}
 	/* String Descriptor */
 	else if (mod->ctrl[3] == 3)
@@ -810,6 +943,8 @@ static void std_get_descriptor(usb_module *mod)
 
 		/* Search the string into standard descriptors */
 		data = usb_find_desc(mod, 0x00, 0x03, str_index, &len);
+		if (len > wLength)
+			len = wLength;
 		/* Send descriptor content (data phase) */
 		usb_transfer(mod, EP_DIR_IN | 0, data, len);
 	}
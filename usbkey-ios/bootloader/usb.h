@@ -21,6 +21,8 @@
 #define EP_ADDR    0x10
 #define EP_DIR_IN  0x80
 #define EP_DIR_OUT 0x00
+/* Max packet size of control and bulk endpoints (full speed, power of 2) */
+#define USB_EP_SIZE  64
 
 typedef struct __attribute__((packed))
 {
@@ -38,16 +40,28 @@ typedef struct __attribute__((packed))
 	u8  b1_reserved[5];
 } ep_desc;
 
+struct usb_module;
+
+typedef struct usb_request
+{
+	u8  *data;  /* Pointer to the data buffer         */
+	int  size;  /* Number of bytes to transfer        */
+	int  count; /* Number of transfered bytes (set on completion) */
+	/* Called (from ISR) when the transfer is complete */
+	void (*complete)(struct usb_module *mod, struct usb_request *req);
+	void *priv;
+	struct usb_request *next;
+} usb_request;
+
 typedef struct
 {
 	int size;   /* Number of bytes to transfer        */
 	int count;  /* Number of already transfered bytes */
 	u32 flags;
 	u8  *data;  /* Pointer to the data buffer */
+	usb_request *queue; /* Pending requests, head is in progress */
 } ep_status;
 
-struct usb_module;
-
 typedef struct usb_class
 {
 	void (*enable)(struct usb_module *mod);
@@ -59,6 +73,16 @@ typedef struct usb_class
 	void *priv;
 } usb_class;
 
+/* Counters of USB events */
+typedef struct
+{
+	u32 setup;      /* SETUP packets received                      */
+	u32 trfail_in;  /* IN token while no data ready (NAK, TRFAIL1) */
+	u32 trfail_out; /* OUT token while bank is full (NAK, TRFAIL0) */
+	u32 stall;      /* STALL handshakes sent                       */
+	u32 reset;      /* Bus resets                                  */
+} usb_stats;
+
 typedef struct usb_module
 {
 	ep_desc ep_desc[8]; /* Endpoint descriptors (see datasheet 32.8.4.1) */
@@ -70,12 +94,15 @@ typedef struct usb_module
 	u8        *desc;       /* Pointer to descriptors */
 	u8        *desc_iface; /* Pointer to interface descriptors */
 	usb_class *class;
+	usb_stats  stats;
 } usb_module;
 
 void usb_config   (usb_module *mod);
 void usb_ep_enable(usb_module *mod, u8 ep, u8 mode);
+usb_stats *usb_get_stats(usb_module *mod);
 u8  *usb_find_desc(usb_module *mod, u8 rtype, u8 type, u8 index, int *size);
 void usb_init     (void);
 void usb_irq      (usb_module *mod);
-void usb_transfer (usb_module *mod, u8 ep, u8* data, int len);
+int  usb_submit   (usb_module *mod, u8 ep, usb_request *req);
+int  usb_transfer (usb_module *mod, u8 ep, u8* data, int len);
 #endif
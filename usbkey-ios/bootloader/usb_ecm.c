@@ -22,7 +22,13 @@
 
 static void cb_enable(usb_module *mod);
 static void cb_setup (usb_module *mod);
-static void cb_xfer  (usb_module *mod, u8 ep);
+static void cb_rx_complete(usb_module *mod, usb_request *req);
+static void cb_tx_complete(usb_module *mod, usb_request *req);
+
+static usb_request ecm_rx_req;
+static usb_request ecm_tx_req;
+/* Request used to send back the RX buffer (see net_send_rx) */
+static usb_request ecm_echo_req;
 
 /**
  * @brief Initialize 
@@ -36,7 +42,13 @@ void ecm_init(usb_module *mod, usb_class *obj)
 	/* Configure ECM callback functions */
 	obj->enable = cb_enable;
 	obj->setup  = cb_setup;
-	obj->xfer   = cb_xfer;
+	/* Initialize transfer requests */
+	memset(&ecm_rx_req, 0, sizeof(usb_request));
+	ecm_rx_req.complete = cb_rx_complete;
+	memset(&ecm_tx_req, 0, sizeof(usb_request));
+	ecm_tx_req.complete = cb_tx_complete;
+	memset(&ecm_echo_req, 0, sizeof(usb_request));
+	ecm_echo_req.complete = cb_tx_complete;
 	/* Register the class into USB module */
 	mod->class = obj;
 }
@@ -70,19 +82,106 @@ void ecm_rx_prepare(usb_module *mod)
 	/* Set buffer length to 0 */
 	net->rx_length = 0;
 	/* Start (prepare) a transfer on endpoint */
-	usb_transfer(mod, 1, net->rx_buffer, 512);
+	ecm_rx_req.data = net->rx_buffer;
+	ecm_rx_req.size = 512;
+	ecm_rx_req.priv = net;
+	usb_submit(mod, 1, &ecm_rx_req);
+}
+
+/**
+ * @brief Set the MAC address string of the descriptors
+ *
+ * The string is found from the iMACAddress field of the Ethernet Networking
+ * functional descriptor, descriptors must be into RAM. This string is also
+ * used as serial number of the device.
+ *
+ * @param mod Pointer to the USB module configuration
+ * @param mac MAC address of the host side of the link
+ */
+void ecm_set_mac(usb_module *mod, const u8 *mac)
+{
+	static const char hex[16] = "0123456789ABCDEF";
+	u8 *desc;
+	int i;
+
+	/* Search the Ethernet Networking functional descriptor */
+	for (i = 0; ; i++)
+	{
+		desc = usb_find_desc(mod, 0, 0x24, i, 0);
+		if (desc[0] == 0)
+			return;
+		if (desc[2] == 0x0F)
+			break;
+	}
+	/* Get the string descriptor (index 0 is the language) */
+	desc = usb_find_desc(mod, 0, 0x03, desc[3], 0);
+	if (desc[0] != (2 + 24))
+		return;
+
+	for (i = 0; i < 6; i++)
+	{
+		desc[2 + (i * 4) + 0] = hex[mac[i] >> 4];
+		desc[2 + (i * 4) + 2] = hex[mac[i] & 0x0F];
+	}
+}
+
+/**
+ * @brief Test if a frame is currently sent (or waiting) on bulk IN endpoint
+ *
+ * @param mod Pointer to the USB module
+ * @return integer Non-zero if the endpoint is busy
+ */
+int ecm_tx_busy(usb_module *mod)
+{
+	return(mod->ep_status[2].queue != 0);
 }
 
 /**
  * @brief Send a network packet over USB ECM
  *
+ * The RX buffer (sent back in place) and the TX buffer use their own request.
+ * A request still queued is never modified : the frame is refused.
+ *
  * @param mod    Pointer to network interface structure
  * @param buffer Pointer to the data buffer to send
  * @param size   Size of the packet (in bytes)
+ * @return integer Zero if the frame is queued, -1 on error
  */
-void ecm_tx(usb_module *mod, u8 *buffer, u32 size)
+int ecm_tx(usb_module *mod, u8 *buffer, u32 size)
 {
-	usb_transfer(mod, 0x82, buffer, size);
+	network *net;
+	usb_request *req;
+	usb_request *q;
+
+	if ((mod->class == 0) || (mod->class->priv == 0))
+		return(-1);
+	net = (network *)mod->class->priv;
+
+	if (buffer == net->rx_buffer)
+		req = &ecm_echo_req;
+	else
+		req = &ecm_tx_req;
+	/* Refuse the frame if the request is still in the endpoint queue */
+	for (q = mod->ep_status[2].queue; q != 0; q = q->next)
+	{
+		if (q == req)
+		{
+			net->stats.tx_err++;
+			ECM_PUTS("usb_ecm: TX fails, previous frame not sent\r\n");
+			return(-1);
+		}
+	}
+
+	req->data = buffer;
+	req->size = size;
+	req->priv = net;
+	if (usb_submit(mod, 0x82, req) != 0)
+	{
+		net->stats.tx_err++;
+		ECM_PUTS("usb_ecm: TX fails, endpoint not ready\r\n");
+		return(-1);
+	}
+	return(0);
 }
 
 /**
@@ -95,9 +194,6 @@ void ecm_tx(usb_module *mod, u8 *buffer, u32 size)
  */
 void cb_enable(usb_module *mod)
 {
-	network *net;
-	u8      *rx_buffer;
-
 	/* Enable endpoint 1 for datas host -> device (bulk OUT) */
 	usb_ep_enable(mod, 1, 0x03);
 	/* Enable endpoint 2 for datas device -> host (bulk IN) */
@@ -105,22 +201,8 @@ void cb_enable(usb_module *mod)
 	/* Enable endpoint 3 for CDC control (interrupt IN) */
 	usb_ep_enable(mod, 3, 0x40);
 
-	/* Sanity check : a network interface must been attached to the ECM */
-	if ((mod->class == 0) || (mod->class->priv == 0))
-	{
-		ECM_PUTS("esb_ecm: Enable error, no network intferface\r\n");
-		return;
-	}
-
-	/* Get network interface from USB class private data */
-	net = (network *)mod->class->priv;
-	/* Get RX buffer (if any) */
-	rx_buffer = net->rx_buffer;
-
-	if (rx_buffer)
-		usb_transfer(mod, 1, rx_buffer, 512);
-	else
-		ECM_PUTS("usb_ecm: Enable error, no RX buffer\r\n");
+	/* Start reception of the first frame */
+	ecm_rx_prepare(mod);
 }
 
 /**
@@ -149,35 +231,48 @@ static void cb_setup (usb_module *mod)
 }
 
 /**
- * @brief Called by USB layer when a transfer is complete on ECM endpoint
+ * @brief Called by USB layer when a frame has been received (bulk OUT)
  *
  * @param mod Pointer to the USB module
- * @param ep  Endpoint id
+ * @param req Pointer to the completed RX request
  */
-static void cb_xfer(usb_module *mod, u8 ep)
+static void cb_rx_complete(usb_module *mod, usb_request *req)
 {
-	network *net;
+	network *net = (network *)req->priv;
+	int len  = req->count;
+	int flow;
 
-	if ((mod->class == 0) || (mod->class->priv == 0))
+	/* Pre-classify the frame, drop it now if not useful */
+	flow = net_rx_classify(net, &len);
+	if (flow < 0)
 	{
-		ECM_PUTS("usb_ecn: ERROR, no network interface\r\n");
+		/* Re-arm reception without waking up the main loop */
+		usb_submit(mod, 1, req);
 		return;
 	}
+	net->rx_flow = flow;
+	/* Update buffer length wth count of received datas */
+	net->rx_length = len;
+}
 
-	/* Get network interface from USB class private data */
-	net = (network *)mod->class->priv;
+/**
+ * @brief Called by USB layer when a frame has been sent (bulk IN)
+ *
+ * @param mod Pointer to the USB module
+ * @param req Pointer to the completed TX request
+ */
+static void cb_tx_complete(usb_module *mod, usb_request *req)
+{
+	network *net = (network *)req->priv;
 
-	switch (ep)
+	/* RX buffer sent back in place : it can be used again for reception */
+	if (req == &ecm_echo_req)
 	{
-		/* RX */
-		case 0x01:
-			/* Update buffer length wth count of received datas */
-			net->rx_length = mod->ep_status[ep].count;
-			break;
-		/* TX */
-		case 0x02:
-			/* Clear ethernet header */
-			memset(net->tx_buffer, 0, 14);
+		ecm_rx_prepare(mod);
+		net->rx_state = NET_RX_READY;
+		return;
 	}
+	/* Clear ethernet header */
+	memset(net->tx_buffer, 0, 14);
 }
 /* EOF */
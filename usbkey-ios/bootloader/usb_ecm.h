@@ -26,5 +26,7 @@
 
 void ecm_init(usb_module *mod, usb_class *obj);
 void ecm_rx_prepare(usb_module *mod);
-void ecm_tx(usb_module *mod, u8 *buffer, u32 size);
+void ecm_set_mac(usb_module *mod, const u8 *mac);
+int  ecm_tx(usb_module *mod, u8 *buffer, u32 size);
+int  ecm_tx_busy(usb_module *mod);
 #endif